@@ -0,0 +1,75 @@
+/**
+* @file calstore.c
+* @brief Calibration store
+*
+* Versioned, CRC-protected calibration record in INFO flash
+*
+* The record sits at the start of INFO bank 0 sector 0 (the flash mailbox
+* area, unused by this application). Loading is a header check and a CRC
+* over the record, a few microseconds; any mismatch (erased flash, older
+* layout, corruption) makes Cal_load fail so the caller falls back to live
+* calibration. Saving erases and reprograms the sector and stalls the CPU
+* for the erase time, so it is meant for one-off writes.
+*
+* @author Lucas Tiziani
+* @date 2021-01-12
+*
+*/
+
+
+#include "calstore.h"
+
+
+uint32_t Cal_crc32(const void * data, int num_bytes) {
+    /* CRC-32 (IEEE 802.3, reflected): half-byte table */
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t * bytes = data;
+    uint32_t crc = 0xFFFFFFFF;
+    int i;
+    for (i = 0; i < num_bytes; i++) {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+
+static bool Cal_isValid(const cal_record_t * rec) {
+    /* Check header and CRC */
+    return (rec->magic == CAL_MAGIC) && (rec->version == CAL_VERSION)
+        && (rec->size == sizeof(cal_record_t))
+        && (rec->crc == Cal_crc32(rec, sizeof(cal_record_t) - sizeof(uint32_t)));
+}
+
+
+bool Cal_load(cal_record_t * rec) {
+    /* Copy calibration record from flash: returns 0 if missing or corrupt */
+    const cal_record_t * rec_flash = (const cal_record_t *)CAL_ADDR;
+    if (!Cal_isValid(rec_flash)) {
+        return 0;
+    }
+    *rec = *rec_flash;
+    return 1;
+}
+
+
+bool Cal_save(cal_record_t * rec) {
+    /* Fill header and CRC, write record to flash: returns 0 on failure */
+    rec->magic = CAL_MAGIC;
+    rec->version = CAL_VERSION;
+    rec->size = sizeof(cal_record_t);
+    rec->crc = Cal_crc32(rec, sizeof(cal_record_t) - sizeof(uint32_t));
+
+    bool ok = MAP_FlashCtl_unprotectSector(CAL_FLASH_BANK, CAL_FLASH_SECTOR);
+    ok = ok && MAP_FlashCtl_eraseSector((uint32_t)CAL_ADDR);
+    ok = ok && MAP_FlashCtl_programMemory(rec, (void *)CAL_ADDR, sizeof(cal_record_t));
+    MAP_FlashCtl_protectSector(CAL_FLASH_BANK, CAL_FLASH_SECTOR);
+
+    return ok && Cal_isValid((const cal_record_t *)CAL_ADDR);
+}
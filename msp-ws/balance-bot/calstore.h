@@ -0,0 +1,54 @@
+/**
+* @file calstore.h
+* @brief Calibration store
+*
+* Versioned, CRC-protected calibration record in INFO flash
+*
+* @author Lucas Tiziani
+* @date 2021-01-12
+*
+*/
+
+#ifndef CALSTORE_H_
+#define CALSTORE_H_
+
+
+#include "driverlib.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* Macros */
+#ifndef CAL_ADDR
+#define CAL_ADDR 0x00200000         // INFO flash bank 0 sector 0 (record start)
+#endif
+#define CAL_FLASH_BANK FLASH_INFO_MEMORY_SPACE_BANK0
+#define CAL_FLASH_SECTOR FLASH_SECTOR0
+
+#define CAL_MAGIC 0x4C414342        // "BCAL": also keeps flash mailbox start key from matching
+#define CAL_VERSION 4               // record layout version: bump when cal_record_t changes
+
+
+/* Data types */
+typedef struct {
+    uint32_t magic;             // CAL_MAGIC
+    uint16_t version;           // CAL_VERSION
+    uint16_t size;              // (bytes) record size
+    float gyro_offset[3];       // (deg/s) gyro angular velocity offset at IMU reference temperature
+    float gyro_temp_coef[3][2]; // (deg/s/degC, deg/s/degC^2) gyro offset change with temperature
+    float accel_bias[3];        // (g) accelerometer bias
+    float accel_mat[3][3];      // accelerometer scale/misalignment correction
+    float deadzone[2];          // (% duty cycle) motor dead zone (right, left)
+    float motor_gain[2];        // ((deg/s)/%) motor steady-state velocity per duty above dead zone
+    float motor_tau[2];         // (s) motor velocity time constant
+    uint32_t crc;               // CRC-32 of all preceding bytes
+} cal_record_t;
+
+
+/* Function prototypes */
+uint32_t Cal_crc32(const void * data, int num_bytes);
+bool Cal_load(cal_record_t * rec);
+bool Cal_save(cal_record_t * rec);
+
+
+#endif /* CALSTORE_H_ */
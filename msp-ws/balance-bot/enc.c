@@ -13,153 +13,311 @@
 /* TODO
  * make encoder channels, degrees per count, LPF order configurable
  * move LPF coefficients to configuration
- * pass encoder read frequency to Enc_calcAngle
  */
 
 
 #include "enc.h"
+#include <math.h>
 
+#define PI 3.14159265f
 
-void Enc_init(enc_t * enc) {
-    /* Initialize encoder based on current channel states */
-    int i; // channel index
-//    int pins_or; // bitwise OR of all encoder pins
-    uint8_t state_chan[2]; // encoder channel states
-    for (i = 0; i < 2; i++) { // loop over encoder channels A & B
 
-        state_chan[i] = MAP_GPIO_getInputPinValue(enc->port, enc->pins[i]); // get encoder channel state
-        if (state_chan[i] == GPIO_INPUT_PIN_LOW) { // if channel is low
-            MAP_GPIO_interruptEdgeSelect(enc->port, enc->pins[i], GPIO_LOW_TO_HIGH_TRANSITION); // set low to high transition
+#if ENC_VEL_EST == ENC_VEL_FIR
+static const float lpf_coeffs[ENC_LPF_ORDER+1] = {-0.00081606,-0.00348667,
+    -0.00846865,-0.01369406,-0.01349162,0.00002764,0.03264918,0.08284379,
+    0.13937502,0.18445740,0.20170049,0.18445740,0.13937502,0.08284379,
+    0.03264918,0.00002764,-0.01349162,-0.01369406,-0.00846865,-0.00348667,
+    -0.00081606};
+#endif
+
+void Enc_initTimer(void) {
+    /* Start free-running 32-bit edge timestamp timer */
+    MAP_Timer32_initModule((uint32_t)(uintptr_t)ENC_TIMER, TIMER32_PRESCALER_1, TIMER32_32BIT,
+        TIMER32_FREE_RUN_MODE);
+    MAP_Timer32_startTimer((uint32_t)(uintptr_t)ENC_TIMER, false);
+}
+
+
+void Enc_init(enc_t * enc, float period) {
+    /* Initialize encoder based on current channel states (interrupt mode: channel B on the pin above channel A) */
+    #if ENC_MODE == ENC_MODE_TIMER
+        enc->shift = 0;
+        while (!((enc->pins[1] >> enc->shift) & 0x01)) {
+            enc->shift++;
         }
-        else { // if channel is high
-            MAP_GPIO_interruptEdgeSelect(enc->port, enc->pins[i], GPIO_HIGH_TO_LOW_TRANSITION); // set high to low transition
+        enc->mask = enc->pins[1];
+        ENC_PORT->IES &= ~enc->mask; // channel B rising edge only
+
+        const Timer_A_ContinuousModeConfig count_config =
+        {   TIMER_A_CLOCKSOURCE_EXTERNAL_TXCLK, // channel A on TAxCLK
+            TIMER_A_CLOCKSOURCE_DIVIDER_1,      // count every rising edge
+            TIMER_A_TAIE_INTERRUPT_DISABLE,     // disable timer A rollover interrupt
+            TIMER_A_DO_CLEAR                    // clear counter upon initialization
+        };
+        MAP_Timer_A_configureContinuousMode(enc->timer_a, &count_config);
+        MAP_Timer_A_startCounter(enc->timer_a, TIMER_A_CONTINUOUS_MODE);
+        enc->tar_ref = MAP_Timer_A_getCounterValue(enc->timer_a);
+    #else
+        enc->shift = 0;
+        while (!((enc->pins[0] >> enc->shift) & 0x01)) {
+            enc->shift++;
         }
-//        pins_or |= enc->pins[i]; // add channel pin to bitwise OR
+        enc->mask = enc->pins[0] | enc->pins[1];
+
+        uint8_t in = ENC_PORT->IN;
+        ENC_PORT->IES ^= (ENC_PORT->IES ^ in) & enc->mask; // interrupt on edge away from current level
+        enc->state_prev = (in >> enc->shift) & 0x03;
+        #if ENC_MIN_EDGE_SPACING > 0
+            enc->state_undo = ENC_STATE_NONE;
+        #endif
+    #endif
+    enc->t_edge = ENC_TIME();
+    enc->count_calc = enc->count;
+    enc->t_edge_calc = enc->t_edge;
+    enc->dir = 0;
+    enc->illegal = 0;
+    enc->missed = 0;
+    enc->glitches = 0;
+    enc->dt_edge_min = UINT32_MAX;
+    enc->period = period;
+
+    #if ENC_VEL_EST == ENC_VEL_FIR
+        Filt_initFir(&enc->lpf_vel, lpf_coeffs, enc->lpf_vel_buf, ENC_LPF_ORDER);
+    #elif ENC_VEL_EST == ENC_VEL_BIQUAD
+        // Butterworth low-pass by bilinear transform with prewarped cutoff
+        float k = tanf(PI*ENC_LPF_CUTOFF*period);
+        float norm = 1.0f/(1.0f + 1.41421356f*k + k*k);
+        float * c = enc->lpf_vel_coeffs[0];
+        c[0] = k*k*norm;
+        c[1] = 2.0f*c[0];
+        c[2] = c[0];
+        c[3] = 2.0f*(k*k - 1.0f)*norm;
+        c[4] = (1.0f - 1.41421356f*k + k*k)*norm;
+        Filt_initBiquad(&enc->lpf_vel, (const float (*)[5])enc->lpf_vel_coeffs,
+            enc->lpf_vel_state, 1);
+    #elif ENC_VEL_EST == ENC_VEL_AB
+        // both observer poles at r: alpha = 1 - r^2, beta = (1 - r)^2
+        float r = expf(-2.0f*PI*ENC_AB_FREQ*period);
+        enc->ab_alpha = 1.0f - r*r;
+        enc->ab_beta = (1.0f - r)*(1.0f - r)/period;
+        enc->ab_pos = (float)enc->count*ENC_DEG_PER_COUNT;
+    #endif
+    enc->vel_filt = 0.0f;
+    enc->delay_vel = Enc_calcVelDelay(enc, ENC_DELAY_FREQ);
+}
+
+
+#if ENC_MODE == ENC_MODE_TIMER
+void Enc_updatePort(enc_t * const * encs, int num_enc) {
+    /* Encoder port interrupt routine: on channel B rising edge, add timer counts and latch direction */
+    uint8_t mask = 0;
+    int i;
+    for (i = 0; i < num_enc; i++) {
+        mask |= encs[i]->mask;
     }
-    enc->state_prev = (state_chan[0] << 1) | state_chan[1]; // set previous encoder state to current encoder state
-//        MAP_GPIO_interruptEdgeSelect(GPIO_PORT_P3, encPins[iEnc][2], GPIO_LOW_TO_HIGH_TRANSITION); // set low to high transition for channel X
-//        pins_or |= encPins[iEnc][2]; // add channel pin to bitwise OR
+    uint8_t flags = ENC_PORT->IFG & mask;
+    ENC_PORT->IFG &= ~flags;
+    uint32_t time = ENC_TIME();
+
+    for (i = 0; i < num_enc; i++) {
+        enc_t * enc = encs[i];
+        if (!(flags & enc->mask)) {
+            continue;
+        }
+        // channel A rises just before B going forward and just after B in reverse: edges since
+        // the last latch net to zero when direction changed (one each way, or one either way)
+        int8_t dir = MAP_GPIO_getInputPinValue(enc->port_a, enc->pins[0]) ? 1 : -1; // A high: forward
+        uint16_t tar = MAP_Timer_A_getCounterValue(enc->timer_a);
+        if (dir == enc->dir) {
+            enc->count += ENC_COUNTS_PER_EDGE*dir*(uint16_t)(tar - enc->tar_ref);
+        }
+        enc->dir = dir;
+        enc->tar_ref = tar;
 
-//    MAP_GPIO_clearInterruptFlag(enc->port, pins_or); // clear all interrupt flags
-//    MAP_GPIO_enableInterrupt(enc->port, pins_or); // enable GPIO interrupt
-//    MAP_Interrupt_enableInterrupt(INT_PORT3); // enable interrupt in NVIC
+        uint32_t dt = time - enc->t_edge;
+        if (dt < enc->dt_edge_min) {
+            enc->dt_edge_min = dt;
+        }
+        enc->t_edge = time;
+    }
 }
+#else
+void Enc_updatePort(enc_t * const * encs, int num_enc) {
+    /* Encoder port interrupt routine: decode all encoders from one read of the port input register */
+    static const int8_t inc_count[16] = { // count increment, index (state << 2) | state_prev
+         0, -1,  1,  0,     // state 0 from 0, 1, 2, 3 (3: illegal)
+         1,  0,  0, -1,     // state 1 (2: illegal)
+        -1,  0,  0,  1,     // state 2 (1: illegal)
+         0,  1, -1,  0      // state 3 (0: illegal)
+    };
 
+    uint8_t mask = 0;
+    int i;
+    for (i = 0; i < num_enc; i++) {
+        mask |= encs[i]->mask;
+    }
+    ENC_PORT->IFG &= ~mask; // clear before reading so later edges interrupt again
+    uint8_t in = ENC_PORT->IN;
+    uint32_t time = ENC_TIME();
+    ENC_PORT->IES ^= (ENC_PORT->IES ^ in) & mask; // next interrupt on edge away from current level
 
-void Enc_update(enc_t * enc) {
-    /* encoder interrupt routine: determine which channel of encoder(s) caused interrupt, change encoder counts accordingly */
-//    uint_fast16_t status = MAP_GPIO_getEnab00InterruptStatus(GPIO_PORT_P3); // get port 3 interrupt status
-//
-//    int iEnc; // encoder index
-//    if (status <= (encPins[0][0] | encPins[0][1])) { // check which encoder (| encPins[0][2] for index channel X)
-//        iEnc = 0; // interrupt is for encoder 0
-//    }
-//    else {
-//        iEnc = 1; // interrupt is for encoder 1
-//    }
-
-    uint8_t state_chan[2] = {MAP_GPIO_getInputPinValue(enc->port, enc->pins[0]), // get encoder channels A, B values
-                                MAP_GPIO_getInputPinValue(enc->port, enc->pins[1])};
-    uint8_t state = (state_chan[0] << 1) | state_chan[1]; // combine channels into encoder state
-
-//    if ((status & encPins[iEnc][2]) && (sysState[0] == 1)) { // if index interrupt
-//        encCounts[iEnc] = 0; // reset encoder count
-//    }... else
-
-    uint8_t state_comb = (state << 2) | enc->state_prev; // combine current state and previous state
-    int8_t inc_count; // encoder counter increment
-    switch (state_comb)
-    {
-        case 0: // do nothing
-            inc_count = 0;
-            break;
-        case 1: // count up
-            inc_count = 1;
-            break;
-        case 2: // count down
-            inc_count = -1;
-            break;
-        case 3: // do nothing - this is an error
-            inc_count = 0;
-            break;
-        case 4: // count down
-            inc_count = -1;
-            break;
-        case 5: // do nothing
-            inc_count = 0;
-            break;
-        case 6: // do nothing - this is an error
-            inc_count = 0;
-            break;
-        case 7: // count up
-            inc_count = 1;
-            break;
-        case 8: // count up
-            inc_count = 1;
-            break;
-        case 9: // do nothing - this is an error
-            inc_count = 0;
-            break;
-        case 10: // do nothing
-            inc_count = 0;
-            break;
-        case 11: // count down
-            inc_count = -1;
-            break;
-        case 12: // do nothing - this is an error
-            inc_count = 0;
-            break;
-        case 13: // count down
-            inc_count = -1;
-            break;
-        case 14: // count up
-            inc_count = 1;
-            break;
-        case 15: // do nothing
-            inc_count = 0;
-            break;
+    for (i = 0; i < num_enc; i++) {
+        enc_t * enc = encs[i];
+        uint8_t state = (in >> enc->shift) & 0x03;
+        uint8_t state_prev = enc->state_prev;
+        if (state == state_prev) { // edge was on another encoder
+            continue;
+        }
+        uint32_t dt = time - enc->t_edge;
+        #if ENC_MIN_EDGE_SPACING > 0
+            if ((dt < ENC_MIN_EDGE_SPACING) && (state == enc->state_undo)) { // back to state before last
+                    // edge: both were a glitch, undo count of the first
+                enc->count -= enc->dir;
+                enc->dir = enc->dir_undo;
+                enc->t_edge = enc->t_edge_undo;
+                enc->state_undo = ENC_STATE_NONE;
+                enc->glitches += 2;
+                enc->state_prev = state;
+                continue;
+            }
+        #endif
+
+        int8_t inc = inc_count[(state << 2) | state_prev];
+        if (inc) {
+            #if ENC_MIN_EDGE_SPACING > 0
+                enc->state_undo = state_prev;
+                enc->dir_undo = enc->dir;
+                enc->t_edge_undo = enc->t_edge;
+            #endif
+            enc->count += inc;
+            enc->dir = inc;
+            if (dt < enc->dt_edge_min) {
+                enc->dt_edge_min = dt;
+            }
+            enc->t_edge = time;
+        }
+        else { // both channels changed: one edge was missed
+            #if ENC_MIN_EDGE_SPACING > 0
+                enc->state_undo = ENC_STATE_NONE;
+            #endif
+            enc->illegal++;
+            if (dt < ENC_MISS_WINDOW) { // moving fast: assume two steps in last direction
+                enc->count += 2*enc->dir;
+                enc->missed++;
+                enc->t_edge = time;
+            }
+        }
+        enc->state_prev = state;
     }
-    enc->count = enc->count + inc_count; // increment/decrement encoder count appropriately
-
-    int i; // channel index
-    for (i = 0; i < 2; i++) { // loop over encoder channels A & B
-       if (state_chan[i] == GPIO_INPUT_PIN_LOW) { // if channel is low
-           MAP_GPIO_interruptEdgeSelect(enc->port, enc->pins[i], GPIO_LOW_TO_HIGH_TRANSITION); // set low to high transition
-       }
-       else { // if channel is high
-           MAP_GPIO_interruptEdgeSelect(enc->port, enc->pins[i], GPIO_HIGH_TO_LOW_TRANSITION); // set high to low transition
-       }
+}
+#endif
+
+
+static float Enc_calcVel(enc_t * enc, int count, uint32_t t_edge, uint32_t time) {
+    /* M/T method: counts since last calculation over time between their last edges */
+    float vel_prev = enc->vel_mt;
+    int delta = count - enc->count_calc;
+    if (delta != 0) {
+        float dt = (float)(t_edge - enc->t_edge_calc)*(1.0f/ENC_TIMER_FREQ);
+        enc->count_calc = count;
+        enc->t_edge_calc = t_edge;
+        return (float)delta*ENC_DEG_PER_COUNT/dt;
     }
 
-    enc->state_prev = state; // set previous encoder state to current encoder state
+    // no edge since last calculation: speed is at most one count over time since last edge
+    float dt = (float)(time - t_edge)*(1.0f/ENC_TIMER_FREQ);
+    if (dt > ENC_VEL_TIMEOUT) { // stopped: hold reference edge within timeout, elapsed ticks cannot wrap
+        enc->t_edge_calc = time - ENC_VEL_TIMEOUT_TICKS;
+        return 0.0f;
+    }
+    float vel_max = ENC_COUNTS_PER_EDGE*ENC_DEG_PER_COUNT/dt;
+    if (vel_prev > vel_max) {
+        return vel_max;
+    }
+    if (vel_prev < -vel_max) {
+        return -vel_max;
+    }
+    return vel_prev;
 }
 
 
 void Enc_calcAngle(enc_t * enc) {
-    /* convert encoder counts to angle, differentiate angle, filter angular velocity  */
-    static const float lpfCoeffs[ENC_LPF_ORDER+1] = {-0.00081606,-0.00348667,
-        -0.00846865,-0.01369406,-0.01349162,0.00002764,0.03264918,0.08284379,
-        0.13937502,0.18445740,0.20170049,0.18445740,0.13937502,0.08284379,
-        0.03264918,0.00002764,-0.01349162,-0.01369406,-0.00846865,-0.00348667,
-        -0.00081606};
+    /* convert encoder counts to angle, estimate angular velocity from counts and edge times, filter */
+    uint32_t basepri = criticalEnter(); // keep count and edge time consistent
+    int count = enc->count;
+    int count_edge = count; // count at time of last edge
+    uint32_t t_edge = enc->t_edge;
+    uint32_t time = ENC_TIME();
+    #if ENC_MODE == ENC_MODE_TIMER
+        count += ENC_COUNTS_PER_EDGE*enc->dir*
+            (uint16_t)(MAP_Timer_A_getCounterValue(enc->timer_a) - enc->tar_ref);
+    #endif
+    criticalExit(basepri);
 
     enc->pos[1] = enc->pos[0];// shift angle histories
-    enc->pos[0] = (float)(enc->count)*ENC_DEG_PER_COUNT; // convert counts to angle
+    enc->pos[0] = (float)count*ENC_DEG_PER_COUNT; // convert counts to angle
 
-    // shift angular velocity histories
-    int i = 0;
-    for (i = 0; i < LPF_ORDER; i++) {
-        enc->vel[LPF_ORDER-i] = enc->vel[ENC_LPF_ORDER-(i+1)]; // shift each value right
-    }
+    enc->vel_mt = Enc_calcVel(enc, count_edge, t_edge, time);
+    #if ENC_VEL_EST == ENC_VEL_FIR
+        enc->vel_filt = Filt_updateFir(&enc->lpf_vel, enc->vel_mt);
+    #elif ENC_VEL_EST == ENC_VEL_BIQUAD
+        enc->vel_filt = Filt_updateBiquad(&enc->lpf_vel, enc->vel_mt);
+    #elif ENC_VEL_EST == ENC_VEL_AB
+        float pos_pred = enc->ab_pos + enc->vel_filt*enc->period;
+        float err = enc->pos[0] - pos_pred;
+        enc->ab_pos = pos_pred + enc->ab_alpha*err;
+        enc->vel_filt += enc->ab_beta*err;
+    #endif
+}
 
-    enc->vel[0] = (enc->pos[0]-enc->pos[1])*ENC_CALC_FREQ; // differentiate angle
 
-    // calculate filtered angular velocity
-    float tmp = 0;
-    for (i = 0; i <= (LPF_ORDER+1); i++) {
-        tmp = tmp + lpfCoeffs[i]*enc->vel[i];
+static void Enc_evalPoly(const float * c, int n, float w, float * re, float * im) {
+    /* Evaluate c[0] + c[1] z^-1 + ... + c[n-1] z^-(n-1) at z = e^(jw) */
+    *re = 0.0f;
+    *im = 0.0f;
+    int i;
+    for (i = 0; i < n; i++) {
+        *re += c[i]*cosf(w*i);
+        *im -= c[i]*sinf(w*i);
     }
-    enc->vel_filt = tmp;
+}
+
+
+float Enc_calcVelDelay(const enc_t * enc, float freq) {
+    /* Delay (s) of vel_filt behind true wheel velocity for a sinusoid at freq (Hz) */
+    float w = 2.0f*PI*freq*enc->period; // (rad/sample)
+    float num_re, num_im, den_re, den_im;
+
+    #if ENC_VEL_EST == ENC_VEL_FIR
+        Enc_evalPoly(enc->lpf_vel.coeffs, enc->lpf_vel.num_taps, w, &num_re, &num_im);
+        den_re = 1.0f;
+        den_im = 0.0f;
+    #elif ENC_VEL_EST == ENC_VEL_BIQUAD
+        const float * c = enc->lpf_vel_coeffs[0];
+        const float den[3] = {1.0f, c[3], c[4]};
+        Enc_evalPoly(c, 3, w, &num_re, &num_im);
+        Enc_evalPoly(den, 3, w, &den_re, &den_im);
+    #elif ENC_VEL_EST == ENC_VEL_AB
+        // angle to velocity: beta/T (1 - z^-1)/(1 - (2 - alpha - beta) z^-1 + (1 - alpha) z^-2)
+        float beta = enc->ab_beta*enc->period;
+        const float num[2] = {1.0f, -1.0f};
+        const float den[3] = {1.0f, -(2.0f - enc->ab_alpha - beta), 1.0f - enc->ab_alpha};
+        Enc_evalPoly(num, 2, w, &num_re, &num_im);
+        Enc_evalPoly(den, 3, w, &den_re, &den_im);
+    #endif
+
+    // phase of num/den, from num*conj(den)
+    float re = num_re*den_re + num_im*den_im;
+    float im = num_im*den_re - num_re*den_im;
+    #if ENC_VEL_EST == ENC_VEL_AB
+        float tmp = re; // remove 90 deg lead of differentiation (multiply by -j)
+        re = im;
+        im = -tmp;
+        return -atan2f(im, re)/(2.0f*PI*freq);
+    #else
+        // M/T velocity is the mean over roughly the last sample period: half a period behind
+        return -atan2f(im, re)/(2.0f*PI*freq) + 0.5f*enc->period;
+    #endif
 }
 
 
@@ -14,32 +14,109 @@
 
 
 #include "driverlib.h"
+#include "msp.h"
+#include "filter.h"
+#include "util.h"
 #include <stdint.h>
 
 
 /* Macros */
 #define ENC_NUM_CH 2                    // number of encoder channels (A,B)
-#define ENC_DEG_PER_COUNT 360.0/1400.0  // deg per count
-#define ENC_LPF_ORDER 20                // low-pass velocity filter order
-#define ENC_CALC_FREQ 100.0       // (Hz) frequency at which encoder angles are calculated
-#define LPF_ORDER 20
+#define ENC_DEG_PER_COUNT (360.0f/1400.0f) // deg per count
+#define ENC_LPF_ORDER 20                // FIR velocity filter order
+#define ENC_LPF_CUTOFF 30.0f            // (Hz) Butterworth velocity filter cutoff
+#define ENC_AB_FREQ 30.0f               // (Hz) alpha-beta observer bandwidth (critically damped)
+#define ENC_DELAY_FREQ 5.0f             // (Hz) frequency at which velocity estimate delay is reported
+#define ENC_PORT P3                     // encoder port registers (all encoders share one port)
+#define ENC_TIMER TIMER32_1             // free-running edge timestamp timer (Timer32 module 0)
+#define ENC_TIMER_FREQ 48000000.0f      // (Hz) edge timestamp timer frequency (MCLK)
+#define ENC_TIME() (~(ENC_TIMER->VALUE)) // (ticks) edge timestamp, counts up
+#define ENC_VEL_TIMEOUT 0.2f            // (s) time without edges after which wheel is stopped
+#define ENC_VEL_TIMEOUT_TICKS ((uint32_t)(ENC_VEL_TIMEOUT*ENC_TIMER_FREQ)) // (ticks) ENC_VEL_TIMEOUT
+#define ENC_MISS_WINDOW 240000          // (ticks) double step within 5 ms of last edge counts as missed edge
+#ifndef ENC_MIN_EDGE_SPACING
+#define ENC_MIN_EDGE_SPACING 0          // (ticks) undo edge followed this closely by a return to prior state (0: off)
+#endif
+#define ENC_STATE_NONE 0xFF             // no state to return to: last edge cannot be undone as a glitch
+
+// Timer mode pin mapping: channel A must drive the TAxCLK input of a Timer_A that is free
+// (TA2CLK P4.2, TA3CLK P8.3; TA0CLK/TA1CLK only through port mapping, and TA0/TA1 are
+// PWM and sensor tick), channel B stays on ENC_PORT with a rising edge interrupt.
+// Counts drop to one per channel A period. Dither about a channel A edge and reversals
+// close to a channel B edge can each misplace a period, so wheel angle random-walks while
+// velocity is unaffected. Timer mode cannot be used with the balance controller: wheel
+// angle is LQR state x[0], and its drift moves the balance point. Use it for velocity-only
+// work (motor characterization, speed loops).
+#define ENC_MODE_INT 0                  // counting: quadrature decoding of every edge in port interrupt
+#define ENC_MODE_TIMER 1                // counting: channel A clocks Timer_A, channel B rising edge latches direction
+#ifndef ENC_MODE
+#define ENC_MODE ENC_MODE_INT
+#endif
+#if ENC_MODE == ENC_MODE_TIMER
+#define ENC_COUNTS_PER_EDGE 4           // counts per timestamped edge (channel B rising)
+#else
+#define ENC_COUNTS_PER_EDGE 1           // counts per timestamped edge
+#endif
+
+#define ENC_VEL_FIR 0                   // velocity estimator: linear-phase FIR on M/T velocity
+#define ENC_VEL_BIQUAD 1                // velocity estimator: 2nd-order Butterworth on M/T velocity
+#define ENC_VEL_AB 2                    // velocity estimator: alpha-beta observer on angle
+#ifndef ENC_VEL_EST
+#define ENC_VEL_EST ENC_VEL_BIQUAD
+#endif
 
 /* Data types */
 typedef struct {
     uint8_t port;             // encoder port
     uint8_t pins[ENC_NUM_CH]; // encoder pins corresponding to encoder channels
-    volatile uint8_t state_prev;    // previous encoder state
+    uint8_t shift;                  // bit position of channel A in port (channel B is next bit up)
+    uint8_t mask;                   // port bits of channels A and B (timer mode: B only)
+#if ENC_MODE == ENC_MODE_TIMER
+    uint8_t port_a;                 // channel A port (TAxCLK pin)
+    uint32_t timer_a;               // base of Timer_A clocked by channel A
+    volatile uint16_t tar_ref;      // timer count at last direction latch
+#endif
+    volatile uint8_t state_prev;    // previous encoder state (B << 1 | A)
     volatile int count;             // encoder pulse count
+    volatile uint32_t t_edge;       // (ticks) time of last counted edge
+    int count_calc;                 // encoder count at last velocity calculation with edges
+    uint32_t t_edge_calc;           // (ticks) time of last edge before that calculation
+    volatile int8_t dir;            // direction of last counted edge (+1/-1, 0: none yet)
+    volatile uint32_t illegal;      // number of illegal transitions (both channels changed)
+    volatile uint32_t missed;       // number of illegal transitions recovered as missed edges
+    volatile uint32_t glitches;     // number of edges undone as glitches (two per glitch)
+#if ENC_MIN_EDGE_SPACING > 0
+    volatile uint8_t state_undo;    // state before last counted edge (ENC_STATE_NONE: no single step to undo)
+    volatile int8_t dir_undo;       // direction before last counted edge
+    volatile uint32_t t_edge_undo;  // (ticks) time of counted edge before last one
+#endif
+    volatile uint32_t dt_edge_min;  // (ticks) shortest interval between counted edges
+    float period;                   // (s) Enc_calcAngle call period
     float pos[2];                   // (deg) wheel angle history (current and previous)
-    float vel[ENC_LPF_ORDER+1];     // (deg/s) wheel angular velocity history
+    float vel_mt;                   // (deg/s) unfiltered wheel angular velocity (M/T method)
+#if ENC_VEL_EST == ENC_VEL_FIR
+    filt_fir_t lpf_vel;             // low-pass velocity filter
+    float lpf_vel_buf[FILT_FIR_BUF_LEN(ENC_LPF_ORDER)]; // (deg/s) velocity filter history
+#elif ENC_VEL_EST == ENC_VEL_BIQUAD
+    filt_biquad_t lpf_vel;          // low-pass velocity filter
+    float lpf_vel_coeffs[1][5];     // velocity filter coefficients
+    float lpf_vel_state[1][2];      // (deg/s) velocity filter state
+#elif ENC_VEL_EST == ENC_VEL_AB
+    float ab_pos;                   // (deg) observer angle estimate
+    float ab_alpha;                 // observer angle gain
+    float ab_beta;                  // (1/s) observer velocity gain (beta/T)
+#endif
     float vel_filt;                 // (deg/s) filtered wheel angular velocity
+    float delay_vel;                // (s) vel_filt delay at ENC_DELAY_FREQ (M/T averaging included)
 } enc_t;
 
 
 /* Function prototypes */
-void Enc_init(enc_t * enc);
-void Enc_update(enc_t * enc);
+void Enc_initTimer(void);
+void Enc_init(enc_t * enc, float period);
+void Enc_updatePort(enc_t * const * encs, int num_enc);
 void Enc_calcAngle(enc_t * enc);
+float Enc_calcVelDelay(const enc_t * enc, float freq);
 
 
 #endif /* ENC_H_ */
@@ -0,0 +1,78 @@
+/**
+* @file fastmath.c
+* @brief Fast single-precision math
+*
+* Polynomial arctangent, reciprocal square root approximation and hardware
+* square root for Cortex-M4F
+*
+* All arithmetic is single precision (f-suffixed constants, no libm calls) so
+* every operation maps to an FPU instruction. Square root uses the FPU's own
+* VSQRT.F32 (14 cycles, correctly rounded).
+* Error bounds over the full float range:
+*   FMath_atan2f:   1.2e-5 rad (0.0007 deg) absolute
+*   FMath_invSqrtf: 5.0e-6 relative
+*   FMath_sqrtf:    0.5 ulp (hardware)
+*
+* @author Lucas Tiziani
+* @date 2021-01-10
+*
+*/
+
+
+#include "fastmath.h"
+
+
+static float FMath_atanUnit(float z) {
+    /* Arctangent of z in [0,1]: 9th-order minimax polynomial, max error 1.2e-5 rad */
+    float z2 = z*z;
+    return z*(0.99986600f + z2*(-0.33029950f + z2*(0.18014100f
+        + z2*(-0.08513300f + z2*0.02083510f))));
+}
+
+
+float FMath_atan2f(float y, float x) {
+    /* Four-quadrant arctangent (rad) */
+    float abs_x = (x < 0.0f) ? -x : x;
+    float abs_y = (y < 0.0f) ? -y : y;
+    if ((abs_x == 0.0f) && (abs_y == 0.0f)) {
+        return 0.0f;
+    }
+
+    float angle;
+    if (abs_y <= abs_x) { // reduce to first octant
+        angle = FMath_atanUnit(abs_y/abs_x);
+    }
+    else {
+        angle = FMATH_PI_2 - FMath_atanUnit(abs_x/abs_y);
+    }
+    if (x < 0.0f) {
+        angle = FMATH_PI - angle;
+    }
+    if (y < 0.0f) {
+        angle = -angle;
+    }
+    return angle;
+}
+
+
+float FMath_invSqrtf(float x) {
+    /* Reciprocal square root of x > 0: exponent estimate refined by two Newton steps */
+    union {
+        float f;
+        uint32_t i;
+    } conv = {x};
+    float half_x = 0.5f*x;
+    conv.i = 0x5F375A86 - (conv.i >> 1); // initial estimate, 3.4% max error
+    conv.f *= 1.5f - half_x*conv.f*conv.f;
+    conv.f *= 1.5f - half_x*conv.f*conv.f;
+    return conv.f;
+}
+
+
+float FMath_sqrtf(float x) {
+    /* Square root of x >= 0: VSQRT.F32, guard keeps errno/NaN handling out of the call */
+    if (x <= 0.0f) {
+        return 0.0f;
+    }
+    return __builtin_sqrtf(x);
+}
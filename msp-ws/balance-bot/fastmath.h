@@ -0,0 +1,32 @@
+/**
+* @file fastmath.h
+* @brief Fast single-precision math
+*
+* Polynomial arctangent, reciprocal square root approximation and hardware
+* square root for Cortex-M4F
+*
+* @author Lucas Tiziani
+* @date 2021-01-10
+*
+*/
+
+#ifndef FASTMATH_H_
+#define FASTMATH_H_
+
+
+#include <stdint.h>
+
+
+/* Macros */
+#define FMATH_PI 3.14159265f            // pi
+#define FMATH_PI_2 1.57079633f          // pi/2
+#define FMATH_RAD_TO_DEG 57.2957795f    // (deg/rad)
+
+
+/* Function prototypes */
+float FMath_atan2f(float y, float x);
+float FMath_invSqrtf(float x);
+float FMath_sqrtf(float x);
+
+
+#endif /* FASTMATH_H_ */
@@ -0,0 +1,160 @@
+/**
+* @file filter.c
+* @brief Digital filters
+*
+* Ring-buffer FIR, biquad IIR cascade and moving average filters
+*
+* Every filter is an instance struct pointing at caller-owned coefficients
+* and history, so any number of filters of any order can run side by side
+* without heap allocation. FIR history is stored twice (at idx and
+* idx + num_taps): the newest num_taps samples are then always contiguous,
+* a new sample costs two stores and the convolution needs no wrap check.
+* The Q15 FIR uses the dual 16-bit multiply-accumulate (SMLAD) when the
+* core has the DSP extension.
+*
+* @author Lucas Tiziani
+* @date 2021-01-14
+*
+*/
+
+
+#include "filter.h"
+#include <string.h>
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#include "msp.h" // CMSIS __SMLAD
+#endif
+
+
+void Filt_initFir(filt_fir_t * filt, const float * coeffs, float * buf, int order) {
+    /* Set up FIR filter with zero history */
+    filt->coeffs = coeffs;
+    filt->buf = buf;
+    filt->num_taps = order + 1;
+    filt->idx = 0;
+    memset(buf, 0, FILT_FIR_BUF_LEN(order)*sizeof(float));
+}
+
+
+float Filt_updateFir(filt_fir_t * filt, float x) {
+    /* Add sample, return filtered output */
+    int n = filt->num_taps;
+    filt->idx = (filt->idx == 0) ? n - 1 : filt->idx - 1;
+    float * hist = &filt->buf[filt->idx]; // hist[k] = x[i-k]
+    hist[0] = x;
+    hist[n] = x;
+
+    float y = 0.0f;
+    int k;
+    for (k = 0; k < n; k++) {
+        y += filt->coeffs[k]*hist[k];
+    }
+    return y;
+}
+
+
+void Filt_initFirQ15(filt_fir_q15_t * filt, const int16_t * coeffs, int16_t * buf, int order) {
+    /* Set up Q15 FIR filter with zero history */
+    filt->coeffs = coeffs;
+    filt->buf = buf;
+    filt->num_taps = order + 1;
+    filt->idx = 0;
+    memset(buf, 0, FILT_FIR_BUF_LEN(order)*sizeof(int16_t));
+}
+
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+static inline int32_t Filt_readQ15x2(const int16_t * p) {
+    /* Load two Q15 values as one word (unaligned load) */
+    int32_t pair;
+    memcpy(&pair, p, sizeof(pair));
+    return pair;
+}
+#endif
+
+
+int16_t Filt_updateFirQ15(filt_fir_q15_t * filt, int16_t x) {
+    /* Add sample, return filtered output: sum of |taps| must stay below 2 */
+    int n = filt->num_taps;
+    filt->idx = (filt->idx == 0) ? n - 1 : filt->idx - 1;
+    int16_t * hist = &filt->buf[filt->idx];
+    hist[0] = x;
+    hist[n] = x;
+
+    int32_t acc = 1 << 14; // (Q30) rounding
+    int k;
+    for (k = 0; k + 1 < n; k += 2) { // two taps per multiply-accumulate
+        #if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+            acc = (int32_t)__SMLAD((uint32_t)Filt_readQ15x2(&hist[k]),
+                (uint32_t)Filt_readQ15x2(&filt->coeffs[k]), (uint32_t)acc);
+        #else
+            acc += (int32_t)hist[k]*filt->coeffs[k] + (int32_t)hist[k + 1]*filt->coeffs[k + 1];
+        #endif
+    }
+    if (k < n) { // odd number of taps
+        acc += (int32_t)hist[k]*filt->coeffs[k];
+    }
+
+    acc >>= 15;
+    if (acc > INT16_MAX) {
+        acc = INT16_MAX;
+    }
+    else if (acc < INT16_MIN) {
+        acc = INT16_MIN;
+    }
+    return (int16_t)acc;
+}
+
+
+void Filt_initBiquad(filt_biquad_t * filt, const float (*coeffs)[5], float (*state)[2],
+                     int num_sections) {
+    /* Set up cascade of second-order sections with zero state */
+    filt->coeffs = coeffs;
+    filt->state = state;
+    filt->num_sections = num_sections;
+    memset(state, 0, num_sections*sizeof(state[0]));
+}
+
+
+float Filt_updateBiquad(filt_biquad_t * filt, float x) {
+    /* Run sample through each section (transposed direct form II), return output */
+    int i;
+    for (i = 0; i < filt->num_sections; i++) {
+        const float * c = filt->coeffs[i];
+        float * s = filt->state[i];
+        float y = c[0]*x + s[0];
+        s[0] = c[1]*x - c[3]*y + s[1];
+        s[1] = c[2]*x - c[4]*y;
+        x = y;
+    }
+    return x;
+}
+
+
+void Filt_initAvg(filt_avg_t * filt, float * buf, int len) {
+    /* Set up moving average over len samples with zero history */
+    filt->buf = buf;
+    filt->len = len;
+    filt->idx = 0;
+    filt->sum = 0.0f;
+    filt->inv_len = 1.0f/(float)len;
+    memset(buf, 0, len*sizeof(float));
+}
+
+
+float Filt_updateAvg(filt_avg_t * filt, float x) {
+    /* Add sample, return mean of last len samples */
+    filt->sum += x - filt->buf[filt->idx];
+    filt->buf[filt->idx] = x;
+    filt->idx++;
+    if (filt->idx == filt->len) { // once per pass, resum so round-off does not accumulate
+        filt->idx = 0;
+        float sum = 0.0f;
+        int i;
+        for (i = 0; i < filt->len; i++) {
+            sum += filt->buf[i];
+        }
+        filt->sum = sum;
+    }
+    return filt->sum*filt->inv_len;
+}
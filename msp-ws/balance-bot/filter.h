@@ -0,0 +1,65 @@
+/**
+* @file filter.h
+* @brief Digital filters
+*
+* Ring-buffer FIR, biquad IIR cascade and moving average filters
+*
+* @author Lucas Tiziani
+* @date 2021-01-14
+*
+*/
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+
+#include <stdint.h>
+
+
+/* Macros */
+#define FILT_FIR_BUF_LEN(order) (2*((order) + 1)) // FIR history buffer length (samples)
+
+
+/* Data types */
+typedef struct {
+    const float * coeffs;   // taps h[0..order]
+    float * buf;            // history, FILT_FIR_BUF_LEN(order) samples (each sample stored twice)
+    int num_taps;           // order + 1
+    int idx;                // position of newest sample in buf
+} filt_fir_t;
+
+typedef struct {
+    const int16_t * coeffs; // (Q15) taps h[0..order]
+    int16_t * buf;          // (Q15) history, FILT_FIR_BUF_LEN(order) samples
+    int num_taps;           // order + 1
+    int idx;                // position of newest sample in buf
+} filt_fir_q15_t;
+
+typedef struct {
+    const float (*coeffs)[5];   // per section: b0, b1, b2, a1, a2 (a0 = 1)
+    float (*state)[2];          // per section: transposed direct form II state
+    int num_sections;           // number of second-order sections
+} filt_biquad_t;
+
+typedef struct {
+    float * buf;            // last len samples
+    int len;                // averaging length (samples)
+    int idx;                // position of oldest sample in buf
+    float sum;              // sum of samples in buf
+    float inv_len;          // 1/len
+} filt_avg_t;
+
+
+/* Function prototypes */
+void Filt_initFir(filt_fir_t * filt, const float * coeffs, float * buf, int order);
+float Filt_updateFir(filt_fir_t * filt, float x);
+void Filt_initFirQ15(filt_fir_q15_t * filt, const int16_t * coeffs, int16_t * buf, int order);
+int16_t Filt_updateFirQ15(filt_fir_q15_t * filt, int16_t x);
+void Filt_initBiquad(filt_biquad_t * filt, const float (*coeffs)[5], float (*state)[2],
+                     int num_sections);
+float Filt_updateBiquad(filt_biquad_t * filt, float x);
+void Filt_initAvg(filt_avg_t * filt, float * buf, int len);
+float Filt_updateAvg(filt_avg_t * filt, float x);
+
+
+#endif /* FILTER_H_ */
@@ -4,6 +4,21 @@
 *
 * MSP432 I2C driver
 *
+* Transactions (write, read, write-then-read) are queued and driven by the
+* EUSCI_B1 interrupt, so the CPU is free while bytes are on the bus. The
+* blocking functions submit a transaction and sleep (WFI) until it completes.
+* With interrupts masked, as during start-up, the wait still sleeps until the
+* interrupt is pending and then services the engine itself; only before
+* I2Cc_initAsync does it poll the flags.
+*
+* A single-byte read never polls for the end of the address phase: STOP is
+* set from the first receive interrupt, before RXBUF is read, so the byte
+* held on the bus is the last one. It is NACKed and discarded.
+*
+* Reads flagged for DMA move the received bytes straight from RXBUF to the
+* buffer and let the byte counter generate the STOP, so the CPU only sees the
+* address/RESTART interrupts and the STOP (completion) interrupt.
+*
 * @author Lucas Tiziani
 * @date 2020-12-19
 *
@@ -16,97 +31,273 @@
 #include "i2c_cust.h"
 
 
-int I2Cc_write(int addr_slave, unsigned char memAddr, unsigned char data) {
-    /* write single byte to I2C module 1 */
-    EUSCI_B1->I2CSA = addr_slave;    // set slave address
-    EUSCI_B1->CTLW0 |= 0x0010;      // enable transmitter
-    EUSCI_B1->CTLW0 |= 0x0002;      // generate START and send slave address
+/* Module variables */
+static i2c_trans_t * volatile queue[I2CC_QUEUE_LEN]; // pending transactions
+static volatile int idx_queue_head = 0; // next free queue slot
+static volatile int idx_queue_tail = 0; // oldest queued transaction
+static i2c_trans_t * volatile trans_active = 0; // transaction on the bus
+static volatile int flag_async = 0; // 1 if EUSCI_B1 interrupt drives engine
+static int num_auto_stop = 0; // byte count for automatic STOP (0 = disabled)
+static int flag_nack = 0; // 1 if active transaction was not acknowledged (reported after STOP)
 
-    while(!(EUSCI_B1->IFG & 2));    // wait until ready to transmit
-    EUSCI_B1->IFG &= ~2;            // clear transmit interrupt flag
-    EUSCI_B1->TXBUF = memAddr;      // send memory address to slave
+#pragma DATA_ALIGN(dma_control_table, 1024)
+static uint8_t dma_control_table[1024]; // DMA channel control structures
 
-    while(!(EUSCI_B1->IFG & 2));    // wait until ready to transmit
-    EUSCI_B1->IFG &= ~2;            // clear transmit interrupt flag
-    EUSCI_B1->TXBUF = data;         // send data to slave
 
-    while(!(EUSCI_B1->IFG & 2));    // wait until last transmit is done
-    EUSCI_B1->IFG &= ~2;            // clear transmit interrupt flag
-    EUSCI_B1->CTLW0 |= 0x0004;      // send STOP
-    while(EUSCI_B1->CTLW0 & 4);     // wait until STOP is sent
-    EUSCI_B1->IFG &= ~8;            // clear STOP interrupt flag
+static void I2Cc_setAutoStop(int num_bytes) {
+    /* Set byte count after which STOP is generated automatically (0 = disabled) */
+    if (num_bytes == num_auto_stop) {
+        return; // already configured
+    }
+    EUSCI_B1->CTLW0 |= I2CC_CTLW0_SWRST;    // byte counter can only be changed in reset
+    EUSCI_B1->CTLW1 &= ~I2CC_CTLW1_ASTP_MASK;
+    if (num_bytes > 0) {
+        EUSCI_B1->CTLW1 |= I2CC_CTLW1_ASTP_STOP;
+        EUSCI_B1->TBCNT = num_bytes;
+    }
+    EUSCI_B1->CTLW0 &= ~I2CC_CTLW0_SWRST;
+    if (flag_async) { // reset cleared interrupt enables
+        EUSCI_B1->IE |= I2CC_IFG_RX | I2CC_IFG_TX | I2CC_IFG_STP | I2CC_IFG_NACK;
+    }
+    num_auto_stop = num_bytes;
+}
 
-    return 0;
+
+static void I2Cc_startNext(void) {
+    /* Start next queued transaction on the bus (call inside criticalEnter or from ISR) */
+    if (idx_queue_tail == idx_queue_head) { // no queued transactions
+        trans_active = 0;
+        return;
+    }
+    i2c_trans_t * trans = queue[idx_queue_tail];
+    idx_queue_tail = (idx_queue_tail + 1) % I2CC_QUEUE_LEN;
+    trans_active = trans;
+
+    trans->status = I2CC_STATUS_BUSY;
+    trans->idx = 0;
+    I2Cc_setAutoStop(trans->flag_dma ? trans->num_rx : 0);
+    if (trans->flag_dma) { // receive by DMA: disable receive interrupt, arm channel
+        EUSCI_B1->IE &= ~I2CC_IFG_RX;
+        MAP_DMA_setChannelTransfer(UDMA_PRI_SELECT | I2CC_DMA_CH_RX, UDMA_MODE_BASIC,
+            (void *)&EUSCI_B1->RXBUF, trans->data_rx, trans->num_rx);
+        MAP_DMA_enableChannel(I2CC_DMA_CH_RX);
+    }
+    EUSCI_B1->I2CSA = trans->addr_slave;        // set slave address
+    if (trans->num_tx > 0) {
+        EUSCI_B1->CTLW0 |= I2CC_CTLW0_TR;       // enable transmitter
+        EUSCI_B1->CTLW0 |= I2CC_CTLW0_TXSTT;    // generate START and send slave address
+    }
+    else {
+        EUSCI_B1->CTLW0 &= ~I2CC_CTLW0_TR;      // enable receiver
+        EUSCI_B1->CTLW0 |= I2CC_CTLW0_TXSTT;    // generate START and send slave address
+    }
 }
 
 
-int I2Cc_read(int addr_slave, unsigned char memAddr, unsigned char* data) {
-    /* read single byte from I2C module 1*/
-    EUSCI_B1->I2CSA = addr_slave;    // set slave address
-    EUSCI_B1->CTLW0 |= 0x0010;      // enable transmitter
-    EUSCI_B1->CTLW0 |= 0x0002;      // generate START and send slave address
+void I2Cc_initAsync(void) {
+    /* Enable interrupt-driven transactions on I2C module 1 (module must already be configured) */
+    EUSCI_B1->IFG &= ~(I2CC_IFG_RX | I2CC_IFG_TX | I2CC_IFG_STP | I2CC_IFG_NACK); // clear flags
+    EUSCI_B1->IE |= I2CC_IFG_RX | I2CC_IFG_TX | I2CC_IFG_STP | I2CC_IFG_NACK; // enable interrupts
+    MAP_Interrupt_setPriority(INT_EUSCIB1, I2CC_INT_PRIORITY);
+    MAP_Interrupt_enableInterrupt(INT_EUSCIB1);
+    flag_async = 1;
+}
 
-    while(!(EUSCI_B1->IFG & 2));    // wait until ready to transmit
-    EUSCI_B1->IFG &= ~2;            // clear transmit interrupt flag
-    EUSCI_B1->TXBUF = memAddr;      // send memory address to slave
 
-    while(!(EUSCI_B1->IFG & 2));    // wait until ready to transmit
-    EUSCI_B1->IFG &= ~2;            // clear transmit interrupt flag
-    EUSCI_B1->CTLW0 &= ~0x0010;     // enable receiver
-    EUSCI_B1->CTLW0 |= 0x0002;      // generate RESTART and send slave address
+void I2Cc_initDma(void) {
+    /* Enable DMA for reads flagged with flag_dma */
+    MAP_DMA_enableModule();
+    MAP_DMA_setControlBase(dma_control_table);
+    MAP_DMA_assignChannel(I2CC_DMA_CH_RX);
+    MAP_DMA_setChannelControl(UDMA_PRI_SELECT | I2CC_DMA_CH_RX,
+        UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_1);
+}
 
-    while(EUSCI_B1->CTLW0 & 2);     // wait until restart is sent
-    EUSCI_B1->CTLW0 |= 0x0004;      // setup to generate STOP after byte is received
 
-    while(!(EUSCI_B1->IFG & 1));    // wait until data is received
-    *data = EUSCI_B1->RXBUF;        // read the received data
-    EUSCI_B1->IFG &= ~1;            // clear receive interrupt flag
-    while(EUSCI_B1->CTLW0 & 4);     // wait until STOP is sent
-    EUSCI_B1->IFG &= ~8;            // clear STOP interrupt flag
+int I2Cc_submit(i2c_trans_t * trans) {
+    /* Queue transaction, start it if bus is idle: returns -1 if queue is full */
+    if ((trans->num_tx <= 0) && (trans->num_rx <= 0)) {
+        return -1; // nothing to transfer
+    }
 
+    uint32_t cycles_start = CYCLE_COUNT();
+    uint32_t basepri = criticalEnter(); // mask I2C interrupt and other submitters, not PWM commit
+    int idx_next = (idx_queue_head + 1) % I2CC_QUEUE_LEN;
+    if (idx_next == idx_queue_tail) { // queue full
+        criticalExit(basepri);
+        return -1;
+    }
+    trans->status = I2CC_STATUS_QUEUED;
+    trans->cycles = 0;
+    queue[idx_queue_head] = trans;
+    idx_queue_head = idx_next;
+
+    if (!trans_active) { // bus idle
+        I2Cc_startNext();
+    }
+    trans->cycles += CYCLE_COUNT() - cycles_start;
+    criticalExit(basepri);
     return 0;
 }
 
 
+int I2Cc_wait(i2c_trans_t * trans) {
+    /* Wait for transaction to complete, sleeping between interrupts: returns -1 if it was not acknowledged */
+    while (1) {
+        // check and sleep atomically: completion cannot slip in between. Only PRIMASK section of the
+        // firmware, a few cycles around WFI: a pending PWM commit wakes the CPU and runs at cpsie
+        uint32_t primask = CPU_cpsid();
+        if ((trans->status != I2CC_STATUS_QUEUED) && (trans->status != I2CC_STATUS_BUSY)) {
+            if (!primask) {
+                CPU_cpsie();
+            }
+            break;
+        }
+        if (!flag_async) { // engine not enabled: poll flags
+            I2Cc_service();
+        }
+        else if (primask) { // interrupts masked (start-up): sleep until flagged, service here
+            CPU_wfi(); // wakes on pending interrupt even while masked
+            I2Cc_service();
+            MAP_Interrupt_unpendInterrupt(INT_EUSCIB1); // re-pends while flags remain
+        }
+        else {
+            CPU_wfi();
+        }
+        if (!primask) {
+            CPU_cpsie(); // pending interrupt runs here
+        }
+    }
+    return (trans->status == I2CC_STATUS_DONE) ? 0 : -1;
+}
+
+
+int I2Cc_transfer(i2c_trans_t * trans) {
+    /* Submit transaction and block until it completes */
+    if (I2Cc_submit(trans)) {
+        return -1;
+    }
+    return I2Cc_wait(trans);
+}
+
+
+void I2Cc_service(void) {
+    /* Advance active transaction according to EUSCI_B1 flags */
+    uint32_t cycles_start = CYCLE_COUNT();
+    uint16_t ifg = EUSCI_B1->IFG;
+    i2c_trans_t * trans = trans_active;
+    if (!trans) {
+        return;
+    }
+
+    if (ifg & I2CC_IFG_NACK) { // slave did not acknowledge: abort, status follows STOP
+        EUSCI_B1->IFG &= ~(I2CC_IFG_NACK | I2CC_IFG_TX);
+        EUSCI_B1->CTLW0 |= I2CC_CTLW0_TXSTP;
+        flag_nack = 1;
+    }
+    else if (ifg & I2CC_IFG_TX) { // ready to transmit
+        if (trans->idx < trans->num_tx) {
+            EUSCI_B1->TXBUF = trans->data_tx[trans->idx++]; // send next byte (clears flag)
+        }
+        else if (trans->num_rx > 0) {
+            EUSCI_B1->IFG &= ~I2CC_IFG_TX;          // clear transmit interrupt flag
+            trans->idx = 0;
+            EUSCI_B1->CTLW0 &= ~I2CC_CTLW0_TR;      // enable receiver
+            EUSCI_B1->CTLW0 |= I2CC_CTLW0_TXSTT;    // generate RESTART and send slave address
+        }
+        else {
+            EUSCI_B1->IFG &= ~I2CC_IFG_TX;          // clear transmit interrupt flag
+            EUSCI_B1->CTLW0 |= I2CC_CTLW0_TXSTP;    // last byte is out: send STOP
+        }
+    }
+
+    if ((ifg & I2CC_IFG_RX) && !trans->flag_dma) { // byte received
+        if ((trans->num_rx == 1) && (trans->idx == 0)) { // single byte: STOP before RXBUF is read, bus is held
+            EUSCI_B1->CTLW0 |= I2CC_CTLW0_TXSTP; // byte in flight is NACKed and discarded
+        }
+        if (trans->idx < trans->num_rx) {
+            trans->data_rx[trans->idx++] = EUSCI_B1->RXBUF; // read byte (clears flag)
+        }
+        else {
+            (void)EUSCI_B1->RXBUF; // discard
+        }
+        if (trans->idx == trans->num_rx - 1) { // only last byte left
+            EUSCI_B1->CTLW0 |= I2CC_CTLW0_TXSTP; // generate STOP after last byte is received
+        }
+    }
+
+    if (ifg & I2CC_IFG_STP) { // STOP sent: transaction finished
+        EUSCI_B1->IFG &= ~I2CC_IFG_STP;
+        trans->status = flag_nack ? I2CC_STATUS_NACK : I2CC_STATUS_DONE;
+        flag_nack = 0;
+        if (trans->flag_dma && flag_async) {
+            EUSCI_B1->IE |= I2CC_IFG_RX; // restore receive interrupt
+        }
+        trans->cycles += CYCLE_COUNT() - cycles_start;
+        I2Cc_startNext();
+        if (trans->callback) {
+            trans->callback(trans);
+        }
+        return;
+    }
+    trans->cycles += CYCLE_COUNT() - cycles_start;
+}
+
+
+void EUSCIB1_IRQHandler(void) {
+    /* I2C module 1 interrupt routine */
+    I2Cc_service();
+}
+
+
+void I2Cc_swapBytes2(int16_t * data, int num_words) {
+    /* Convert big-endian register words received from the bus to host order */
+    int i;
+    for (i = 0; i < num_words; i++) {
+        uint16_t word = (uint16_t)data[i];
+        data[i] = (int16_t)((word << 8) | (word >> 8));
+    }
+}
+
+
+int I2Cc_write(int addr_slave, unsigned char addr_mem, unsigned char data) {
+    /* write single byte to I2C module 1 */
+    uint8_t data_tx[2] = {addr_mem, data}; // memory address, data
+    i2c_trans_t trans = {
+        .addr_slave = addr_slave,
+        .data_tx = data_tx,
+        .num_tx = 2,
+    };
+    return I2Cc_transfer(&trans);
+}
+
+
+int I2Cc_read(int addr_slave, unsigned char addr_mem, unsigned char* data) {
+    /* read single byte from I2C module 1*/
+    i2c_trans_t trans = {
+        .addr_slave = addr_slave,
+        .data_tx = &addr_mem,
+        .num_tx = 1,
+        .data_rx = data,
+        .num_rx = 1,
+    };
+    return I2Cc_transfer(&trans);
+}
+
+
 int I2Cc_burstRead2(int addr_slave, unsigned char addr_mem, int num_bytes, int16_t* data) {
     /* Burst read sets of 2 bytes */
     if (num_bytes <= 0) {
         return -1;  // no read was performed
     }
-     EUSCI_B1->I2CSA = addr_slave;  // set slave address
-     EUSCI_B1->CTLW0 |= 0x0010;     // enable transmitter
-     EUSCI_B1->CTLW0 |= 0x0002;     // generate START and send slave address
-
-     while(!(EUSCI_B1->IFG & 2));    // wait until ready to transmit
-     EUSCI_B1->IFG &= ~2;            // clear transmit interrupt flag
-     EUSCI_B1->TXBUF = addr_mem;     // send memory address to slave
-
-     while(!(EUSCI_B1->IFG & 2));    // wait until ready to transmit
-     EUSCI_B1->IFG &= ~2;            // clear transmit interrupt flag
-     EUSCI_B1->CTLW0 &= ~0x0010;     // enable receiver
-     EUSCI_B1->CTLW0 |= 0x0002;      // generate RESTART and send slave address
-     while(EUSCI_B1->CTLW0 & 2);     // wait until restart is sent
-
-     int16_t tmp; // temporary data holder
-     do {
-         if (num_bytes == 1) {          // when only one byte of data is left
-             EUSCI_B1->CTLW0 |= 0x0004; // generate STOP after byte is received
-         }
-         while(!(EUSCI_B1->IFG & 1));   // wait until data is received
-
-         if (num_bytes % 2 == 0){       // if first of 2 bytes
-             tmp = EUSCI_B1->RXBUF;     // read the received data into temp var
-         }
-         else {                         // if last of 2 bytes
-             *data++ = (((tmp) << 8) | EUSCI_B1->RXBUF); // combine bytes
-         }
-         EUSCI_B1->IFG &= ~1;           // clear receive interrupt flag
-         num_bytes--;
-     } while (num_bytes);
-
-     while(EUSCI_B1->CTLW0 & 4)     // wait until stop is sent
-     EUSCI_B1->IFG &= ~8;           // clear STOP interrupt flag
-
-     return 0;
+    i2c_trans_t trans = {
+        .addr_slave = addr_slave,
+        .data_tx = &addr_mem,
+        .num_tx = 1,
+        .data_rx = (uint8_t *)data,
+        .num_rx = num_bytes,
+    };
+    int err = I2Cc_transfer(&trans);
+    I2Cc_swapBytes2(data, num_bytes/2); // combine bytes
+    return err;
 }
-
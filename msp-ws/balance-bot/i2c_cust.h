@@ -13,15 +13,65 @@
 #define I2C_CUST_H_
 
 
-//#include "driverlib.h"
+#include "util.h"
+#include "driverlib.h"
 #include "msp.h"
 #include <stdint.h>
 
 
+/* Macros */
+#define I2CC_QUEUE_LEN 8            // max number of queued transactions
+#define I2CC_INT_PRIORITY PRIORITY_ENC // EUSCI_B1 interrupt priority: masked by criticalEnter
+
+#define I2CC_DMA_CH_RX DMA_CH3_EUSCIB1RX0 // DMA channel mapped to UCB1 receive
+
+#define I2CC_CTLW0_TR 0x0010        // transmitter mode
+#define I2CC_CTLW0_TXSTP 0x0004     // generate STOP
+#define I2CC_CTLW0_TXSTT 0x0002     // generate START
+#define I2CC_CTLW0_SWRST 0x0001     // software reset
+#define I2CC_CTLW1_ASTP_MASK 0x000C // automatic STOP mode bits
+#define I2CC_CTLW1_ASTP_STOP 0x0008 // STOP automatically after byte counter threshold
+#define I2CC_IFG_RX 0x0001          // receive interrupt flag
+#define I2CC_IFG_TX 0x0002          // transmit interrupt flag
+#define I2CC_IFG_STP 0x0008         // STOP condition interrupt flag
+#define I2CC_IFG_NACK 0x0020        // not-acknowledge interrupt flag
+
+#define I2CC_STATUS_IDLE 0          // transaction not submitted
+#define I2CC_STATUS_QUEUED 1        // transaction waiting in queue
+#define I2CC_STATUS_BUSY 2          // transaction on the bus
+#define I2CC_STATUS_DONE 3          // transaction completed
+#define I2CC_STATUS_NACK 4          // transaction aborted: slave did not acknowledge
+
+
+/* Data types */
+typedef struct i2c_trans_s {
+    uint8_t addr_slave;         // slave address
+    const uint8_t * data_tx;    // bytes to write (e.g. memory address)
+    int num_tx;                 // number of bytes to write
+    uint8_t * data_rx;          // buffer for bytes read after (RE)START
+    int num_rx;                 // number of bytes to read
+    void (*callback)(struct i2c_trans_s * trans); // completion callback, runs in ISR (optional)
+    void * context;             // user data for callback (optional)
+    int flag_dma;               // 1: read bytes by DMA, STOP generated by byte counter
+    uint32_t cycles;            // (cycles) CPU time spent on transaction
+    volatile int status;        // transaction status
+    volatile int idx;           // byte index within current write/read phase
+} i2c_trans_t;
+
+
 /* Function prototypes */
+void I2Cc_initAsync(void);
+void I2Cc_initDma(void);
+int I2Cc_submit(i2c_trans_t * trans);
+int I2Cc_wait(i2c_trans_t * trans);
+int I2Cc_transfer(i2c_trans_t * trans);
+void I2Cc_service(void);
+void I2Cc_swapBytes2(int16_t * data, int num_words);
+void EUSCIB1_IRQHandler(void);
+
 int I2Cc_write(int addr_slave, unsigned char addr_mem, unsigned char data);
 int I2Cc_read(int addr_slave, unsigned char addr_mem, unsigned char* data);
-int I2Cc_burstRead2(int addr_lsave, unsigned char addr_mem, int count_byte, int16_t* data);
+int I2Cc_burstRead2(int addr_slave, unsigned char addr_mem, int count_byte, int16_t* data);
 
 
 #endif /* I2C_CUST_H_ */
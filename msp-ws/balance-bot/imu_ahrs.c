@@ -0,0 +1,104 @@
+/**
+* @file imu_ahrs.c
+* @brief Quaternion IMU attitude estimation
+*
+* Mahony complementary filter on the attitude quaternion
+*
+* The gyro rates are integrated as a quaternion, so combined rotations about
+* several axes stay consistent (unlike integrating each Euler angle on its
+* own). The accelerometer corrects the estimate through the cross product of
+* measured and estimated gravity directions, with a PI gain that also tracks
+* residual gyro bias. World frame is y-up, matching IMU_calcAngleAccel: pitch
+* about x, yaw about y, roll about z. The update needs two reciprocal square
+* roots and no trigonometry.
+*
+* @author Lucas Tiziani
+* @date 2021-01-10
+*
+*/
+
+
+#include "imu_ahrs.h"
+
+
+static void IMUahrs_calcUp(imu_ahrs_t * est) {
+    /* Up direction in body frame: second row of rotation matrix */
+    float q0 = est->q[0], q1 = est->q[1], q2 = est->q[2], q3 = est->q[3];
+    est->up[0] = 2.0f*(q1*q2 + q0*q3);
+    est->up[1] = q0*q0 - q1*q1 + q2*q2 - q3*q3;
+    est->up[2] = 2.0f*(q2*q3 - q0*q1);
+}
+
+
+void IMUahrs_init(imu_ahrs_t * est, float pitch, float roll) {
+    /* Set attitude from pitch, roll (deg) with zero yaw */
+    float half_pitch = 0.5f*IMUAHRS_DEG_TO_RAD*pitch;
+    float half_roll = 0.5f*IMUAHRS_DEG_TO_RAD*roll;
+    float c_p = cosf(half_pitch), s_p = sinf(half_pitch);
+    float c_r = cosf(half_roll), s_r = sinf(half_roll);
+
+    // pitch about x followed by roll about z
+    est->q[0] = c_p*c_r;
+    est->q[1] = s_p*c_r;
+    est->q[2] = -s_p*s_r;
+    est->q[3] = c_p*s_r;
+
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        est->bias_integ[axis] = 0.0f;
+    }
+    est->yaw_rate = 0.0f;
+    IMUahrs_calcUp(est);
+}
+
+
+void IMUahrs_update(imu_ahrs_t * est, const volatile float * ang_vel,
+                    const volatile float * accel, float period) {
+    /* Update attitude from angular velocity (deg/s) and acceleration (g) */
+    float g_x = ang_vel[0]*IMUAHRS_DEG_TO_RAD;
+    float g_y = ang_vel[1]*IMUAHRS_DEG_TO_RAD;
+    float g_z = ang_vel[2]*IMUAHRS_DEG_TO_RAD;
+    float a_x = accel[0], a_y = accel[1], a_z = accel[2];
+
+    // correct rates with error between measured and estimated gravity direction
+    float norm_sq = a_x*a_x + a_y*a_y + a_z*a_z;
+    if (norm_sq > 0.0f) { // skip correction if accelerometer reads nothing
+        float inv_norm = FMath_invSqrtf(norm_sq);
+        a_x *= inv_norm;
+        a_y *= inv_norm;
+        a_z *= inv_norm;
+        float e_x = a_y*est->up[2] - a_z*est->up[1];
+        float e_y = a_z*est->up[0] - a_x*est->up[2];
+        float e_z = a_x*est->up[1] - a_y*est->up[0];
+
+        est->bias_integ[0] += IMUAHRS_K_I*e_x*period;
+        est->bias_integ[1] += IMUAHRS_K_I*e_y*period;
+        est->bias_integ[2] += IMUAHRS_K_I*e_z*period;
+        g_x += IMUAHRS_K_P*e_x + est->bias_integ[0];
+        g_y += IMUAHRS_K_P*e_y + est->bias_integ[1];
+        g_z += IMUAHRS_K_P*e_z + est->bias_integ[2];
+    }
+
+    // integrate rate of change of quaternion: q' = q*(0, w)/2
+    float half_period = 0.5f*period;
+    g_x *= half_period;
+    g_y *= half_period;
+    g_z *= half_period;
+    float q0 = est->q[0], q1 = est->q[1], q2 = est->q[2], q3 = est->q[3];
+    est->q[0] = q0 - q1*g_x - q2*g_y - q3*g_z;
+    est->q[1] = q1 + q0*g_x + q2*g_z - q3*g_y;
+    est->q[2] = q2 + q0*g_y - q1*g_z + q3*g_x;
+    est->q[3] = q3 + q0*g_z + q1*g_y - q2*g_x;
+
+    // renormalize quaternion
+    float inv_norm = FMath_invSqrtf(est->q[0]*est->q[0] + est->q[1]*est->q[1]
+        + est->q[2]*est->q[2] + est->q[3]*est->q[3]);
+    int i;
+    for (i = 0; i < 4; i++) {
+        est->q[i] *= inv_norm;
+    }
+    IMUahrs_calcUp(est);
+
+    // measured rate about world vertical
+    est->yaw_rate = ang_vel[0]*est->up[0] + ang_vel[1]*est->up[1] + ang_vel[2]*est->up[2];
+}
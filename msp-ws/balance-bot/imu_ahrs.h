@@ -0,0 +1,42 @@
+/**
+* @file imu_ahrs.h
+* @brief Quaternion IMU attitude estimation
+*
+* Mahony complementary filter on the attitude quaternion
+*
+* @author Lucas Tiziani
+* @date 2021-01-10
+*
+*/
+
+#ifndef IMU_AHRS_H_
+#define IMU_AHRS_H_
+
+
+#include "fastmath.h"
+#include <math.h>
+#include <stdint.h>
+
+
+/* Macros */
+#define IMUAHRS_K_P 1.0f                // (rad/s) proportional gain on gravity direction error
+#define IMUAHRS_K_I 0.02f               // (rad/s^2) integral gain on gravity direction error
+#define IMUAHRS_DEG_TO_RAD 0.0174532925f // (rad/deg)
+
+
+/* Data types */
+typedef struct {
+    float q[4];             // attitude quaternion (w, x, y, z): body to world rotation
+    float bias_integ[3];    // (rad/s) integral correction of gyro bias
+    float up[3];            // up direction in body frame (unit vector, +y when upright)
+    float yaw_rate;         // (deg/s) angular velocity about world vertical
+} imu_ahrs_t;
+
+
+/* Function prototypes */
+void IMUahrs_init(imu_ahrs_t * est, float pitch, float roll);
+void IMUahrs_update(imu_ahrs_t * est, const volatile float * ang_vel,
+                    const volatile float * accel, float period);
+
+
+#endif /* IMU_AHRS_H_ */
@@ -0,0 +1,183 @@
+/**
+* @file imu_fixed.c
+* @brief Fixed-point IMU attitude estimation
+*
+* Complementary filter attitude estimation on raw IMU counts in Q-format
+*
+* Same filter as IMU_calcAngleFused, but sensitivity scaling, offset
+* removal, accelerometer correction, integration, accelerometer angles, fusion
+* and differentiation all run in integer arithmetic (no float or double in the
+* update path). Angles and angular velocities are Q16 (1 deg = 65536).
+* Calibration enters as precomputed offsets and gains: the caller folds the
+* gyro temperature model into the offsets whenever the temperature moves.
+*
+* @author Lucas Tiziani
+* @date 2021-01-09
+*
+*/
+
+
+#include "imu_fixed.h"
+
+
+static int32_t IMUfix_atanUnit(int32_t z) {
+    /* Arctangent of z in [0,1] (Q15), result in rad (Q15): 9th-order polynomial, max error 1e-5 rad */
+    static const int32_t coeffs[5] = {683, -2790, 5903, -10823, 32764}; // a9, a7, a5, a3, a1 (Q15)
+    int32_t z2 = (z*z) >> 15;
+    int32_t p = coeffs[0];
+    int i;
+    for (i = 1; i < 5; i++) {
+        p = ((p*z2) >> 15) + coeffs[i];
+    }
+    return (p*z) >> 15;
+}
+
+
+int32_t IMUfix_atan2(int32_t y, int32_t x) {
+    /* Four-quadrant arctangent of |x|,|y| < 65536: result in deg (Q16) */
+    uint32_t abs_x = (x < 0) ? -x : x;
+    uint32_t abs_y = (y < 0) ? -y : y;
+    if ((abs_x == 0) && (abs_y == 0)) {
+        return 0;
+    }
+
+    int32_t angle; // (rad, Q15)
+    if (abs_y <= abs_x) { // reduce to first octant
+        angle = IMUfix_atanUnit((abs_y << 15)/abs_x);
+    }
+    else {
+        angle = IMUFIX_PI_2_Q15 - IMUfix_atanUnit((abs_x << 15)/abs_y);
+    }
+    if (x < 0) {
+        angle = IMUFIX_PI_Q15 - angle;
+    }
+    if (y < 0) {
+        angle = -angle;
+    }
+    return (int32_t)(((int64_t)angle*IMUFIX_RAD_TO_DEG_Q16) >> 16);
+}
+
+
+uint32_t IMUfix_sqrt(uint32_t x) {
+    /* Integer square root (rounded down) */
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+
+void IMUfix_init(imu_fixed_t * est, float sens_gyro, const float * offset_gyro,
+                 const float * angle, float period) {
+    /* Precompute Q-format constants and set initial angles (deg) */
+    est->gain_gyro = (int32_t)(16777216.0f/sens_gyro + 0.5f);
+    IMUfix_setOffset(est, sens_gyro, offset_gyro);
+    est->period = (uint32_t)(period*4294967296.0f);
+    est->freq = (int32_t)(1.0f/period + 0.5f);
+    est->k_drift = (int32_t)(IMUFIX_K_DRIFT*2147483648.0f);
+    est->k_accel = (int32_t)(IMUFIX_K_ACCEL*(float)IMUFIX_ONE_Q15);
+
+    const float offset_accel[3] = {0,0,0}; // no accelerometer correction until set
+    const float mat_accel[3][3] = {{1,0,0}, {0,1,0}, {0,0,1}};
+    IMUfix_setAccelCal(est, offset_accel, mat_accel);
+
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        est->ang_vel[axis] = 0;
+        est->accel[axis] = 0;
+        est->ang_vel_prev[axis] = 0;
+        est->angle_gyro[axis] = (int32_t)(angle[axis]*65536.0f);
+        est->angle_accel[axis] = est->angle_gyro[axis];
+    }
+    est->angle_fused[0] = est->angle_gyro[0];
+    est->angle_fused[1] = est->angle_gyro[0];
+    est->ang_vel_fused = 0;
+}
+
+
+void IMUfix_setOffset(imu_fixed_t * est, float sens_gyro, const float * offset_gyro) {
+    /* Convert gyro offsets (deg/s) to counts (Q8) */
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        est->offset_gyro[axis] = (int32_t)(offset_gyro[axis]*sens_gyro*256.0f);
+    }
+}
+
+
+void IMUfix_setAccelCal(imu_fixed_t * est, const float * offset_accel, const float mat[3][3]) {
+    /* Set accelerometer bias (counts) and correction matrix (sensitivity cancels in angles) */
+    int i, j;
+    for (i = 0; i < 3; i++) {
+        est->offset_accel[i] = (int32_t)(offset_accel[i] + ((offset_accel[i] < 0) ? -0.5f : 0.5f));
+        for (j = 0; j < 3; j++) {
+            est->mat_accel[i][j] = (int32_t)(mat[i][j]*(float)IMUFIX_ONE_Q14
+                + ((mat[i][j] < 0) ? -0.5f : 0.5f));
+        }
+    }
+}
+
+
+void IMUfix_update(imu_fixed_t * est, const int16_t * counts_accel, const int16_t * counts_gyro) {
+    /* Update angles from one raw sample */
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        int32_t counts = ((int32_t)counts_gyro[axis] << 8) - est->offset_gyro[axis]; // (Q8)
+        est->ang_vel[axis] = (int32_t)(((int64_t)counts*est->gain_gyro) >> 16); // Q8*Q24 -> Q16
+        est->angle_gyro[axis] += (int32_t)(((int64_t)(est->ang_vel[axis] + est->ang_vel_prev[axis])
+            *(int64_t)est->period) >> 33); // trapezoidal integration: Q16*Q32/2 -> Q16
+        est->ang_vel_prev[axis] = est->ang_vel[axis];
+    }
+
+    // correct accelerometer bias, scale and misalignment, saturate to sample range
+    int32_t counts[3];
+    for (axis = 0; axis < 3; axis++) {
+        counts[axis] = (int32_t)counts_accel[axis] - est->offset_accel[axis];
+    }
+    for (axis = 0; axis < 3; axis++) {
+        int32_t accel = (int32_t)(((int64_t)est->mat_accel[axis][0]*counts[0]
+            + (int64_t)est->mat_accel[axis][1]*counts[1]
+            + (int64_t)est->mat_accel[axis][2]*counts[2]) >> 14); // Q14*Q0 -> Q0
+        if (accel > IMUFIX_COUNTS_MAX) {
+            accel = IMUFIX_COUNTS_MAX;
+        }
+        else if (accel < -IMUFIX_COUNTS_MAX) {
+            accel = -IMUFIX_COUNTS_MAX;
+        }
+        est->accel[axis] = accel;
+    }
+
+    // angles from accelerometer (sensitivity cancels in ratios)
+    int32_t accel_x = est->accel[0];
+    int32_t accel_y = est->accel[1];
+    int32_t accel_z = est->accel[2];
+    int32_t norm_xy = (int32_t)IMUfix_sqrt((uint32_t)(accel_x*accel_x) + (uint32_t)(accel_y*accel_y));
+    if (accel_y < 0) {
+        norm_xy = -norm_xy;
+    }
+    est->angle_accel[0] = -IMUfix_atan2(accel_z, norm_xy);    // pitch about x-axis
+    est->angle_accel[2] = -IMUfix_atan2(-accel_x, accel_y);   // roll about z-axis
+
+    // correct drift of gyro
+    est->angle_gyro[0] += (int32_t)(((int64_t)(est->angle_accel[0] - est->angle_gyro[0])
+        *est->k_drift) >> 31);
+
+    // combine gyro and accelerometer data
+    est->angle_fused[1] = est->angle_fused[0];
+    est->angle_fused[0] = est->angle_gyro[0] + (int32_t)(((int64_t)(est->angle_accel[0]
+        - est->angle_gyro[0])*est->k_accel) >> 15);
+
+    // calculate angular velocity
+    est->ang_vel_fused = (est->angle_fused[0] - est->angle_fused[1])*est->freq;
+}
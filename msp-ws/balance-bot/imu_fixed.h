@@ -0,0 +1,63 @@
+/**
+* @file imu_fixed.h
+* @brief Fixed-point IMU attitude estimation
+*
+* Complementary filter attitude estimation on raw IMU counts in Q-format
+*
+* @author Lucas Tiziani
+* @date 2021-01-09
+*
+*/
+
+#ifndef IMU_FIXED_H_
+#define IMU_FIXED_H_
+
+
+#include <stdint.h>
+
+
+/* Macros */
+#define IMUFIX_ONE_Q15 32768            // 1.0 in Q15
+#define IMUFIX_PI_Q15 102944            // (rad, Q15) pi
+#define IMUFIX_PI_2_Q15 51472           // (rad, Q15) pi/2
+#define IMUFIX_RAD_TO_DEG_Q16 7509872   // (deg/rad, Q16) 2*180/pi: rad Q15 to deg Q16
+#define IMUFIX_ONE_Q14 16384            // 1.0 in Q14 (accelerometer correction matrix)
+#define IMUFIX_COUNTS_MAX 32767         // (counts) corrected accelerometer range (atan2/sqrt input limit)
+
+#define IMUFIX_K_DRIFT 0.0004f          // weight of accel angle in gyro drift correction
+#define IMUFIX_K_ACCEL 0.10f            // weight of accel angle in fused angle
+
+#define IMUFIX_TO_FLOAT(x) ((float)(x)*(1.0f/65536.0f)) // Q16 to float
+
+
+/* Data types */
+typedef struct {
+    int32_t gain_gyro;          // (deg/s/count, Q24) gyro sensitivity
+    int32_t offset_gyro[3];     // (counts, Q8) gyro offset
+    int32_t offset_accel[3];    // (counts) accelerometer bias
+    int32_t mat_accel[3][3];    // (Q14) accelerometer scale/misalignment correction
+    uint32_t period;            // (s, Q32) sample period
+    int32_t freq;               // (Hz) sample frequency
+    int32_t k_drift;            // (Q31) gyro drift correction weight
+    int32_t k_accel;            // (Q15) accel weight in fused angle
+    int32_t ang_vel[3];         // (deg/s, Q16) angular velocity
+    int32_t accel[3];           // (counts) corrected acceleration
+    int32_t ang_vel_prev[3];    // (deg/s, Q16) previous angular velocity
+    int32_t angle_gyro[3];      // (deg, Q16) angle from gyro data
+    int32_t angle_accel[3];     // (deg, Q16) angle from accel data
+    int32_t angle_fused[2];     // (deg, Q16) pitch history from fusion of data
+    int32_t ang_vel_fused;      // (deg/s, Q16) pitch angular velocity
+} imu_fixed_t;
+
+
+/* Function prototypes */
+void IMUfix_init(imu_fixed_t * est, float sens_gyro, const float * offset_gyro,
+                 const float * angle, float period);
+void IMUfix_setOffset(imu_fixed_t * est, float sens_gyro, const float * offset_gyro);
+void IMUfix_setAccelCal(imu_fixed_t * est, const float * offset_accel, const float mat[3][3]);
+void IMUfix_update(imu_fixed_t * est, const int16_t * counts_accel, const int16_t * counts_gyro);
+int32_t IMUfix_atan2(int32_t y, int32_t x);
+uint32_t IMUfix_sqrt(uint32_t x);
+
+
+#endif /* IMU_FIXED_H_ */
@@ -0,0 +1,81 @@
+/**
+* @file imu_kalman.c
+* @brief Kalman filter IMU pitch estimation
+*
+* Two-state (angle, gyro bias) Kalman filter on pitch
+*
+* The gyro rate drives the angle prediction, the accelerometer pitch is the
+* measurement. Gyro bias is a random walk state, so it is tracked online and
+* the blocking start-up calibration is not needed. With the sample period
+* fixed the gain converges to a constant, which IMUkal_init precomputes: the
+* default update is then two multiply-adds per state. IMUKAL_FULL_COV = 1
+* instead propagates the covariance every sample, which converges faster
+* from the initial uncertainty at the cost of about 20 extra flops.
+*
+* @author Lucas Tiziani
+* @date 2021-01-11
+*
+*/
+
+
+#include "imu_kalman.h"
+
+
+static void IMUkal_updateCov(imu_kalman_t * est) {
+    /* Propagate covariance one period, compute gain and apply measurement */
+    float dt = est->period;
+    float p00 = est->p[0][0], p01 = est->p[0][1];
+    float p10 = est->p[1][0], p11 = est->p[1][1];
+
+    // predict: P = F*P*F' + Q with F = [1 -dt; 0 1]
+    p00 += dt*(dt*p11 - p01 - p10 + IMUKAL_Q_ANGLE);
+    p01 -= dt*p11;
+    p10 -= dt*p11;
+    p11 += IMUKAL_Q_BIAS*dt;
+
+    // gain with H = [1 0]
+    float inv_s = 1.0f/(p00 + IMUKAL_R_ANGLE);
+    est->k[0] = p00*inv_s;
+    est->k[1] = p10*inv_s;
+
+    // correct: P = (I - K*H)*P
+    est->p[0][0] = p00 - est->k[0]*p00;
+    est->p[0][1] = p01 - est->k[0]*p01;
+    est->p[1][0] = p10 - est->k[1]*p00;
+    est->p[1][1] = p11 - est->k[1]*p01;
+}
+
+
+void IMUkal_init(imu_kalman_t * est, float angle, float period) {
+    /* Set initial angle (deg) and precompute steady-state gain */
+    est->angle = angle;
+    est->bias = 0.0f;
+    est->rate = 0.0f;
+    est->period = period;
+
+    est->p[0][0] = IMUKAL_P0_ANGLE;
+    est->p[0][1] = 0.0f;
+    est->p[1][0] = 0.0f;
+    est->p[1][1] = IMUKAL_P0_BIAS;
+    #if IMUKAL_FULL_COV == 0
+        int i;
+        for (i = 0; i < IMUKAL_ITER_GAIN; i++) {
+            IMUkal_updateCov(est);
+        }
+    #endif
+}
+
+
+void IMUkal_update(imu_kalman_t * est, float ang_vel, float angle_accel) {
+    /* Update pitch from gyro rate (deg/s) and accelerometer pitch (deg) */
+    est->rate = ang_vel - est->bias;
+    est->angle += est->rate*est->period; // predict
+
+    #if IMUKAL_FULL_COV
+        IMUkal_updateCov(est);
+    #endif
+
+    float innov = angle_accel - est->angle; // correct
+    est->angle += est->k[0]*innov;
+    est->bias += est->k[1]*innov;
+}
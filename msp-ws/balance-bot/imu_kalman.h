@@ -0,0 +1,48 @@
+/**
+* @file imu_kalman.h
+* @brief Kalman filter IMU pitch estimation
+*
+* Two-state (angle, gyro bias) Kalman filter on pitch
+*
+* @author Lucas Tiziani
+* @date 2021-01-11
+*
+*/
+
+#ifndef IMU_KALMAN_H_
+#define IMU_KALMAN_H_
+
+
+#include <stdint.h>
+
+
+/* Macros */
+#ifndef IMUKAL_FULL_COV
+#define IMUKAL_FULL_COV 0           // 0: precomputed steady-state gain, 1: covariance update every sample
+#endif
+
+#define IMUKAL_Q_ANGLE 0.001f       // (deg^2/s) angle process noise density
+#define IMUKAL_Q_BIAS 0.003f        // (deg^2/s^3) gyro bias random walk density
+#define IMUKAL_R_ANGLE 0.03f        // (deg^2) accel angle measurement variance
+#define IMUKAL_P0_ANGLE 10.0f       // (deg^2) initial angle variance
+#define IMUKAL_P0_BIAS 10.0f        // (deg^2/s^2) initial gyro bias variance
+#define IMUKAL_ITER_GAIN 10000      // Riccati iterations to reach steady-state gain
+
+
+/* Data types */
+typedef struct {
+    float angle;        // (deg) pitch estimate
+    float bias;         // (deg/s) gyro bias estimate
+    float rate;         // (deg/s) bias-corrected pitch rate
+    float p[2][2];      // error covariance (angle, bias)
+    float k[2];         // Kalman gain (angle, bias)
+    float period;       // (s) sample period
+} imu_kalman_t;
+
+
+/* Function prototypes */
+void IMUkal_init(imu_kalman_t * est, float angle, float period);
+void IMUkal_update(imu_kalman_t * est, float ang_vel, float angle_accel);
+
+
+#endif /* IMU_KALMAN_H_ */
@@ -24,6 +24,7 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Header files */
+#include "calstore.h"
 #include "mpu6050.h"
 #include "motor.h"
 #include "enc.h"
@@ -49,11 +50,23 @@
 #define DIV_TIMER_SENSE 0x02
 #define DIV_TIMER_CONTROL 0x02
 
-#define PERIOD_MOTOR 12000 // freq_dco=48e6/div_smclk=4/freq_motor=1000
+#define FREQ_SMCLK 12000000 // (Hz) freq_dco=48e6/div_smclk=4
+#define FREQ_MOTOR 20000 // (Hz) motor PWM frequency, above audible range
+#define PERIOD_MOTOR MOTOR_PWM_PERIOD(FREQ_SMCLK, FREQ_MOTOR) // 600 at 20 kHz
 #define PERIOD_SENSE 12000 // freq_dco=48e6/div_smclk=4/div_timer=2/freq_sense=500
 #define PERIOD_CONTROL 12000 // freq_dco=48e6/div_smclk=4/div_timer=2/freq_control=500
 #define FREQ_CONTROL 500.0f
 
+#if (PERIOD_MOTOR < MOTOR_PWM_PERIOD_MIN) || (PERIOD_MOTOR > MOTOR_PWM_PERIOD_MAX)
+#error "FREQ_MOTOR gives PWM resolution outside MOTOR_PWM_PERIOD_MIN/MAX"
+#endif
+#if (PERIOD_MOTOR - MOTOR_CCR_MIN)*100 < MOTOR_DUTY_CAP_MIN*PERIOD_MOTOR
+#error "FREQ_MOTOR leaves duty cap (PERIOD_MOTOR - MOTOR_CCR_MIN)/PERIOD_MOTOR below MOTOR_DUTY_CAP_MIN"
+#endif
+#if FREQ_SMCLK*MOTOR_CYCLES_PER_COUNT != 48000000
+#error "commit latency budget (MOTOR_CYCLES_PER_COUNT) assumes SMCLK = MCLK/4"
+#endif
+
 #define PIN_MOTOR_RF GPIO_PIN4
 #define PIN_MOTOR_RB GPIO_PIN5
 #define PIN_MOTOR_LF GPIO_PIN7
@@ -68,8 +81,33 @@
 #define PIN_ENC0_CHB GPIO_PIN3
 #define PIN_ENC1_CHA GPIO_PIN6
 #define PIN_ENC1_CHB GPIO_PIN7
-
-#define N_UART_DATA 9
+#define PORT_ENC0_CLK GPIO_PORT_P8 // timer encoder mode: right channel A on TA3CLK (P8.3)
+#define PIN_ENC0_CLK GPIO_PIN3
+#define TIMER_ENC0 TIMER_A3_BASE
+#define PORT_ENC1_CLK GPIO_PORT_P4 // timer encoder mode: left channel A on TA2CLK (P4.2)
+#define PIN_ENC1_CLK GPIO_PIN2
+#define TIMER_ENC1 TIMER_A2_BASE
+#define PERIOD_CONTROL_T32 96000 // freq_dco=48e6/freq_control=500 (control tick when TA2 counts encoder)
+
+#define SENSE_MODE_TIMER 0 // sample IMU on Timer A1 tick
+#define SENSE_MODE_DRDY 1 // sample IMU on MPU-6050 data ready pulse (INT wired to P4.1)
+#define SENSE_MODE SENSE_MODE_TIMER
+#define IMU_READ_MODE IMU_READ_DMA // IMU_READ_BLOCKING, IMU_READ_DMA or IMU_READ_FIFO
+#define IMU_DIV_SAMPLE 1 // IMU sample rate divider: 1 kHz/(1+1) = 500 Hz
+#define IMU_DIV_SAMPLE_FIFO 0 // IMU sample rate divider in FIFO mode: 1 kHz
+#define PERIOD_IMU_FIFO 0.001f // (s) IMU sample period in FIFO mode
+#define DIV_READ_BLOCKING 500 // time a blocking IMU read every 500th sense tick (1 Hz) in DMA/FIFO mode, 0: never
+
+#define PORT_IMU_INT GPIO_PORT_P4
+#define PIN_IMU_INT GPIO_PIN1
+
+#define CAL_ACCEL_RUN 0 // 1: run six-position accelerometer calibration at boot
+#define CAL_MOTOR_RUN 0 // 1: identify motor dead zone and model at boot (wheels off ground)
+
+#define N_UART_DATA 10
+#define N_UART_HEALTH 9 // health line: illegal, missed, glitches, max edge rate (right, left), commit latency
+#define DIV_UART_HEALTH 10 // send encoder health every 10th transmit (1 Hz)
+#define N_UART_MOTOR 6 // motor model line: dead zone, gain, time constant (right, left)
 
 #define LED_OFF 0
 #define LED_RED 1
@@ -85,6 +123,9 @@ enc_t g_enc_l; // left encoder struct
 volatile bool g_flag_sense = 0;
 volatile bool g_flag_control = 0;
 volatile bool g_flag_transmit = 0;
+volatile uint32_t g_cycles_enc_max = 0; // (cycles) longest encoder interrupt
+volatile uint32_t g_cycles_commit_max = 0; // (cycles) longest time from PWM period boundary to committed duties
+motor_t * g_motors[2]; // motors committed at PWM period boundary (right, left)
 
 #ifndef NDEBUG
     volatile bool g_flag_debug = 0;
@@ -94,14 +135,27 @@ volatile bool g_flag_transmit = 0;
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Prototypes */
+void TA0_0_IRQHandler(void);
 void TA1_0_IRQHandler(void);
 void TA2_0_IRQHandler(void);
+void T32_INT2_IRQHandler(void);
 void PORT3_IRQHandler(void);
+void PORT4_IRQHandler(void);
+
+void startSense(void);
+void tickControl(void);
 
 void configEncGpio(enc_t * enc, uint8_t port, uint8_t pinA, uint8_t pinB);
+#if ENC_MODE == ENC_MODE_TIMER
+    void configEncTimerGpio(enc_t * enc, uint8_t port_a, uint8_t pinA, uint32_t timer_a, uint8_t pinB);
+#endif
 void updateControl(imu_t * imu, enc_t * enc_r, enc_t * enc_l,
                    motor_t * motor_r, motor_t * motor_l);
+void calibrateAccel(imu_t * imu);
+void saveCal(cal_record_t * cal, imu_t * imu, motor_t * motor_r, motor_t * motor_l);
 void recordData(imu_t * imu, float * data);
+void recordEncHealth(enc_t * enc_r, enc_t * enc_l, float * data);
+void recordMotorModel(motor_t * motor_r, motor_t * motor_l, float * data);
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -109,6 +163,7 @@ void recordData(imu_t * imu, float * data);
 void main(void) {
     MAP_WDT_A_holdTimer(); // hold the watchdog timer (stop from running)
     MAP_Interrupt_disableMaster(); // disable interrupts
+    cycleCountInit(); // start cycle counter for timing measurements
 
 
     // Configure master and subsystem master clocks
@@ -132,8 +187,8 @@ void main(void) {
         TIMER_A_CLOCKSOURCE_DIVIDER_1,      // clock source divider
         PERIOD_MOTOR,                       // timer period
         TIMER_A_CAPTURECOMPARE_REGISTER_1,  // capture compare register
-        TIMER_A_OUTPUTMODE_RESET_SET,       // reset set output mode
-        0                                   // initial duty cycle
+        TIMER_A_OUTPUTMODE_SET_RESET,       // set reset output mode (pulse at end of period)
+        MOTOR_CCR_OFF                       // initial duty cycle (output low)
     };
     MAP_Timer_A_generatePWM(TIMER_A0_BASE, &pwm_right_forward_config); // TA0.1 --> P2.4
 
@@ -142,8 +197,8 @@ void main(void) {
         TIMER_A_CLOCKSOURCE_DIVIDER_1,
         PERIOD_MOTOR,
         TIMER_A_CAPTURECOMPARE_REGISTER_2,
-        TIMER_A_OUTPUTMODE_RESET_SET,
-        0 // initial duty cycle
+        TIMER_A_OUTPUTMODE_SET_RESET,
+        MOTOR_CCR_OFF // initial duty cycle
     };
     MAP_Timer_A_generatePWM(TIMER_A0_BASE, &pwm_right_back_config); // TA0.2 --> P2.5
 
@@ -152,8 +207,8 @@ void main(void) {
         TIMER_A_CLOCKSOURCE_DIVIDER_1,
         PERIOD_MOTOR,
         TIMER_A_CAPTURECOMPARE_REGISTER_3,
-        TIMER_A_OUTPUTMODE_RESET_SET,
-        0
+        TIMER_A_OUTPUTMODE_SET_RESET,
+        MOTOR_CCR_OFF
     };
     MAP_Timer_A_generatePWM(TIMER_A0_BASE, &pwm_left_forward_config); // TA0.3 --> P2.6
 
@@ -162,46 +217,64 @@ void main(void) {
         TIMER_A_CLOCKSOURCE_DIVIDER_1,
         PERIOD_MOTOR,
         TIMER_A_CAPTURECOMPARE_REGISTER_4,
-        TIMER_A_OUTPUTMODE_RESET_SET,
-        0
+        TIMER_A_OUTPUTMODE_SET_RESET,
+        MOTOR_CCR_OFF
     };
     MAP_Timer_A_generatePWM(TIMER_A0_BASE, &pwm_left_back_config); // TA0.4 --> P2.7
 
+    MAP_Timer_A_clearCaptureCompareInterrupt(TIMER_A0_BASE,
+        TIMER_A_CAPTURECOMPARE_REGISTER_0);
+    MAP_Timer_A_enableCaptureCompareInterrupt(TIMER_A0_BASE,
+        TIMER_A_CAPTURECOMPARE_REGISTER_0); // commit staged duties at period boundary
+    MAP_Interrupt_setPriority(INT_TA0_0, PRIORITY_PWM); // before set points (MOTOR_CCR_MIN)
+    MAP_Interrupt_enableInterrupt(INT_TA0_0);
     MAP_Timer_A_startCounter(TIMER_A0_BASE, TIMER_A_UP_MODE); // start timer A0
 
 
     // Configure Timer A1 for sensor reading
-    const Timer_A_UpModeConfig timer_sensor_config =
-    {   TIMER_A_CLOCKSOURCE_SMCLK,          // SMCLK clock source
-        DIV_TIMER_SENSE,                    // clock source divider
-        PERIOD_SENSE,                       // timer period
-        TIMER_A_TAIE_INTERRUPT_DISABLE,     // disable timer A rollover interrupt
-        TIMER_A_CCIE_CCR0_INTERRUPT_ENABLE, // enable capture compare interrupt
-        TIMER_A_DO_CLEAR                    // clear counter upon initialization
-    };
-    MAP_Timer_A_configureUpMode(TIMER_A1_BASE, &timer_sensor_config);
-    MAP_Timer_A_clearCaptureCompareInterrupt(TIMER_A1_BASE,
-        TIMER_A_CAPTURECOMPARE_REGISTER_0);
-    MAP_Interrupt_setPriority(INT_TA1_0, 2);
-    MAP_Interrupt_enableInterrupt(INT_TA1_0);
-    MAP_Timer_A_startCounter(TIMER_A1_BASE, TIMER_A_UP_MODE);
+    #if SENSE_MODE == SENSE_MODE_TIMER
+        const Timer_A_UpModeConfig timer_sensor_config =
+        {   TIMER_A_CLOCKSOURCE_SMCLK,          // SMCLK clock source
+            DIV_TIMER_SENSE,                    // clock source divider
+            PERIOD_SENSE,                       // timer period
+            TIMER_A_TAIE_INTERRUPT_DISABLE,     // disable timer A rollover interrupt
+            TIMER_A_CCIE_CCR0_INTERRUPT_ENABLE, // enable capture compare interrupt
+            TIMER_A_DO_CLEAR                    // clear counter upon initialization
+        };
+        MAP_Timer_A_configureUpMode(TIMER_A1_BASE, &timer_sensor_config);
+        MAP_Timer_A_clearCaptureCompareInterrupt(TIMER_A1_BASE,
+            TIMER_A_CAPTURECOMPARE_REGISTER_0);
+        MAP_Interrupt_setPriority(INT_TA1_0, PRIORITY_TICK);
+        MAP_Interrupt_enableInterrupt(INT_TA1_0);
+        MAP_Timer_A_startCounter(TIMER_A1_BASE, TIMER_A_UP_MODE);
+    #endif
 
 
-    // Configure Timer A2 for control update
-    const Timer_A_UpModeConfig timer_control_config =
-    {   TIMER_A_CLOCKSOURCE_SMCLK,          // SMCLK clock source
-        DIV_TIMER_CONTROL,                  // clock source divider
-        PERIOD_CONTROL,                     // timer period
-        TIMER_A_TAIE_INTERRUPT_DISABLE,     // disable timer A rollover interrupt
-        TIMER_A_CCIE_CCR0_INTERRUPT_ENABLE, // enable capture compare interrupt
-        TIMER_A_DO_CLEAR                    // clear counter upon initialization
-    };
-    MAP_Timer_A_configureUpMode(TIMER_A2_BASE, &timer_control_config);
-    MAP_Timer_A_clearCaptureCompareInterrupt(TIMER_A2_BASE,
-        TIMER_A_CAPTURECOMPARE_REGISTER_0);
-    MAP_Interrupt_setPriority(INT_TA2_0, 2);
-    MAP_Interrupt_enableInterrupt(INT_TA2_0);
-    MAP_Timer_A_startCounter(TIMER_A2_BASE, TIMER_A_UP_MODE);
+    // Configure control update tick: Timer A2, or Timer32 module 2 when Timer A2 counts encoder
+    #if ENC_MODE == ENC_MODE_TIMER
+        MAP_Timer32_initModule(TIMER32_1_BASE, TIMER32_PRESCALER_1, TIMER32_32BIT,
+            TIMER32_PERIODIC_MODE);
+        MAP_Timer32_setCount(TIMER32_1_BASE, PERIOD_CONTROL_T32);
+        MAP_Timer32_enableInterrupt(TIMER32_1_BASE);
+        MAP_Interrupt_setPriority(INT_T32_INT2, PRIORITY_TICK);
+        MAP_Interrupt_enableInterrupt(INT_T32_INT2);
+        MAP_Timer32_startTimer(TIMER32_1_BASE, false);
+    #else
+        const Timer_A_UpModeConfig timer_control_config =
+        {   TIMER_A_CLOCKSOURCE_SMCLK,          // SMCLK clock source
+            DIV_TIMER_CONTROL,                  // clock source divider
+            PERIOD_CONTROL,                     // timer period
+            TIMER_A_TAIE_INTERRUPT_DISABLE,     // disable timer A rollover interrupt
+            TIMER_A_CCIE_CCR0_INTERRUPT_ENABLE, // enable capture compare interrupt
+            TIMER_A_DO_CLEAR                    // clear counter upon initialization
+        };
+        MAP_Timer_A_configureUpMode(TIMER_A2_BASE, &timer_control_config);
+        MAP_Timer_A_clearCaptureCompareInterrupt(TIMER_A2_BASE,
+            TIMER_A_CAPTURECOMPARE_REGISTER_0);
+        MAP_Interrupt_setPriority(INT_TA2_0, PRIORITY_TICK);
+        MAP_Interrupt_enableInterrupt(INT_TA2_0);
+        MAP_Timer_A_startCounter(TIMER_A2_BASE, TIMER_A_UP_MODE);
+    #endif
 
 
     // Configure I2C
@@ -211,6 +284,8 @@ void main(void) {
     P6->SEL0 |= 0x30;         // configure P6.4, P6.5 for UCB1: set bits 4 & 5
     P6->SEL1 &= ~0x30;        // configure P6.4, P6.5 for UCB1: clear bits 4 & 5
     EUSCI_B1->CTLW0 &= ~1;    // enable UCB1 after configuration
+    I2Cc_initAsync();         // drive I2C transactions from UCB1 interrupt
+    I2Cc_initDma();           // receive IMU samples by DMA
 
 
     // Configure UART to 115200 baud rate
@@ -232,10 +307,27 @@ void main(void) {
 
 
     // Configure encoder pins
-    configEncGpio(&g_enc_r, PORT_ENC, GPIO_PIN2, GPIO_PIN3);
-    configEncGpio(&g_enc_l, PORT_ENC, GPIO_PIN6, GPIO_PIN7);
-    MAP_Interrupt_setPriority(PORT_ENC, 0);
-    MAP_Interrupt_enableInterrupt(PORT_ENC);
+    Enc_initTimer(); // edge timestamps
+    #if ENC_MODE == ENC_MODE_TIMER
+        configEncTimerGpio(&g_enc_r, PORT_ENC0_CLK, PIN_ENC0_CLK, TIMER_ENC0, PIN_ENC0_CHB);
+        configEncTimerGpio(&g_enc_l, PORT_ENC1_CLK, PIN_ENC1_CLK, TIMER_ENC1, PIN_ENC1_CHB);
+    #else
+        configEncGpio(&g_enc_r, PORT_ENC, GPIO_PIN2, GPIO_PIN3);
+        configEncGpio(&g_enc_l, PORT_ENC, GPIO_PIN6, GPIO_PIN7);
+    #endif
+    MAP_Interrupt_setPriority(INT_PORT3, PRIORITY_ENC);
+    MAP_Interrupt_enableInterrupt(INT_PORT3);
+
+
+    // Configure IMU data ready pin
+    #if SENSE_MODE == SENSE_MODE_DRDY
+        MAP_GPIO_setAsInputPinWithPullDownResistor(PORT_IMU_INT, PIN_IMU_INT);
+        MAP_GPIO_interruptEdgeSelect(PORT_IMU_INT, PIN_IMU_INT, GPIO_LOW_TO_HIGH_TRANSITION);
+        MAP_GPIO_clearInterruptFlag(PORT_IMU_INT, PIN_IMU_INT);
+        MAP_GPIO_enableInterrupt(PORT_IMU_INT, PIN_IMU_INT);
+        MAP_Interrupt_setPriority(INT_PORT4, PRIORITY_TICK);
+        MAP_Interrupt_enableInterrupt(INT_PORT4);
+    #endif
 
 
     // Configure LEDs
@@ -247,52 +339,113 @@ void main(void) {
 
     ////////////////////////////////////////////////////////////////////////////
     /* Local variables */
-    imu_t imu;  // imu struct
+    imu_t imu = {0};  // imu struct
+    #if (IMU_READ_MODE == IMU_READ_BLOCKING) || (DIV_READ_BLOCKING > 0)
+        imu_sample_t sample; // raw sample read in main loop
+    #endif
 
     motor_t motor_r = {
         .reg_duty = {REG_MOTOR_RF_DUTY,
                      REG_MOTOR_RB_DUTY},
-        .deadzone = 14.17,               // (% duty cycle) (1700/12000)
-        .pid_vel = {.k_p = 0.03,
-                    .k_i = 0.005,
-                    .k_d = 0},
+        .decay = MOTOR_DECAY_FAST,       // coast during PWM off-time
+        .deadzone = 14.17,               // (% duty cycle)
     };
     motor_t motor_l = {
         .reg_duty = {REG_MOTOR_LF_DUTY,
                      REG_MOTOR_LB_DUTY},
-        .deadzone = 17.50,                // (% duty cycle) (2100/12000)
-        .pid_vel = {.k_p = 0.03,
-                    .k_i = 0.005,
-                    .k_d = 0},
+        .decay = MOTOR_DECAY_FAST,       // coast during PWM off-time
+        .deadzone = 17.50,               // (% duty cycle)
     };
 
-    float data_uart[N_UART_DATA] = {0,0,0,0,0,0,0,0,0};
+    g_motors[0] = &motor_r;
+    g_motors[1] = &motor_l;
+    if (Motor_initPwm(g_motors, 2, TIMER_A0_BASE, FREQ_MOTOR)) { // period from actual SMCLK
+        LED2_set(LED_RED); // PWM resolution too coarse for clock tree
+        while (1);
+    }
+
+    const motor_gains_t gains_vel = {
+        .k_p = 0.03f,       // (%/(deg/s))
+        .k_i = 2.5f,        // (%/deg) (0.005 per 2 ms step)
+        .k_d = 0.0f,        // (%/(deg/s^2))
+        .k_aw = 80.0f,      // (1/s) back-calculation only (about k_i/k_p)
+        .k_ff_vel = 0.0f,   // (%/(deg/s))
+        .k_ff_acc = 0.0f,   // (%/(deg/s^2))
+    };
+
+    float data_uart[N_UART_DATA] = {0,0,0,0,0,0,0,0,0,0};
+    float data_health[N_UART_HEALTH];
+    int count_health = 0;
+    #if (IMU_READ_MODE != IMU_READ_BLOCKING) && (DIV_READ_BLOCKING > 0)
+        int count_read_blocking = 0;
+    #endif
+    float data_motor[N_UART_MOTOR];
+
+    motor_char_t char_r; // motor characterization state
+    motor_char_t char_l;
+    bool char_run = CAL_MOTOR_RUN; // characterization replaces control until finished
+    bool char_send = 0; // send identified motor model with next transmission
+
+    cal_record_t cal = {0}; // calibration record stored in flash
+    bool cal_stored = 0;    // calibration loaded from (or written to) flash
+    bool temp_fit_stored = 0; // temperature model written to flash
 
 
     ////////////////////////////////////////////////////////////////////////////
     /* Initialize */
     delayMs(FREQ_DCO, 500); // delay to let IMU power up
 
-//    LED2_set(LED_GREEN);
-//    Enc_init(&g_enc_r); // initialize encoder 0
-//    Enc_init(&g_enc_l); // initialize encoder 1
-//    delayMs(FREQ_DCO, 100);
-//    LED2_set(LED_OFF);
+    LED2_set(LED_GREEN);
+    Enc_init(&g_enc_r, 1.0f/FREQ_CONTROL); // initialize encoder 0, angle sampled at control rate
+    Enc_init(&g_enc_l, 1.0f/FREQ_CONTROL); // initialize encoder 1
+    delayMs(FREQ_DCO, 100);
+    LED2_set(LED_OFF);
 
     LED2_set(LED_RED);
-    IMU_init(&imu, 44, 1000, 2);   // initialize IMU
+    while (IMU_init(&imu, 44, 1000, 2)) { // initialize IMU, retry until configuration is confirmed
+        delayMs(FREQ_DCO, 100);
+    }
+    #if SENSE_MODE == SENSE_MODE_DRDY
+        IMU_initDataReady(IMU_DIV_SAMPLE); // pulse INT pin on every new sample
+    #endif
     delayMs(FREQ_DCO, 100);
     LED2_set(LED_OFF);
 
     LED2_set(LED_BLUE);
-    IMU_calibrate(&imu, 200, 20000); // calibrate IMU
+    cal_stored = Cal_load(&cal) && !CAL_ACCEL_RUN; // calibration run replaces stored record
+    if (cal_stored) { // start from stored calibration
+        IMU_setAccelCal(&imu, cal.accel_bias, cal.accel_mat);
+        motor_r.deadzone = cal.deadzone[0];
+        motor_l.deadzone = cal.deadzone[1];
+        motor_r.gain = cal.motor_gain[0];
+        motor_l.gain = cal.motor_gain[1];
+        motor_r.tau = cal.motor_tau[0];
+        motor_l.tau = cal.motor_tau[1];
+    }
+    Motor_initPid(&motor_r, &gains_vel, 1.0f/FREQ_CONTROL); // after deadzone is known
+    Motor_initPid(&motor_l, &gains_vel, 1.0f/FREQ_CONTROL);
+    #if CAL_ACCEL_RUN
+        calibrateAccel(&imu);
+    #endif
+    IMU_readVals(&imu);
+    IMU_initCal(&imu); // gyro offsets converge in background while stationary
+    if (cal_stored) {
+        IMU_setCal(&imu, cal.gyro_offset, cal.gyro_temp_coef);
+    }
     IMU_calcAngleFused(&imu, 0.002); // get initial measurement
     LED2_set(LED_OFF);
 
-    LED2_set(LED_GREEN);
-    delayMs(FREQ_DCO, 2000); // allow time for positioning
-    LED2_set(LED_OFF);
+    if (!cal_stored) { // live calibration only
+        LED2_set(LED_GREEN);
+        delayMs(FREQ_DCO, 2000); // allow time for positioning
+        LED2_set(LED_OFF);
+    }
 
+    #if IMU_READ_MODE == IMU_READ_FIFO
+        IMU_initFifo(IMU_DIV_SAMPLE_FIFO); // start oversampling into IMU FIFO
+    #endif
+    Motor_initChar(&char_r, g_enc_r.count);
+    Motor_initChar(&char_l, -g_enc_l.count);
     MAP_Interrupt_enableMaster(); // enable interrupts
 
 
@@ -300,24 +453,81 @@ void main(void) {
     /* Run */
     while(1) {
         if (1 == g_flag_sense) {
-            IMU_readVals(&imu);
-            IMU_calcAngleFused(&imu, 0.002);
-//            Enc_calcAngle(&g_enc_r);
-//            Enc_calcAngle(&g_enc_l);
+            #if IMU_READ_MODE == IMU_READ_DMA
+                IMU_finishReadDma(&imu); // sample was read in background
+                IMU_calcAngleFused(&imu, 0.002);
+            #elif IMU_READ_MODE == IMU_READ_FIFO
+                IMU_updateFifo(&imu, PERIOD_IMU_FIFO); // fuse all samples queued since last tick
+            #else
+                IMU_readSampleTimed(&imu, &sample);
+                IMU_takeSample(&imu, &sample); // counts go straight to fixed-point estimator
+                IMU_calcAngleFused(&imu, 0.002);
+            #endif
+            #if (IMU_READ_MODE != IMU_READ_BLOCKING) && (DIV_READ_BLOCKING > 0)
+                if (DIV_READ_BLOCKING == ++count_read_blocking) { // keep blocking read cost current, bus is idle after tick
+                    IMU_readSampleTimed(&imu, &sample); // sample is discarded
+                    count_read_blocking = 0;
+                }
+            #endif
+            Enc_calcAngle(&g_enc_r);
+            Enc_calcAngle(&g_enc_l);
             g_flag_sense = 0;
         }
 
+        if (!cal_stored && imu.cal.converged) { // store live calibration for next boot
+            saveCal(&cal, &imu, &motor_r, &motor_l);
+            cal_stored = 1; // one attempt per boot: flash erase stalls the loop
+        }
+        if (!temp_fit_stored && imu.temp_fit.valid) { // store gyro offset temperature model
+            saveCal(&cal, &imu, &motor_r, &motor_l);
+            temp_fit_stored = 1;
+        }
+
         if (1 == g_flag_control) {
+            if (char_run) { // motor characterization, wheels free
+                bool done_r = Motor_updateChar(&motor_r, &char_r, g_enc_r.count,
+                    g_enc_r.vel_mt, 1.0f/FREQ_CONTROL);
+                bool done_l = Motor_updateChar(&motor_l, &char_l, -g_enc_l.count,
+                    -(g_enc_l.vel_mt), 1.0f/FREQ_CONTROL);
+                Motor_releasePwm();
+                if (done_r && done_l) { // a failed motor keeps its previous model
+                    bool ok_r = (MOTOR_CHAR_DONE == char_r.stage);
+                    bool ok_l = (MOTOR_CHAR_DONE == char_l.stage);
+                    if (ok_r) {
+                        Motor_initPid(&motor_r, &gains_vel, 1.0f/FREQ_CONTROL); // new dead zone and feed-forward
+                    }
+                    if (ok_l) {
+                        Motor_initPid(&motor_l, &gains_vel, 1.0f/FREQ_CONTROL);
+                    }
+                    if ((ok_r || ok_l) && cal_stored) { // otherwise stored with live IMU calibration
+                        saveCal(&cal, &imu, &motor_r, &motor_l);
+                    }
+                    char_run = 0;
+                    char_send = ok_r && ok_l; // model line only carries identified models
+                }
+            }
 //            updateControl(&imu, &g_enc_r, &g_enc_l, &motor_r, &motor_l);
-//            Motor_velUpdate(&motor_r, g_enc_r.vel[0], PERIOD_MOTOR);
-//            Motor_velUpdate(&motor_l, -(g_enc_l.vel[0]), PERIOD_MOTOR);
+//            Motor_velUpdate(&motor_r, g_enc_r.vel_mt);
+//            Motor_velUpdate(&motor_l, -(g_enc_l.vel_mt));
+//            Motor_releasePwm(); // both motors change in same PWM period
             g_flag_control = 0;
         }
 
         if (1 == g_flag_transmit) {
             recordData(&imu, data_uart);
-//            float data_test[N_UART_DATA] = {1.1, 2.2, 3.3, 4.4, 5.5, 6.6, 7.7, 8.8, 9.9};
-            UARTc_sendFloatArray(data_uart, 9); //(int)(sizeof(data_uart)/sizeof(data_uart[0])));
+//            float data_test[N_UART_DATA] = {1.1, 2.2, 3.3, 4.4, 5.5, 6.6, 7.7, 8.8, 9.9, 10.0};
+            UARTc_sendFloatArray(data_uart, N_UART_DATA);
+            count_health++;
+            if (DIV_UART_HEALTH == count_health) { // shorter line tells receiver it is health data
+                recordEncHealth(&g_enc_r, &g_enc_l, data_health);
+                UARTc_sendFloatArray(data_health, N_UART_HEALTH);
+                count_health = 0;
+            }
+            if (char_send) { // six-value line tells receiver it is the motor model
+                recordMotorModel(&motor_r, &motor_l, data_motor);
+                UARTc_sendFloatArray(data_motor, N_UART_MOTOR);
+                char_send = 0;
+            }
 
             MAP_GPIO_toggleOutputOnPin(GPIO_PORT_P1, GPIO_PIN0);
 
@@ -329,13 +539,13 @@ void main(void) {
 //                g_flag_debug++;
 //
 //                if (200 = g_flag_debug) { // 10 seconds
-//                    motor_r.pid_vel.vel_des = 800;
-//                    motor_l.pid_vel.vel_des = -800;
+//                    Motor_setVel(&motor_r, 800, 0);
+//                    Motor_setVel(&motor_l, -800, 0);
 //    //                *(motor_l.reg_duty.forward) = 2100;
 //                }
 //                if (300 == g_flag_debug) { // 15 seconds
-//                    motor_r.pid_vel.vel_des = 0;
-//                    motor_l.pid_vel.vel_des = 0;
+//                    Motor_setVel(&motor_r, 0, 0);
+//                    Motor_setVel(&motor_l, 0, 0);
 //    //                *(motor_l.reg_duty.forward) = 0;
 //                    g_flag_debug = 0;
 //                }
@@ -349,9 +559,23 @@ void main(void) {
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Interrupts */
+void TA0_0_IRQHandler(void) {
+    /* Motor PWM period interrupt routine: commit staged duties of both motors */
+    uint32_t cycles_start = CYCLE_COUNT();
+    uint32_t counts_entry = TIMER_A0->R; // (timer counts) since period boundary
+    Motor_commitPwm(g_motors, 2);
+    uint32_t cycles = counts_entry*MOTOR_CYCLES_PER_COUNT + (CYCLE_COUNT() - cycles_start);
+    if (cycles > g_cycles_commit_max) { // over MOTOR_CCR_MIN*MOTOR_CYCLES_PER_COUNT: set point missed
+        g_cycles_commit_max = cycles;
+    }
+    MAP_Timer_A_clearCaptureCompareInterrupt(TIMER_A0_BASE,
+        TIMER_A_CAPTURECOMPARE_REGISTER_0);
+}
+
+
 void TA1_0_IRQHandler(void) {
     /* Timer 0 interrupt routine: read sensors */
-    g_flag_sense = 1;
+    startSense();
     MAP_Timer_A_clearCaptureCompareInterrupt(TIMER_A1_BASE,
         TIMER_A_CAPTURECOMPARE_REGISTER_0);
 }
@@ -359,42 +583,67 @@ void TA1_0_IRQHandler(void) {
 
 void TA2_0_IRQHandler(void) {
     /* Timer 1 interrupt routine: update control */
-    static int count;
-
-    g_flag_control = 1;
-
-    count++;
-    if (50 == count) { // transmit data at 10 Hz
-        g_flag_transmit = 1;
-        count = 0;
-    }
-
+    tickControl();
     MAP_Timer_A_clearCaptureCompareInterrupt(TIMER_A2_BASE,
         TIMER_A_CAPTURECOMPARE_REGISTER_0);
 }
 
 
-void PORT3_IRQHandler(void) {
-    /* Encoder interrupt handler */
-//    MAP_Interrupt_disableMaster(); // disable interrupts
-    uint_fast16_t status = MAP_GPIO_getEnabledInterruptStatus(PORT_ENC);
+void T32_INT2_IRQHandler(void) {
+    /* Timer32 module 2 interrupt routine: update control (timer encoder mode) */
+    MAP_Timer32_clearInterruptFlag(TIMER32_1_BASE);
+    tickControl();
+}
 
-    if (status <= (PIN_ENC0_CHA | PIN_ENC0_CHB)) { // check which encoder
-        Enc_update(&g_enc_r);
-//        LED2_Set(LED_GREEN);
-    }
-    else if (status <= (PIN_ENC1_CHA | PIN_ENC1_CHB)) {
-        Enc_update(&g_enc_l);
-//        LED2_Set(LED_BLUE);
+
+void PORT3_IRQHandler(void) {
+    /* Encoder interrupt handler: decode both encoders from one port read */
+    static enc_t * const encs[2] = {&g_enc_r, &g_enc_l};
+    uint32_t cycles_start = CYCLE_COUNT();
+    Enc_updatePort(encs, 2);
+    uint32_t cycles = CYCLE_COUNT() - cycles_start;
+    if (cycles > g_cycles_enc_max) {
+        g_cycles_enc_max = cycles;
     }
+}
+
 
-    MAP_GPIO_clearInterruptFlag(PORT_ENC, status);
-//    MAP_Interrupt_enableMaster(); // disable interrupts
+void PORT4_IRQHandler(void) {
+    /* IMU data ready interrupt handler: read sample as soon as it is available */
+    uint_fast16_t status = MAP_GPIO_getEnabledInterruptStatus(PORT_IMU_INT);
+    if (status & PIN_IMU_INT) {
+        startSense();
+    }
+    MAP_GPIO_clearInterruptFlag(PORT_IMU_INT, status);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 /* Functions */
+void startSense(void) {
+    /* Start sensor reading: background read or flag for main loop */
+    #if IMU_READ_MODE == IMU_READ_DMA
+        IMU_startReadDma(&g_flag_sense); // flag is set when sample has arrived
+    #else
+        g_flag_sense = 1;
+    #endif
+}
+
+
+void tickControl(void) {
+    /* Flag control update, and data transmission every 50th tick */
+    static int count;
+
+    g_flag_control = 1;
+
+    count++;
+    if (50 == count) { // transmit data at 10 Hz
+        g_flag_transmit = 1;
+        count = 0;
+    }
+}
+
+
 void configEncGpio(enc_t * enc, uint8_t port, uint8_t pinA, uint8_t pinB) {
     enc->port = port;
     enc->pins[0] = pinA;
@@ -406,18 +655,38 @@ void configEncGpio(enc_t * enc, uint8_t port, uint8_t pinA, uint8_t pinB) {
 }
 
 
+#if ENC_MODE == ENC_MODE_TIMER
+void configEncTimerGpio(enc_t * enc, uint8_t port_a, uint8_t pinA, uint32_t timer_a, uint8_t pinB) {
+    /* Channel A as Timer_A clock input (TAxCLK), channel B interrupt on encoder port */
+    enc->port = PORT_ENC;
+    enc->pins[0] = pinA;
+    enc->pins[1] = pinB;
+    enc->port_a = port_a;
+    enc->timer_a = timer_a;
+
+    MAP_GPIO_setAsPeripheralModuleFunctionInputPin(port_a, pinA, GPIO_PRIMARY_MODULE_FUNCTION);
+    MAP_GPIO_setAsInputPinWithPullDownResistor(PORT_ENC, pinB);
+    MAP_GPIO_clearInterruptFlag(PORT_ENC, pinB);
+    MAP_GPIO_enableInterrupt(PORT_ENC, pinB);
+}
+#endif
+
+
 void updateControl(imu_t * imu, enc_t * enc_r, enc_t * enc_l,
     motor_t * motor_r, motor_t * motor_l) {
     /* Update motor velocity set-points based on sensor measurements*/
 
     //TODO: put gains somewhere?
     static float k_lqr[4] = {-0.1000f, -0.8716f, -410.4197f, -71.6509f};
+    static float accel_alpha_prev = 0; // (rad/s^2) last commanded wheel acceleration
 
     // create state vector of angles and angular velocities
     float x[4];
-    x[0] = (enc_r->pos[0])*DEG_TO_RAD;          // alpha: wheel angle relative to chassis
-    x[1] = (enc_r->vel_filt)*DEG_TO_RAD;        // alpha vel: wheel angular velocity relative to chassis
-    x[2] = (imu->angle.fused[0][0])*DEG_TO_RAD; // theta2: chassis angle
+    x[0] = (enc_r->pos[0])*DEG_TO_RAD;          // alpha: wheel angle relative to chassis (needs ENC_MODE_INT)
+    x[1] = (enc_r->vel_filt)*DEG_TO_RAD + accel_alpha_prev*enc_r->delay_vel; // alpha vel: wheel angular
+        // velocity relative to chassis, extrapolated over velocity filter delay
+    x[2] = (imu->angle.fused[0][0] + imu->ang_vel.fused[0]*imu->dlpf.delay_gyro)*DEG_TO_RAD; // theta2: chassis angle,
+        // extrapolated over IMU filter delay
     x[3] = (imu->ang_vel.fused[0])*DEG_TO_RAD;  // theta2 vel: chassis angular velocity
 
     // calculate acceleration input
@@ -426,6 +695,7 @@ void updateControl(imu_t * imu, enc_t * enc_r, enc_t * enc_l,
     for (i = 0; i < 4; i++) {
         accel_alpha = accel_alpha - k_lqr[i]*x[i]; // calculate acceleration from LQR state-feedback control law
     }
+    accel_alpha_prev = accel_alpha;
 
 //    // impose acceleration limit
 //    if (accel_alpha > ACCEL_LIMIT)
@@ -455,8 +725,44 @@ void updateControl(imu_t * imu, enc_t * enc_r, enc_t * enc_l,
 //        vel_alpha = -VEL_LIMIT;
 //    }
 
-    motor_r->pid_vel.vel_des = vel_alpha;
-    motor_l->pid_vel.vel_des = vel_alpha;
+    Motor_setVel(motor_r, vel_alpha, accel_alpha*RAD_TO_DEG); // acceleration as feed-forward
+    Motor_setVel(motor_l, vel_alpha, accel_alpha*RAD_TO_DEG);
+}
+
+
+void calibrateAccel(imu_t * imu) {
+    /* Six-position accelerometer calibration: place robot +x, -x, +y, -y, +z, -z up while LED is green */
+    float poses[IMU_CAL_ACCEL_POSES][3];
+    int pose;
+    for (pose = 0; pose < IMU_CAL_ACCEL_POSES; pose++) {
+        LED2_set(LED_GREEN);
+        delayMs(FREQ_DCO, 5000); // allow time for positioning
+        LED2_set(LED_OFF);
+        IMU_measureAccelPose(imu, poses[pose], 500);
+    }
+    IMU_calibrateAccel(imu, poses);
+}
+
+
+void saveCal(cal_record_t * cal, imu_t * imu, motor_t * motor_r, motor_t * motor_l) {
+    /* Write current calibration to flash */
+    int axis, i;
+    for (axis = 0; axis < 3; axis++) {
+        cal->gyro_offset[axis] = imu->cal.ang_vel_offset[axis];
+        cal->gyro_temp_coef[axis][0] = imu->cal.ang_vel_temp_coef[axis][0];
+        cal->gyro_temp_coef[axis][1] = imu->cal.ang_vel_temp_coef[axis][1];
+        cal->accel_bias[axis] = imu->cal.accel_bias[axis];
+        for (i = 0; i < 3; i++) {
+            cal->accel_mat[axis][i] = imu->cal.accel_mat[axis][i];
+        }
+    }
+    cal->deadzone[0] = motor_r->deadzone;
+    cal->deadzone[1] = motor_l->deadzone;
+    cal->motor_gain[0] = motor_r->gain;
+    cal->motor_gain[1] = motor_l->gain;
+    cal->motor_tau[0] = motor_r->tau;
+    cal->motor_tau[1] = motor_l->tau;
+    Cal_save(cal);
 }
 
 
@@ -467,14 +773,18 @@ void recordData(imu_t * imu, float * data) {
 //    #ifndef NDEBUG
 //        data[2] = g_debug;
 //    #endif
+    data[0] = (float)g_cycles_enc_max;           // (cycles) longest encoder interrupt
+    data[1] = (float)imu->cycles.read_dma;      // (cycles) CPU time of DMA IMU read
+    data[2] = (float)imu->cycles.read_blocking; // (cycles) CPU time of blocking IMU read (refreshed at 1 Hz)
+    data[3] = (float)imu->fifo.overflows;       // IMU FIFO overflow count
 
-    data[3] = imu->raw.ang_vel[0];
-    data[4] = imu->raw.ang_vel[1];
-    data[5] = imu->raw.ang_vel[2];
+    data[4] = imu->raw.ang_vel[0];
+    data[5] = imu->raw.ang_vel[1];
+    data[6] = imu->raw.ang_vel[2];
 
-    data[6] = imu->angle.gyro[0];
-    data[7] = imu->angle.accel[0];
-    data[8] = imu->angle.fused[0][0];
+    data[7] = (float)imu->cycles.estimate;      // (cycles) CPU time of attitude update
+    data[8] = imu->angle.accel[0];
+    data[9] = imu->angle.fused[0][0];
 
 //    data[6] = imu->angle.fused[0][0];
 //    data[8] = imu->ang_vel.fused[0];
@@ -482,5 +792,32 @@ void recordData(imu_t * imu, float * data) {
 }
 
 
+void recordEncHealth(enc_t * enc_r, enc_t * enc_l, float * data) {
+    /* Record encoder health counters and PWM commit latency to transmit via UART */
+    enc_t * encs[2] = {enc_r, enc_l};
+    int i;
+    for (i = 0; i < 2; i++) {
+        data[4*i] = (float)encs[i]->illegal;    // illegal transitions
+        data[4*i+1] = (float)encs[i]->missed;   // illegal transitions recovered as missed edges
+        data[4*i+2] = (float)encs[i]->glitches; // edges rejected as glitches
+        data[4*i+3] = (UINT32_MAX == encs[i]->dt_edge_min) ? 0.0f :
+            ENC_TIMER_FREQ/(float)encs[i]->dt_edge_min; // (edges/s) max edge rate
+    }
+    data[8] = (float)g_cycles_commit_max; // (cycles) longest PWM commit latency
+}
+
+
+void recordMotorModel(motor_t * motor_r, motor_t * motor_l, float * data) {
+    /* Record identified motor dead zone and model to transmit via UART */
+    motor_t * motors[2] = {motor_r, motor_l};
+    int i;
+    for (i = 0; i < 2; i++) {
+        data[3*i] = motors[i]->deadzone;    // (% duty cycle) breakaway duty
+        data[3*i+1] = motors[i]->gain;      // ((deg/s)/%) steady-state gain
+        data[3*i+2] = motors[i]->tau;       // (s) time constant
+    }
+}
+
+
 
 
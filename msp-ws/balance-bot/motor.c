@@ -11,26 +11,260 @@
 
 
 #include "motor.h"
+#include <math.h>
+#include <stdlib.h>
 
 
-void Motor_velUpdate(motor_t * motor, float vel_motor, int period_motor) {
-    /* Motor velocity controller: PID */
-    float err = vel_motor - motor->pid_vel.vel_des;
-    motor->pid_vel.err_int += err;
-    float err_der = err - motor->pid_vel.err_prev; // assume consistent timestep
-    motor->pid_vel.err_prev = err; // set previous error to current error
+#if MOTOR_PID_Q15
+#define VEL_TO_Q15 (32768.0f/MOTOR_VEL_FULL)       // (1/(deg/s)) velocity to Q15
+#define DUTY_TO_Q15 (32768.0f/MOTOR_DUTY_MAX)      // (1/%) duty cycle to Q15
+#endif
 
-    // reset integral windup
-    if ((motor->pid_vel.err_int)*(motor->pid_vel.k_p) > 100.0) {
-        motor->pid_vel.err_int = 100.0/(motor->pid_vel.k_p);
+
+void Motor_initPid(motor_t * motor, const motor_gains_t * gains, float period) {
+    /* Precompute velocity controller gains for fixed period: call after deadzone and model are set.
+       Identified model replaces feed-forward gains: u = (vel + tau*acc)/gain */
+    motor_pid_t * pid = &motor->pid_vel;
+    float u_max = Motor_getDutyMax(motor) - motor->deadzone; // deadzone compensation adds the rest
+    #if MOTOR_PID_Q15
+        float norm = MOTOR_VEL_FULL/MOTOR_DUTY_MAX; // normalized gain per gain
+        pid->k_p = (int32_t)(gains->k_p*norm*65536.0f);
+        pid->k_i_dt = (int32_t)(gains->k_i*period*norm*16777216.0f);
+        pid->k_d_dt = (int32_t)(gains->k_d/period*norm*65536.0f);
+        pid->k_aw_dt = (int32_t)(gains->k_aw*period*65536.0f);
+        pid->u_max = (int32_t)(u_max*DUTY_TO_Q15);
+    #else
+        pid->k_p = gains->k_p;
+        pid->k_i_dt = gains->k_i*period;
+        pid->k_d_dt = gains->k_d/period;
+        pid->k_aw_dt = gains->k_aw*period;
+        pid->u_max = u_max;
+    #endif
+    pid->k_ff_vel = (motor->gain > 0.0f) ? 1.0f/motor->gain : gains->k_ff_vel;
+    pid->k_ff_acc = (motor->gain > 0.0f) ? motor->tau/motor->gain : gains->k_ff_acc;
+    pid->integ = 0;
+    pid->vel_prev = 0;
+    pid->u = 0.0f;
+    Motor_setVel(motor, 0.0f, 0.0f);
+}
+
+
+void Motor_setVel(motor_t * motor, float vel_des, float acc_des) {
+    /* Set velocity set-point and its rate of change, precompute feed-forward command */
+    motor_pid_t * pid = &motor->pid_vel;
+    float u_ff = pid->k_ff_vel*vel_des + pid->k_ff_acc*acc_des;
+    #if MOTOR_PID_Q15
+        pid->vel_des = (int32_t)(vel_des*VEL_TO_Q15);
+        pid->u_ff = (int32_t)(u_ff*DUTY_TO_Q15);
+    #else
+        pid->vel_des = vel_des;
+        pid->u_ff = u_ff;
+    #endif
+    pid->off = (fabsf(vel_des) < MOTOR_VEL_DEADBAND);
+}
+
+
+float Motor_calcPid(motor_t * motor, float vel_motor) {
+    /* Velocity controller: PI-D with feed-forward, derivative on measurement, anti-windup */
+    motor_pid_t * pid = &motor->pid_vel;
+    if (pid->off) { // motor off: start from rest next time
+        pid->integ = 0;
+        pid->u = 0.0f;
+        #if MOTOR_PID_Q15
+            pid->vel_prev = (int32_t)(vel_motor*VEL_TO_Q15);
+        #else
+            pid->vel_prev = vel_motor;
+        #endif
+        return 0.0f;
+    }
+
+    #if MOTOR_PID_Q15
+        int32_t vel = (int32_t)(vel_motor*VEL_TO_Q15);
+        int32_t err = pid->vel_des - vel;
+        int32_t u_unsat = (int32_t)(((int64_t)pid->k_p*err) >> 16) + (pid->integ >> 15)
+            + (int32_t)(((int64_t)pid->k_d_dt*(pid->vel_prev - vel)) >> 16) + pid->u_ff;
+        pid->vel_prev = vel;
+
+        int32_t u = u_unsat;
+        if (u > pid->u_max) {
+            u = pid->u_max;
+        }
+        else if (u < -pid->u_max) {
+            u = -pid->u_max;
+        }
+
+        int32_t d_integ = (int32_t)(((int64_t)pid->k_i_dt*err) >> 9); // (Q30)
+        #if MOTOR_ANTIWINDUP == MOTOR_AW_BACKCALC
+            pid->integ += d_integ + (int32_t)(((int64_t)pid->k_aw_dt*(u - u_unsat)) >> 1);
+        #else
+            if ((u == u_unsat) || ((u_unsat > u) == (err < 0))) { // not saturated, or error unwinds it
+                pid->integ += d_integ;
+            }
+        #endif
+        int32_t integ_max = pid->u_max << 15;
+        if (pid->integ > integ_max) {
+            pid->integ = integ_max;
+        }
+        else if (pid->integ < -integ_max) {
+            pid->integ = -integ_max;
+        }
+        pid->u = (float)u*(1.0f/DUTY_TO_Q15);
+    #else
+        float err = pid->vel_des - vel_motor;
+        float u_unsat = pid->k_p*err + pid->integ + pid->k_d_dt*(pid->vel_prev - vel_motor)
+            + pid->u_ff;
+        pid->vel_prev = vel_motor;
+
+        float u = u_unsat;
+        if (u > pid->u_max) {
+            u = pid->u_max;
+        }
+        else if (u < -pid->u_max) {
+            u = -pid->u_max;
+        }
+
+        #if MOTOR_ANTIWINDUP == MOTOR_AW_BACKCALC
+            pid->integ += pid->k_i_dt*err + pid->k_aw_dt*(u - u_unsat);
+        #else
+            if ((u == u_unsat) || ((u_unsat > u) == (err < 0))) { // not saturated, or error unwinds it
+                pid->integ += pid->k_i_dt*err;
+            }
+        #endif
+        if (pid->integ > pid->u_max) {
+            pid->integ = pid->u_max;
+        }
+        else if (pid->integ < -pid->u_max) {
+            pid->integ = -pid->u_max;
+        }
+        pid->u = u;
+    #endif
+    return pid->u;
+}
+
+
+static volatile bool pwm_staged = false; // staged outputs ready to commit
+
+
+static uint16_t Motor_ccr(const motor_t * motor, uint16_t on) {
+    /* Set/reset output register value for on-time at end of period: not earlier than commit latency */
+    if (!on) {
+        return MOTOR_CCR_OFF;
+    }
+    if (on > motor->period - MOTOR_CCR_MIN) {
+        return MOTOR_CCR_MIN;
+    }
+    return motor->period - on;
+}
+
+
+void Motor_setOutput(motor_t * motor, float duty, uint8_t decay) {
+    /* Stage signed duty (%) for next PWM period: 0 coasts (fast decay) or brakes (slow decay).
+       Staged outputs of all motors are committed together after Motor_releasePwm */
+    pwm_staged = false; // hold commit until all motors are staged
+
+    int8_t dir = (duty > 0.0f) - (duty < 0.0f);
+    float duty_abs = (duty < 0.0f) ? -duty : duty;
+    uint16_t on = motor->period;
+    if (duty_abs < MOTOR_DUTY_MAX) {
+        on = (uint16_t)(duty_abs*(1.0f/MOTOR_DUTY_MAX)*motor->period + 0.5f);
+    }
+
+    uint16_t active, passive; // input driven by PWM, other input
+    if (MOTOR_DECAY_SLOW == decay) { // active input high from earliest set point, other joins after on-time
+        uint16_t on_max = motor->period - MOTOR_CCR_MIN; // both inputs low before earliest set point
+        active = Motor_ccr(motor, motor->period);
+        passive = dir ? Motor_ccr(motor, (on < on_max) ? on_max - on : 0) : active; // brake when stopped
+    }
+    else { // active input high during on-time, other low
+        active = dir ? Motor_ccr(motor, on) : MOTOR_CCR_OFF; // coast when stopped
+        passive = MOTOR_CCR_OFF;
+    }
+
+    motor->pwm_next.forward = (dir < 0) ? passive : active;
+    motor->pwm_next.back = (dir < 0) ? active : passive;
+    motor->pwm_next.dir = dir;
+}
+
+
+int Motor_initPwm(motor_t * const * motors, int num_motor, uint32_t timer, uint32_t freq_pwm) {
+    /* Set PWM frequency (Hz) of motors sharing timer (SMCLK, undivided) from current clock tree.
+       Outputs are off until next staged duty; returns -1 if resolution is below MOTOR_PWM_PERIOD_MIN
+       (duty cap is at least MOTOR_DUTY_CAP_MIN from there on, checked at compile time) */
+    uint32_t period = MOTOR_PWM_PERIOD(MAP_CS_getSMCLK(), freq_pwm);
+    if ((period < MOTOR_PWM_PERIOD_MIN) || (period > MOTOR_PWM_PERIOD_MAX)) {
+        return -1;
     }
-    else if ((motor->pid_vel.err_int)*(motor->pid_vel.k_p) < -100.0) {
-        motor->pid_vel.err_int = -100.0/(motor->pid_vel.k_p);
+
+    pwm_staged = false;
+    MAP_Timer_A_setCompareValue(timer, TIMER_A_CAPTURECOMPARE_REGISTER_0, period);
+    int i;
+    for (i = 0; i < num_motor; i++) {
+        motor_t * motor = motors[i];
+        motor->period = period;
+        *(motor->reg_duty.forward) = MOTOR_CCR_OFF;
+        *(motor->reg_duty.back) = MOTOR_CCR_OFF;
+        motor->dir = 0;
+        motor->pwm_next.forward = MOTOR_CCR_OFF;
+        motor->pwm_next.back = MOTOR_CCR_OFF;
+        motor->pwm_next.dir = 0;
+    }
+    return 0;
+}
+
+
+float Motor_getResolution(const motor_t * motor) {
+    /* Duty cycle step (%) of one timer count at current PWM period */
+    return MOTOR_DUTY_MAX/motor->period;
+}
+
+
+float Motor_getDutyMax(const motor_t * motor) {
+    /* Highest duty cycle (%) output: set points are no earlier than MOTOR_CCR_MIN into the period */
+    return MOTOR_DUTY_MAX - MOTOR_CCR_MIN*Motor_getResolution(motor);
+}
+
+
+void Motor_releasePwm(void) {
+    /* Allow staged outputs to be committed at next PWM period boundary */
+    pwm_staged = true;
+}
+
+
+void Motor_commitPwm(motor_t * const * motors, int num_motor) {
+    /* PWM period boundary interrupt routine: write staged outputs of all motors.
+       Reversal holds both inputs low for one period first, other motors keep their previous output
+       so that all new outputs still take effect in the same period */
+    if (!pwm_staged) {
+        return;
+    }
+
+    bool reversing = false;
+    int i;
+    for (i = 0; i < num_motor; i++) {
+        if (motors[i]->pwm_next.dir && (motors[i]->pwm_next.dir == -motors[i]->dir)) {
+            reversing = true;
+        }
     }
+    for (i = 0; i < num_motor; i++) {
+        motor_t * motor = motors[i];
+        if (!reversing) {
+            *(motor->reg_duty.forward) = motor->pwm_next.forward;
+            *(motor->reg_duty.back) = motor->pwm_next.back;
+            motor->dir = motor->pwm_next.dir;
+        }
+        else if (motor->pwm_next.dir && (motor->pwm_next.dir == -motor->dir)) { // reversing motor: both inputs low
+            *(motor->reg_duty.forward) = MOTOR_CCR_OFF;
+            *(motor->reg_duty.back) = MOTOR_CCR_OFF;
+            motor->dir = 0;
+        }
+    }
+    pwm_staged = reversing; // commit all next period
+}
 
-    // calculate raw control
-    float u = -(motor->pid_vel.k_p)*err - (motor->pid_vel.k_i)*(motor->pid_vel.err_int)
-        - (motor->pid_vel.k_d)*err_der;
+
+void Motor_velUpdate(motor_t * motor, float vel_motor) {
+    /* Motor velocity control: run controller, compensate deadzone, set PWM duty cycle */
+    float u = Motor_calcPid(motor, vel_motor);
 
     //impose deadzone compensation
     if (u > 0) {
@@ -40,30 +274,106 @@ void Motor_velUpdate(motor_t * motor, float vel_motor, int period_motor) {
         u -= motor->deadzone;
     }
 
-    // impose saturation limits
-    if (u > 100.0) {
-        u = 100.0;
+    Motor_setOutput(motor, u, motor->decay);
+}
+
+
+void Motor_initChar(motor_char_t * ch, int count) {
+    /* Start characterization from rest at encoder count */
+    *ch = (motor_char_t){0};
+    ch->stage = MOTOR_CHAR_RAMP;
+    ch->count_start = count;
+}
+
+
+static void Motor_fitChar(motor_t * motor, motor_char_t * ch, float period) {
+    /* Fit first-order model vel[k+1] = a*vel[k] + b*u[k] to step samples, copy model to motor if stable */
+    float det = ch->sum_vv*ch->sum_uu - ch->sum_vu*ch->sum_vu;
+    if (det <= 0.0f) {
+        ch->stage = MOTOR_CHAR_FAILED;
+        return;
     }
-    else if (u < -100.0) {
-        u = -100.0;
+    float a = (ch->sum_v1v*ch->sum_uu - ch->sum_v1u*ch->sum_vu)/det;
+    float b = (ch->sum_v1u*ch->sum_vv - ch->sum_v1v*ch->sum_vu)/det;
+    if ((a <= 0.0f) || (a >= 1.0f) || (b <= 0.0f)) { // not a stable, forward-driven lag
+        ch->stage = MOTOR_CHAR_FAILED;
+        return;
     }
+    ch->gain = b/(1.0f - a);
+    ch->tau = -period/logf(a);
+    motor->deadzone = ch->deadzone; // motor model changes only on success
+    motor->gain = ch->gain;
+    motor->tau = ch->tau;
+    ch->stage = MOTOR_CHAR_DONE;
+}
 
-    // impose velocity dead-band
-    if (abs(motor->pid_vel.vel_des) < 1) {
-        u = 0;
-    }
 
-    // set duty cycle depending on motor direction
-    int duty = (int)(period_motor*(u/100.0)); // calculate motor PWM timer duty cycle
+bool Motor_updateChar(motor_t * motor, motor_char_t * ch, int count, float vel, float period) {
+    /* Characterization step, once per control period with wheel free to turn: ramp duty to find
+       breakaway (dead zone), then fit gain and time constant to two forward velocity steps.
+       Stages output like Motor_setOutput; returns 1 when finished (results in ch, copied to motor only
+       if MOTOR_CHAR_DONE) */
+    int ticks_step = (int)(MOTOR_CHAR_STEP_TIME/period);
+    float duty_max = Motor_getDutyMax(motor);
+    ch->ticks++;
 
-    if (duty >= 0) { // if duty cycle is positive, go forward
-        *(motor->reg_duty.back) = 0;  // set backward PWM signal to zero
-        *(motor->reg_duty.forward) = duty; // set forward PWM signal to duty cycle
-    }
-    else { // if duty cycle is negative, go backward
-        *(motor->reg_duty.back) = 0;  // set backward PWM signal to zero
-        *(motor->reg_duty.forward) = -duty; // set forward PWM signal to duty cycle
+    switch (ch->stage) {
+    case MOTOR_CHAR_RAMP:
+        if (abs(count - ch->count_start) >= MOTOR_CHAR_BREAK_COUNTS) {
+            ch->deadzone = ch->duty;
+            ch->step = fminf(MOTOR_CHAR_STEP, 0.5f*(duty_max - ch->duty));
+            ch->duty = 0.0f;
+            ch->stage = MOTOR_CHAR_SETTLE;
+            ch->ticks = 0;
+        }
+        else if (ch->duty >= duty_max) {
+            ch->duty = 0.0f;
+            ch->stage = MOTOR_CHAR_FAILED;
+        }
+        else {
+            ch->duty = fminf(ch->duty + MOTOR_CHAR_RAMP_RATE*period, duty_max);
+        }
+        break;
+
+    case MOTOR_CHAR_SETTLE:
+        if (ch->ticks >= ticks_step) {
+            ch->duty = ch->deadzone + ch->step;
+            ch->stage = MOTOR_CHAR_STEP1;
+            ch->ticks = 0;
+        }
+        break;
+
+    case MOTOR_CHAR_STEP1:
+    case MOTOR_CHAR_STEP2:
+        if (ch->u_prev > 0.0f) { // pair previous sample with velocity it produced
+            ch->sum_vv += ch->vel_prev*ch->vel_prev;
+            ch->sum_vu += ch->vel_prev*ch->u_prev;
+            ch->sum_uu += ch->u_prev*ch->u_prev;
+            ch->sum_v1v += vel*ch->vel_prev;
+            ch->sum_v1u += vel*ch->u_prev;
+        }
+        if (ch->ticks >= ticks_step) {
+            ch->ticks = 0;
+            if (MOTOR_CHAR_STEP1 == ch->stage) {
+                ch->duty = ch->deadzone + 2.0f*ch->step;
+                ch->stage = MOTOR_CHAR_STEP2;
+            }
+            else {
+                ch->duty = 0.0f;
+                Motor_fitChar(motor, ch, period);
+            }
+        }
+        break;
+
+    default: // finished: motor off
+        ch->duty = 0.0f;
+        break;
     }
+
+    ch->u_prev = (ch->duty > 0.0f) ? ch->duty - ch->deadzone : 0.0f;
+    ch->vel_prev = vel;
+    Motor_setOutput(motor, ch->duty, MOTOR_DECAY_FAST);
+    return (ch->stage >= MOTOR_CHAR_DONE);
 }
 
 
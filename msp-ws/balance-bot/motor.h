@@ -17,10 +17,100 @@
 #include "driverlib.h"
 //#include "init.h"
 #include "util.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 
-//* Data types */
+/* Macros */
+#define MOTOR_DUTY_MAX 100.0f           // (% duty cycle) full command
+#define MOTOR_VEL_DEADBAND 1.0f         // (deg/s) set-points smaller than this switch motor off
+#define MOTOR_VEL_FULL 2000.0f          // (deg/s) velocity at Q15 full scale
+#define MOTOR_CCR_OFF 0xFFFF            // duty register value above period: set/reset output stays low
+#define MOTOR_CYCLES_PER_COUNT 4        // MCLK cycles per PWM timer count: 48 MHz MCLK, 12 MHz SMCLK
+#define MOTOR_CYCLES_ENTRY 16           // (cycles) period boundary to first handler instruction: exception
+    // entry, vector fetch wait states, wake-up from sleep
+#define MOTOR_CYCLES_COMMIT 100         // (cycles) TA0_0_IRQHandler start to last duty register write, bound
+    // for the commit latency on the health line (which also includes entry and masking)
+#define MOTOR_CYCLES_MASKED 16          // (cycles) longest PRIMASK section (I2Cc_wait check and sleep): all
+    // other critical sections mask by priority (criticalEnter) below PRIORITY_PWM
+#define MOTOR_CCR_MIN 36                // (timer counts) earliest output set point, after worst-case commit
+#define MOTOR_PWM_PERIOD_MIN 400        // (timer counts) min PWM period: 0.25 % duty resolution
+#define MOTOR_DUTY_CAP_MIN 90           // (% duty cycle) min duty reachable before commit margin (MOTOR_CCR_MIN):
+    // 91 % at MOTOR_PWM_PERIOD_MIN, 94 % at 20 kHz (600 counts)
+#define MOTOR_PWM_PERIOD_MAX 0xFFFE     // (timer counts) max PWM period: below MOTOR_CCR_OFF
+#define MOTOR_PWM_PERIOD(freq_clk, freq_pwm) ((freq_clk)/(freq_pwm)) // (timer counts) PWM period
+
+#if MOTOR_CCR_MIN*MOTOR_CYCLES_PER_COUNT < MOTOR_CYCLES_ENTRY + MOTOR_CYCLES_COMMIT + MOTOR_CYCLES_MASKED
+#error "MOTOR_CCR_MIN does not cover commit latency: entry + commit + longest masked section"
+#endif
+#if (MOTOR_PWM_PERIOD_MIN - MOTOR_CCR_MIN)*100 < MOTOR_DUTY_CAP_MIN*MOTOR_PWM_PERIOD_MIN
+#error "MOTOR_CCR_MIN leaves duty cap below MOTOR_DUTY_CAP_MIN at MOTOR_PWM_PERIOD_MIN"
+#endif
+
+#define MOTOR_DECAY_FAST 0              // PWM off-time: both inputs low, motor coasts
+#define MOTOR_DECAY_SLOW 1              // PWM off-time: both inputs high, motor brakes
+
+#define MOTOR_AW_CLAMP 0                // anti-windup: hold integrator while output saturates further
+#define MOTOR_AW_BACKCALC 1             // anti-windup: bleed integrator by saturation excess
+#ifndef MOTOR_ANTIWINDUP
+#define MOTOR_ANTIWINDUP MOTOR_AW_CLAMP
+#endif
+
+#define MOTOR_CHAR_RAMP_RATE 5.0f       // (%/s) duty ramp while searching breakaway
+#define MOTOR_CHAR_BREAK_COUNTS 8       // encoder counts moved that mark breakaway
+#define MOTOR_CHAR_STEP 15.0f           // (% duty cycle) first velocity step above deadzone, second doubles it
+#define MOTOR_CHAR_STEP_TIME 1.0f       // (s) duration of each velocity step and of settling
+
+#define MOTOR_CHAR_RAMP 0               // characterization stage: ramp duty until wheel turns
+#define MOTOR_CHAR_SETTLE 1             // characterization stage: coast to rest
+#define MOTOR_CHAR_STEP1 2              // characterization stage: first velocity step
+#define MOTOR_CHAR_STEP2 3              // characterization stage: second velocity step
+#define MOTOR_CHAR_DONE 4               // characterization stage: model identified
+#define MOTOR_CHAR_FAILED 5             // characterization stage: no breakaway or no stable fit
+
+#ifndef MOTOR_PID_Q15
+#define MOTOR_PID_Q15 0                 // 1: run velocity controller in Q15 fixed point
+#endif
+
+
+/* Data types */
+typedef struct {
+    float k_p;      // (%/(deg/s)) proportional gain
+    float k_i;      // (%/deg) integral gain
+    float k_d;      // (%/(deg/s^2)) derivative gain, on measured velocity
+    float k_aw;     // (1/s) back-calculation anti-windup gain
+    float k_ff_vel; // (%/(deg/s)) velocity feed-forward gain
+    float k_ff_acc; // (%/(deg/s^2)) acceleration feed-forward gain
+} motor_gains_t;
+
+typedef struct {
+#if MOTOR_PID_Q15
+    int32_t k_p;        // (Q16) proportional gain, normalized to MOTOR_VEL_FULL and full duty
+    int32_t k_i_dt;     // (Q24) integral gain times period
+    int32_t k_d_dt;     // (Q16) derivative gain over period
+    int32_t k_aw_dt;    // (Q16) anti-windup gain times period
+    int32_t u_max;      // (Q15) command limit
+    int32_t integ;      // (Q30) integrator output
+    int32_t vel_prev;   // (Q15) previous measured velocity
+    int32_t vel_des;    // (Q15) velocity set-point
+    int32_t u_ff;       // (Q15) feed-forward command
+#else
+    float k_p;          // (%/(deg/s)) proportional gain
+    float k_i_dt;       // (%/(deg/s)) integral gain times period
+    float k_d_dt;       // (%/(deg/s)) derivative gain over period
+    float k_aw_dt;      // anti-windup gain times period
+    float u_max;        // (% duty cycle) command limit
+    float integ;        // (% duty cycle) integrator output
+    float vel_prev;     // (deg/s) previous measured velocity
+    float vel_des;      // (deg/s) velocity set-point
+    float u_ff;         // (% duty cycle) feed-forward command
+#endif
+    float k_ff_vel;     // (%/(deg/s)) velocity feed-forward gain
+    float k_ff_acc;     // (%/(deg/s^2)) acceleration feed-forward gain
+    uint8_t off;        // set-point inside MOTOR_VEL_DEADBAND: motor off
+    float u;            // (% duty cycle) last command, before deadzone compensation
+} motor_pid_t;
+
 typedef struct {
 //    const uint8_t pins[2]; // motor pins (0=forward, 1=backward)
 //    volatile uint16_t* reg_duty[2]; // duty cycle timer registers corresponding to pins (pointers to registers)
@@ -30,20 +120,52 @@ typedef struct {
         volatile uint16_t * back;
     } reg_duty;
 
-    const float deadzone; // (% duty cycle) motor dead zone
+    uint16_t period; // (timer counts) PWM period
+    uint8_t decay; // MOTOR_DECAY_FAST or MOTOR_DECAY_SLOW
+    int8_t dir; // driven direction (1: forward, -1: back, 0: both inputs in same state)
     struct {
-        const float k_p; // motor velocity control proportional gain
-        const float k_i; // motor velocity control integral gain
-        const float k_d; // motor velocity control derivative
-        volatile float vel_des; // motor velocity setpoint
-        volatile float err_int; // motor velocity integrated error
-        volatile float err_prev; // motor velocity previous error
-    } pid_vel;
+        volatile uint16_t forward;  // staged forward duty register value
+        volatile uint16_t back;     // staged back duty register value
+        volatile int8_t dir;        // staged direction
+    } pwm_next; // output staged for next PWM period boundary (read by commit interrupt)
+    float deadzone; // (% duty cycle) motor dead zone, independent of PWM period
+    float gain; // ((deg/s)/%) steady-state velocity per duty above dead zone, 0 if unknown
+    float tau; // (s) velocity time constant
+    motor_pid_t pid_vel; // velocity controller
 } motor_t;
 
+typedef struct {
+    uint8_t stage;          // MOTOR_CHAR_* stage
+    int ticks;              // control periods spent in stage
+    int count_start;        // encoder count at start of ramp
+    float duty;             // (% duty cycle) applied duty
+    float deadzone;         // (% duty cycle) breakaway duty found by ramp
+    float gain;             // ((deg/s)/%) fitted steady-state gain
+    float tau;              // (s) fitted time constant
+    float step;             // (% duty cycle) first step above dead zone
+    float u_prev;           // (% duty cycle) duty above dead zone applied over last period
+    float vel_prev;         // (deg/s) velocity at last period
+    float sum_vv;           // least-squares sums for vel[k+1] = a*vel[k] + b*u[k]
+    float sum_vu;
+    float sum_uu;
+    float sum_v1v;
+    float sum_v1u;
+} motor_char_t;             // motor characterization state
+
 
 /* Function prototypes */
-void Motor_velUpdate(motor_t * motor, float vel_motor, int period_motor);
+void Motor_initPid(motor_t * motor, const motor_gains_t * gains, float period);
+void Motor_setVel(motor_t * motor, float vel_des, float acc_des);
+float Motor_calcPid(motor_t * motor, float vel_motor);
+void Motor_setOutput(motor_t * motor, float duty, uint8_t decay);
+void Motor_velUpdate(motor_t * motor, float vel_motor);
+void Motor_initChar(motor_char_t * ch, int count);
+bool Motor_updateChar(motor_t * motor, motor_char_t * ch, int count, float vel, float period);
+int Motor_initPwm(motor_t * const * motors, int num_motor, uint32_t timer, uint32_t freq_pwm);
+float Motor_getResolution(const motor_t * motor);
+float Motor_getDutyMax(const motor_t * motor);
+void Motor_releasePwm(void);
+void Motor_commitPwm(motor_t * const * motors, int num_motor);
 
 
 #endif /* MOTOR_H_ */
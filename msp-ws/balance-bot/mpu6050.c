@@ -12,7 +12,7 @@
 
 /* TODO
  * pass IMU_CALC_FREQ as param?
- * implement yaw/roll
+ * implement yaw/roll in float/fixed estimators
  * imu self test
  * make local functions (within module) static
  */
@@ -21,81 +21,272 @@
 #include "mpu6050.h"
 
 
-void IMU_init(volatile imu_t * imu, int cutoff_dlpf, int range_gyro, int range_accel) {
-    /* Initialize MPU6050 IMU */
+/* Module variables */
+static imu_sample_t samples_dma[2];         // DMA sample buffers (double buffered)
+static volatile int idx_sample_dma = 0;     // buffer holding latest completed sample
+static volatile uint32_t cycles_dma = 0;    // (cycles) CPU time of latest DMA read
+static volatile bool * flag_sample_done;    // flag to set when DMA read completes
+static const uint8_t addr_sample = IMU_REG_ACCEL_XOUT1;
+static i2c_trans_t trans_sample = {         // DMA sample read transaction
+    .addr_slave = IMU_ADDR,
+    .data_tx = &addr_sample,
+    .num_tx = 1,
+    .num_rx = IMU_NUM_SAMPLE_BYTES,
+    .flag_dma = 1,
+};
+
+
+static const imu_dlpf_cfg_t cfg_dlpf[] = { // DLPF settings (MPU-6050 register map, CONFIG)
+    // cutoff, reg,  delay_accel, delay_gyro
+    {260,     0x00, 0.0000f,     0.00098f},
+    {184,     0x01, 0.0020f,     0.0019f},
+    {94,      0x02, 0.0030f,     0.0028f},
+    {44,      0x03, 0.0049f,     0.0048f},
+    {21,      0x04, 0.0085f,     0.0083f},
+    {10,      0x05, 0.0138f,     0.0134f},
+    {5,       0x06, 0.0190f,     0.0186f},
+};
+
+static const imu_range_cfg_t cfg_gyro[] = { // gyro full-scale ranges (GYRO_CONFIG)
+    {250,  0x00, IMU_GYRO_SENS_250},
+    {500,  0x08, IMU_GYRO_SENS_500},
+    {1000, 0x10, IMU_GYRO_SENS_1000},
+    {2000, 0x18, IMU_GYRO_SENS_2000},
+};
+
+static const imu_range_cfg_t cfg_accel[] = { // accelerometer full-scale ranges (ACCEL_CONFIG)
+    {2,  0x00, IMU_ACCEL_SENS_2},
+    {4,  0x08, IMU_ACCEL_SENS_4},
+    {8,  0x10, IMU_ACCEL_SENS_8},
+    {16, 0x18, IMU_ACCEL_SENS_16},
+};
+
+
+static const imu_dlpf_cfg_t * IMU_findDlpf(int cutoff) {
+    /* Look up DLPF cutoff in configuration table: returns 0 if unsupported */
+    int i;
+    for (i = 0; i < (int)(sizeof(cfg_dlpf)/sizeof(cfg_dlpf[0])); i++) {
+        if (cfg_dlpf[i].cutoff == cutoff) {
+            return &cfg_dlpf[i];
+        }
+    }
+    return 0;
+}
+
+
+static const imu_range_cfg_t * IMU_findRange(const imu_range_cfg_t * table, int len, int range) {
+    /* Look up full-scale range in configuration table: returns 0 if unsupported */
+    int i;
+    for (i = 0; i < len; i++) {
+        if (table[i].range == range) {
+            return &table[i];
+        }
+    }
+    return 0;
+}
+
+
+static int IMU_writeVerify(uint8_t addr_reg, uint8_t value) {
+    /* Write register and read it back: returns -1 on bus error or mismatch */
+    uint8_t readback;
+    if (I2Cc_write(IMU_ADDR, addr_reg, value) || I2Cc_read(IMU_ADDR, addr_reg, &readback)) {
+        return -1;
+    }
+    return (readback == value) ? 0 : -1;
+}
+
+
+int IMU_init(volatile imu_t * imu, int cutoff_dlpf, int range_gyro, int range_accel) {
+    /* Initialize MPU6050 IMU: returns -1 if a setting is unsupported or not confirmed by the IMU */
+    const imu_dlpf_cfg_t * dlpf = IMU_findDlpf(cutoff_dlpf);
+    const imu_range_cfg_t * gyro = IMU_findRange(cfg_gyro,
+        sizeof(cfg_gyro)/sizeof(cfg_gyro[0]), range_gyro);
+    const imu_range_cfg_t * accel = IMU_findRange(cfg_accel,
+        sizeof(cfg_accel)/sizeof(cfg_accel[0]), range_accel);
+    if (!dlpf || !gyro || !accel) {
+        return -1;
+    }
+
+    uint8_t who_am_i;
+    if (I2Cc_read(IMU_ADDR, IMU_REG_WHO_AM_I, &who_am_i) || (who_am_i != IMU_WHO_AM_I)) {
+        return -1;
+    }
+
     I2Cc_write(IMU_ADDR, IMU_REG_PWR_MGMT1, 0x03); // disable sleep,
         // set clock source to z-axis gyroscope reference
+    if (IMU_writeVerify(IMU_REG_CONFIG, dlpf->reg)
+        || IMU_writeVerify(IMU_REG_GYRO_CONFIG, gyro->reg)
+        || IMU_writeVerify(IMU_REG_ACCEL_CONFIG, accel->reg)) {
+        return -1;
+    }
+
+    imu->sens.gyro = gyro->sens;
+    imu->sens.accel = accel->sens;
+    imu->dlpf.delay_accel = dlpf->delay_accel;
+    imu->dlpf.delay_gyro = dlpf->delay_gyro;
+
+    // no accelerometer correction until calibrated
+    const float bias[3] = {0,0,0};
+    const float mat[3][3] = {{1,0,0}, {0,1,0}, {0,0,1}};
+    IMU_setAccelCal(imu, bias, mat);
+    return 0;
+}
+
 
-    // set DLPF cutoff (0x00=260, 0x01=184, 0x02=94, 0x03=44, 0x04=21, 0x05=10, 0x06=5)
-    uint8_t reg_dlpf;
-    switch (cutoff_dlpf) {
-        case 260:
-            reg_dlpf = 0x00;
-        case 184:
-            reg_dlpf = 0x01;
-        case 94:
-            reg_dlpf = 0x02;
-        case 44:
-            reg_dlpf = 0x03;
-        case 21:
-            reg_dlpf = 0x04;
-        case 10:
-            reg_dlpf = 0x05;
-        case 5:
-            reg_dlpf = 0x06;
-    }
-    I2Cc_write(IMU_ADDR, IMU_REG_CONFIG, reg_dlpf);
-
-    // set full-scale range of gyro (0x00=250, 0x08=500, 0x10=1000, 0x18=2000)
-    uint8_t reg_gyro;
-    switch (range_gyro) {
-        case 250:
-            reg_gyro = 0x00;
-            imu->sens.gyro = IMU_GYRO_SENS_250;
-        case 500:
-            reg_gyro = 0x08;
-            imu->sens.gyro = IMU_GYRO_SENS_500;
-        case 1000:
-            reg_gyro = 0x10;
-            imu->sens.gyro = IMU_GYRO_SENS_1000;
-        case 2000:
-            reg_gyro = 0x18;
-            imu->sens.gyro = IMU_GYRO_SENS_2000;
-    }
-    I2Cc_write(IMU_ADDR, IMU_REG_GYRO_CONFIG, reg_gyro);
-
-    // set full scale range of accelerometer (0x00=2, 0x08=4, 0x10=8, 0x18=16)
-    uint8_t reg_accel;
-    switch (range_accel) {
-        case 2:
-            reg_accel = 0x00;
-            imu->sens.accel = IMU_ACCEL_SENS_2;
-        case 4:
-            reg_accel = 0x08;
-            imu->sens.accel = IMU_ACCEL_SENS_4;
-        case 8:
-            reg_accel = 0x10;
-            imu->sens.accel = IMU_ACCEL_SENS_8;
-        case 16:
-            reg_accel = 0x18;
-            imu->sens.accel = IMU_ACCEL_SENS_16;
-    }
-    I2Cc_write(IMU_ADDR, IMU_REG_ACCEL_CONFIG, reg_accel);
+void IMU_initDataReady(int div_sample) {
+    /* Pulse INT pin when a new sample is ready: sample rate = 1 kHz/(1 + div_sample) with DLPF enabled */
+    I2Cc_write(IMU_ADDR, IMU_REG_SMPLRT_DIV, div_sample);
+    I2Cc_write(IMU_ADDR, IMU_REG_INT_PIN_CFG, IMU_INT_RD_CLEAR);
+    I2Cc_write(IMU_ADDR, IMU_REG_INT_ENABLE, IMU_INT_DATA_RDY);
 }
 
 
 void IMU_readVals(volatile imu_t * imu) {
     /* Read angular velocities and accelerations from IMU */
-    int16_t counts_accel[3], counts_gyro[3]; // initialize data arrays
-    I2Cc_burstRead2(IMU_ADDR, IMU_REG_GRYO_XOUT1, 6, counts_gyro); // read gyro counts
-    I2Cc_burstRead2(IMU_ADDR, IMU_REG_ACCEL_XOUT1, 6, counts_accel); // read acceleration counts
+    imu_sample_t sample;
+    IMU_readSampleTimed(imu, &sample);
+    IMU_procSample(imu, &sample);
+}
+
+
+void IMU_readSample(imu_sample_t * sample) {
+    /* Read accel, temp, gyro counts in one transaction so all axes come from the same sample instant */
+    I2Cc_burstRead2(IMU_ADDR, IMU_REG_ACCEL_XOUT1, IMU_NUM_SAMPLE_BYTES, (int16_t *)sample);
+}
+
+
+void IMU_readSampleTimed(volatile imu_t * imu, imu_sample_t * sample) {
+    /* Blocking sample read, CPU time kept for comparison with background reads */
+    uint32_t cycles_start = CYCLE_COUNT();
+    IMU_readSample(sample);
+    imu->cycles.read_blocking = CYCLE_COUNT() - cycles_start;
+}
 
+
+void IMU_procSample(volatile imu_t * imu, const imu_sample_t * sample) {
+    /* Convert raw sample counts to physical units */
     int axis;
+    float accel[3];
+    imu->raw.temp = (float)sample->temp/IMU_TEMP_SENS + IMU_TEMP_OFFSET; // (degC)
+    float temp_rel = imu->raw.temp - IMU_TEMP_REF;
     for (axis = 0; axis < 3; axis++) {
-        imu->raw.ang_vel[axis] = (float)counts_gyro[axis]/imu->sens.gyro
-            - imu->cal.ang_vel_offset[axis]; // (deg/sec) corrected for steady-state gyro offset
-        imu->raw.accel[axis] = (float)counts_accel[axis]/imu->sens.accel; // (g)
+        float offset = imu->cal.ang_vel_offset[axis] + temp_rel*(imu->cal.ang_vel_temp_coef[axis][0]
+            + temp_rel*imu->cal.ang_vel_temp_coef[axis][1]); // (deg/s) gyro offset at current temperature
+        imu->raw.ang_vel[axis] = (float)sample->gyro[axis]/imu->sens.gyro - offset; // (deg/sec)
+        accel[axis] = (float)sample->accel[axis] - imu->cal.accel_offset[axis]; // (counts)
+    }
+    for (axis = 0; axis < 3; axis++) { // (g) corrected for bias, scale, misalignment
+        imu->raw.accel[axis] = imu->cal.accel_gain[axis][0]*accel[0]
+            + imu->cal.accel_gain[axis][1]*accel[1] + imu->cal.accel_gain[axis][2]*accel[2];
+    }
+    imu->sample = *sample;
+}
+
+
+void IMU_takeSample(volatile imu_t * imu, const imu_sample_t * sample) {
+    /* Hand sample to selected estimator: fixed-point estimator converts counts itself */
+    #if IMU_ESTIMATOR == IMU_EST_FIXED
+        imu->sample = *sample;
+    #else
+        IMU_procSample(imu, sample);
+    #endif
+}
+
+
+static void IMU_readDmaCallback(i2c_trans_t * trans) {
+    /* Publish completed DMA sample (runs in I2C interrupt) */
+    if (trans->status != I2CC_STATUS_DONE) {
+        return; // keep previous sample
+    }
+    idx_sample_dma = (trans->data_rx == (uint8_t *)&samples_dma[0]) ? 0 : 1;
+    cycles_dma = trans->cycles;
+    *flag_sample_done = 1;
+}
+
+
+int IMU_startReadDma(volatile bool * flag_done) {
+    /* Start sample read received by DMA, flag is set on completion: returns -1 if previous read is busy */
+    if ((trans_sample.status == I2CC_STATUS_QUEUED) || (trans_sample.status == I2CC_STATUS_BUSY)) {
+        return -1;
+    }
+    flag_sample_done = flag_done;
+    trans_sample.data_rx = (uint8_t *)&samples_dma[idx_sample_dma ^ 1]; // fill buffer not being read
+    trans_sample.callback = IMU_readDmaCallback;
+    return I2Cc_submit(&trans_sample);
+}
+
+
+void IMU_finishReadDma(volatile imu_t * imu) {
+    /* Convert latest sample received by DMA */
+    imu_sample_t sample;
+    uint32_t basepri = criticalEnter(); // keep callback (I2C interrupt) from switching buffers during copy
+    sample = samples_dma[idx_sample_dma];
+    imu->cycles.read_dma = cycles_dma;
+    criticalExit(basepri);
+    I2Cc_swapBytes2((int16_t *)&sample, IMU_NUM_SAMPLE_BYTES/2);
+    IMU_takeSample(imu, &sample);
+}
+
+
+static void IMU_resetFifo(void) {
+    /* Clear IMU FIFO and restart queueing samples */
+    I2Cc_write(IMU_ADDR, IMU_REG_USER_CTRL, IMU_USER_FIFO_RESET); // reset requires FIFO disabled
+    I2Cc_write(IMU_ADDR, IMU_REG_USER_CTRL, IMU_USER_FIFO_EN);
+}
+
+
+void IMU_initFifo(int div_sample) {
+    /* Queue accel, temp, gyro samples in IMU FIFO at 1 kHz/(1 + div_sample) with DLPF enabled */
+    I2Cc_write(IMU_ADDR, IMU_REG_SMPLRT_DIV, div_sample);
+    I2Cc_write(IMU_ADDR, IMU_REG_FIFO_EN, IMU_FIFO_EN_SAMPLE); // same layout as imu_sample_t
+    uint8_t int_enable = 0;
+    I2Cc_read(IMU_ADDR, IMU_REG_INT_ENABLE, &int_enable);
+    I2Cc_write(IMU_ADDR, IMU_REG_INT_ENABLE, int_enable | IMU_INT_FIFO_OFLOW); // flag overflow in INT_STATUS
+    IMU_resetFifo();
+}
+
+
+int IMU_readFifo(volatile imu_t * imu, imu_sample_t * samples, int max_samples) {
+    /* Drain up to max_samples from IMU FIFO in one transaction: returns number of samples read */
+    uint8_t int_status = 0;
+    I2Cc_read(IMU_ADDR, IMU_REG_INT_STATUS, &int_status); // read clears flags
+    if (int_status & IMU_INT_FIFO_OFLOW) { // oldest bytes dropped, samples misaligned
+        IMU_resetFifo();
+        imu->fifo.overflows++;
+        return 0;
+    }
+
+    int16_t count; // (bytes) FIFO fill level
+    I2Cc_burstRead2(IMU_ADDR, IMU_REG_FIFO_COUNTH, 2, &count);
+    if (count % IMU_NUM_SAMPLE_BYTES != 0) { // partial sample: realign
+        IMU_resetFifo();
+        imu->fifo.misaligned++;
+        return 0;
+    }
+
+    int num_samples = count/IMU_NUM_SAMPLE_BYTES;
+    if (num_samples > max_samples) {
+        num_samples = max_samples; // rest is drained next time
+    }
+    if (num_samples > 0) {
+        I2Cc_burstRead2(IMU_ADDR, IMU_REG_FIFO_R_W, num_samples*IMU_NUM_SAMPLE_BYTES,
+            (int16_t *)samples);
     }
+    return num_samples;
+}
+
+
+int IMU_updateFifo(volatile imu_t * imu, float period_sample) {
+    /* Run every queued FIFO sample through sensor fusion: returns number of samples */
+    imu_sample_t samples[IMU_FIFO_MAX_SAMPLES];
+    int num_samples = IMU_readFifo(imu, samples, IMU_FIFO_MAX_SAMPLES);
+
+    int i;
+    for (i = 0; i < num_samples; i++) {
+        IMU_takeSample(imu, &samples[i]);
+        IMU_calcAngleFused(imu, period_sample);
+    }
+    return num_samples;
 }
 
 
@@ -106,7 +297,7 @@ void IMU_calcAngleGyro(volatile float * ang_vel, volatile float * angle, float t
     int axis;
     for (axis = 0; axis < 3; axis++) {
         if (ang_vel[axis] >= IMU_GYRO_THRESHOLD || ang_vel[axis] <= -IMU_GYRO_THRESHOLD) { // check gyro angular velocity threshold
-            angle[axis] = angle[axis] + ((ang_vel[axis] + ang_vel_prev[axis])/2.0)*t_integ; // integrate angular velocity
+            angle[axis] = angle[axis] + ((ang_vel[axis] + ang_vel_prev[axis])/2.0f)*t_integ; // integrate angular velocity
         }
         ang_vel_prev[axis] = ang_vel[axis]; // set current ang vel as previous
     }
@@ -115,33 +306,165 @@ void IMU_calcAngleGyro(volatile float * ang_vel, volatile float * angle, float t
 
 void IMU_calcAngleAccel(volatile float * accel, volatile float * angle) {
     /* Calculate pitch, yaw from accelerometer data */
-    angle[0] = -atan2(accel[2], (accel[1]/fabs(accel[1]))*sqrt(pow(accel[0],2)
-        + pow(accel[1],2)))*(180.0/PI); // pitch about x-axis //TODO: check this formula
-    angle[2] = -atan2(-accel[0], accel[1])*(180.0/PI); // roll about z-axis
+    float accel_x = accel[0];
+    float accel_y = accel[1];
+    float norm_xy = FMath_sqrtf(accel_x*accel_x + accel_y*accel_y);
+    if (accel_y < 0.0f) { // sign of y selects upright/inverted branch
+        norm_xy = -norm_xy;
+    }
+    angle[0] = -FMath_atan2f(accel[2], norm_xy)*FMATH_RAD_TO_DEG; // pitch about x-axis //TODO: check this formula
+    angle[2] = -FMath_atan2f(-accel_x, accel_y)*FMATH_RAD_TO_DEG; // roll about z-axis
 }
 
 
-void IMU_calcAngleFused(volatile imu_t * imu, float period_sense) {
-    /* Calculate orientation based on IMU data */
+#if IMU_ESTIMATOR == IMU_EST_FIXED
+static void IMU_setOffsetFixed(imu_fixed_t * est, volatile imu_t * imu, int16_t counts_temp) {
+    /* Fold gyro offset model at sample temperature into fixed-point offsets */
+    float offset[3];
+    float temp_rel = (float)counts_temp/IMU_TEMP_SENS + IMU_TEMP_OFFSET - IMU_TEMP_REF;
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        offset[axis] = imu->cal.ang_vel_offset[axis] + temp_rel*(imu->cal.ang_vel_temp_coef[axis][0]
+            + temp_rel*imu->cal.ang_vel_temp_coef[axis][1]); // (deg/s) gyro offset at sample temperature
+    }
+    IMUfix_setOffset(est, imu->sens.gyro, offset);
+}
+
+
+static void IMU_calcAngleFusedFixed(volatile imu_t * imu, float period_sense) {
+    /* Calculate orientation with fixed-point estimator from raw counts, export results as floats */
+    static imu_fixed_t est;
+    static float period_est = 0.0f;
+    static int windows_est = 0;     // calibration windows folded into offsets
+    static int16_t temp_est = 0;    // (counts) temperature folded into offsets
+    static float gain_accel = 0.0f; // (g/count) for exported acceleration
+    int axis;
+
+    imu_sample_t sample = imu->sample;
+    if (period_sense != period_est) { // first call or new sample period: start from current angles
+        float angle[3], offset_accel[3], mat_accel[3][3];
+        const float offset_gyro[3] = {0,0,0}; // set from temperature model below
+        for (axis = 0; axis < 3; axis++) {
+            angle[axis] = imu->angle.gyro[axis];
+            offset_accel[axis] = imu->cal.accel_offset[axis];
+            mat_accel[axis][0] = imu->cal.accel_mat[axis][0];
+            mat_accel[axis][1] = imu->cal.accel_mat[axis][1];
+            mat_accel[axis][2] = imu->cal.accel_mat[axis][2];
+        }
+        IMUfix_init(&est, imu->sens.gyro, offset_gyro, angle, period_sense);
+        IMUfix_setAccelCal(&est, offset_accel, mat_accel);
+        IMU_setOffsetFixed(&est, imu, sample.temp);
+        gain_accel = 1.0f/imu->sens.accel;
+        period_est = period_sense;
+        windows_est = imu->cal.windows;
+        temp_est = sample.temp;
+    }
+    else if ((imu->cal.windows != windows_est) // background calibration moved offsets
+        || (sample.temp - temp_est >= IMU_FIX_TEMP_STEP) || (temp_est - sample.temp >= IMU_FIX_TEMP_STEP)) {
+        IMU_setOffsetFixed(&est, imu, sample.temp);
+        windows_est = imu->cal.windows;
+        temp_est = sample.temp;
+    }
+
+    IMUfix_update(&est, sample.accel, sample.gyro);
+
+    for (axis = 0; axis < 3; axis++) {
+        imu->raw.ang_vel[axis] = IMUFIX_TO_FLOAT(est.ang_vel[axis]); // for background calibration
+        imu->raw.accel[axis] = (float)est.accel[axis]*gain_accel;
+        imu->angle.gyro[axis] = IMUFIX_TO_FLOAT(est.angle_gyro[axis]);
+        imu->angle.accel[axis] = IMUFIX_TO_FLOAT(est.angle_accel[axis]);
+    }
+    imu->raw.temp = (float)sample.temp/IMU_TEMP_SENS + IMU_TEMP_OFFSET;
+    imu->angle.fused[0][1] = imu->angle.fused[0][0];
+    imu->angle.fused[0][0] = IMUFIX_TO_FLOAT(est.angle_fused[0]);
+    imu->ang_vel.fused[0] = IMUFIX_TO_FLOAT(est.ang_vel_fused);
+}
+#endif
+
+
+#if IMU_ESTIMATOR == IMU_EST_AHRS
+static void IMU_calcAngleFusedAhrs(volatile imu_t * imu, float period_sense) {
+    /* Calculate pitch, roll and yaw rate with quaternion estimator */
+    static imu_ahrs_t est;
+    static bool est_init = 0;
+    int axis;
+
+    if (!est_init) { // first call: start from calibrated angles
+        IMUahrs_init(&est, imu->angle.gyro[0], imu->angle.gyro[2]);
+        est_init = 1;
+    }
+
+    IMUahrs_update(&est, imu->raw.ang_vel, imu->raw.accel, period_sense);
+    IMU_calcAngleAccel(imu->raw.accel, imu->angle.accel); // for telemetry only
+
+    float angle[3] = {0,0,0};
+    IMU_calcAngleAccel(est.up, angle); // same formulas on estimated gravity direction
+    for (axis = 0; axis < 3; axis += 2) {
+        imu->angle.fused[axis][1] = imu->angle.fused[axis][0];
+        imu->angle.fused[axis][0] = angle[axis];
+    }
+    imu->ang_vel.fused[0] = (imu->angle.fused[0][0] - imu->angle.fused[0][1])/period_sense;
+    imu->ang_vel.fused[1] = est.yaw_rate;
+}
+#endif
+
+
+#if IMU_ESTIMATOR == IMU_EST_KALMAN
+static void IMU_calcAngleFusedKalman(volatile imu_t * imu, float period_sense) {
+    /* Calculate pitch with Kalman filter, gyro bias is estimated online */
+    static imu_kalman_t est;
+
+    IMU_calcAngleAccel(imu->raw.accel, imu->angle.accel);
+    if (period_sense != est.period) { // first call or new sample period: start from accel pitch
+        IMUkal_init(&est, imu->angle.accel[0], period_sense);
+    }
+    IMUkal_update(&est, imu->raw.ang_vel[0], imu->angle.accel[0]);
+
+    imu->angle.fused[0][1] = imu->angle.fused[0][0];
+    imu->angle.fused[0][0] = est.angle;
+    imu->ang_vel.fused[0] = est.rate;
+}
+#endif
+
+
+void IMU_calcAngleFusedFloat(volatile imu_t * imu, float period_sense) {
+    /* Calculate orientation based on IMU data (float complementary filter, reference for other estimators) */
     //TODO: implement yaw, roll later if necessary
 
     IMU_calcAngleGyro(imu->raw.ang_vel, imu->angle.gyro, period_sense); // calculate angles from gyro data
     IMU_calcAngleAccel(imu->raw.accel, imu->angle.accel);       // calculate angles from acceleration data
 
     // correct drift of gyro
-    imu->angle.gyro[0] = 0.9996*imu->angle.gyro[0] + 0.0004*imu->angle.accel[0]; //TODO: configure fusion coefficients
+    imu->angle.gyro[0] = 0.9996f*imu->angle.gyro[0] + 0.0004f*imu->angle.accel[0]; //TODO: configure fusion coefficients
 
     // shift angular velocity history
     imu->angle.fused[0][1] = imu->angle.fused[0][0];
 
     // combine gyro and accelerometer data
-    imu->angle.fused[0][0] = 0.90*imu->angle.gyro[0] + 0.10*imu->angle.accel[0]; // calculate complementary filtered pitch
+    imu->angle.fused[0][0] = 0.90f*imu->angle.gyro[0] + 0.10f*imu->angle.accel[0]; // calculate complementary filtered pitch
 
     // calculate angular velocity
     imu->ang_vel.fused[0] = (imu->angle.fused[0][0] - imu->angle.fused[0][1])/period_sense;
 }
 
 
+void IMU_calcAngleFused(volatile imu_t * imu, float period_sense) {
+    /* Calculate orientation with selected estimator */
+    uint32_t cycles_start = CYCLE_COUNT();
+    #if IMU_ESTIMATOR == IMU_EST_FIXED
+        IMU_calcAngleFusedFixed(imu, period_sense);
+    #elif IMU_ESTIMATOR == IMU_EST_AHRS
+        IMU_calcAngleFusedAhrs(imu, period_sense);
+    #elif IMU_ESTIMATOR == IMU_EST_KALMAN
+        IMU_calcAngleFusedKalman(imu, period_sense);
+    #else
+        IMU_calcAngleFusedFloat(imu, period_sense);
+    #endif
+    imu->cycles.estimate = CYCLE_COUNT() - cycles_start;
+    IMU_updateCal(imu); // after estimator: fixed-point estimator produces the calibrated rates
+}
+
+
 void IMU_calibrate(volatile imu_t * imu, const int n_cycles, const int delay) {
     /* Initialize gyro values based on accelerometer values: must be stationary */
     int axis;
@@ -182,3 +505,248 @@ void IMU_calibrate(volatile imu_t * imu, const int n_cycles, const int delay) {
     imu->angle.gyro[2] = angles[2]; // set gyro roll based on accelerometer
 }
 
+
+static bool IMU_invert3(const float a[3][3], float inv[3][3]) {
+    /* Invert 3x3 matrix by cofactors: returns 0 if singular */
+    inv[0][0] = a[1][1]*a[2][2] - a[1][2]*a[2][1];
+    inv[0][1] = a[0][2]*a[2][1] - a[0][1]*a[2][2];
+    inv[0][2] = a[0][1]*a[1][2] - a[0][2]*a[1][1];
+    inv[1][0] = a[1][2]*a[2][0] - a[1][0]*a[2][2];
+    inv[1][1] = a[0][0]*a[2][2] - a[0][2]*a[2][0];
+    inv[1][2] = a[0][2]*a[1][0] - a[0][0]*a[1][2];
+    inv[2][0] = a[1][0]*a[2][1] - a[1][1]*a[2][0];
+    inv[2][1] = a[0][1]*a[2][0] - a[0][0]*a[2][1];
+    inv[2][2] = a[0][0]*a[1][1] - a[0][1]*a[1][0];
+    float det = a[0][0]*inv[0][0] + a[0][1]*inv[1][0] + a[0][2]*inv[2][0];
+    if ((det < 1e-6f) && (det > -1e-6f)) {
+        return 0;
+    }
+    int i, j;
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            inv[i][j] /= det;
+        }
+    }
+    return 1;
+}
+
+
+static void IMU_resetCalWindow(volatile imu_t * imu) {
+    /* Clear stationarity window sums */
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        imu->cal.ang_vel_sum[axis] = 0.0f;
+        imu->cal.ang_vel_sq_sum[axis] = 0.0f;
+        imu->cal.accel_sum[axis] = 0.0f;
+        imu->cal.accel_sq_sum[axis] = 0.0f;
+    }
+    imu->cal.temp_sum = 0.0f;
+    imu->cal.count = 0;
+}
+
+
+static void IMU_updateTempFit(volatile imu_t * imu, float temp, const float * offset) {
+    /* Add stationary window gyro offset (deg/s) at temp (degC) to quadratic offset model, refit */
+    float x = temp - IMU_TEMP_REF;
+    float x_pow = 1.0f;
+    int axis, i, j;
+    for (i = 0; i < 5; i++) {
+        imu->temp_fit.x_pow_sum[i] += x_pow;
+        if (i < 3) {
+            for (axis = 0; axis < 3; axis++) {
+                imu->temp_fit.y_sum[axis][i] += offset[axis]*x_pow;
+            }
+        }
+        x_pow *= x;
+    }
+    if (imu->temp_fit.x_pow_sum[0] <= 1.0f) { // first window
+        imu->temp_fit.temp_min = temp;
+        imu->temp_fit.temp_max = temp;
+    }
+    if (temp < imu->temp_fit.temp_min) {
+        imu->temp_fit.temp_min = temp;
+    }
+    if (temp > imu->temp_fit.temp_max) {
+        imu->temp_fit.temp_max = temp;
+    }
+    if (imu->temp_fit.temp_max - imu->temp_fit.temp_min < IMU_TEMP_FIT_SPAN) {
+        return; // not enough temperature range to separate slope from offset
+    }
+
+    // least squares: solve normal equations for offset, slope, curvature
+    float normal[3][3], normal_inv[3][3];
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) {
+            normal[i][j] = imu->temp_fit.x_pow_sum[i + j];
+        }
+    }
+    if (!IMU_invert3(normal, normal_inv)) {
+        return;
+    }
+    for (axis = 0; axis < 3; axis++) {
+        float coef[3];
+        for (i = 0; i < 3; i++) {
+            coef[i] = normal_inv[i][0]*imu->temp_fit.y_sum[axis][0]
+                + normal_inv[i][1]*imu->temp_fit.y_sum[axis][1]
+                + normal_inv[i][2]*imu->temp_fit.y_sum[axis][2];
+        }
+        imu->cal.ang_vel_offset[axis] = coef[0];
+        imu->cal.ang_vel_temp_coef[axis][0] = coef[1];
+        imu->cal.ang_vel_temp_coef[axis][1] = coef[2];
+    }
+    imu->temp_fit.valid = 1;
+}
+
+
+void IMU_initCal(volatile imu_t * imu) {
+    /* Start background calibration: set gyro angles from latest sample's accelerometer values */
+    int axis, i;
+    for (axis = 0; axis < 3; axis++) {
+        imu->cal.ang_vel_offset[axis] = 0.0f;
+        imu->cal.ang_vel_temp_coef[axis][0] = 0.0f;
+        imu->cal.ang_vel_temp_coef[axis][1] = 0.0f;
+        for (i = 0; i < 3; i++) {
+            imu->temp_fit.y_sum[axis][i] = 0.0f;
+        }
+    }
+    for (i = 0; i < 5; i++) {
+        imu->temp_fit.x_pow_sum[i] = 0.0f;
+    }
+    imu->temp_fit.valid = 0;
+    imu->cal.windows = 0;
+    imu->cal.converged = 0;
+    IMU_resetCalWindow(imu);
+
+    float angles[3];
+    IMU_calcAngleAccel(imu->raw.accel, angles);
+    imu->angle.gyro[0] = angles[0]; // set gyro pitch based on accelerometer
+    imu->angle.gyro[1] = 0.0f; // don't know this
+    imu->angle.gyro[2] = angles[2]; // set gyro roll based on accelerometer
+}
+
+
+void IMU_setCal(volatile imu_t * imu, const float * ang_vel_offset, const float temp_coef[3][2]) {
+    /* Set stored gyro offset model as converged, background calibration keeps tracking drift */
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        imu->cal.ang_vel_offset[axis] = ang_vel_offset[axis];
+        imu->cal.ang_vel_temp_coef[axis][0] = temp_coef[axis][0];
+        imu->cal.ang_vel_temp_coef[axis][1] = temp_coef[axis][1];
+    }
+    imu->cal.windows = IMU_CAL_WINDOWS_CONVERGE;
+    imu->cal.converged = 1;
+}
+
+
+void IMU_updateCal(volatile imu_t * imu) {
+    /* Add latest sample to stationarity window, update gyro offsets at end of a stationary window */
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        float ang_vel = imu->raw.ang_vel[axis];
+        float accel = imu->raw.accel[axis];
+        imu->cal.ang_vel_sum[axis] += ang_vel;
+        imu->cal.ang_vel_sq_sum[axis] += ang_vel*ang_vel;
+        imu->cal.accel_sum[axis] += accel;
+        imu->cal.accel_sq_sum[axis] += accel*accel;
+    }
+    imu->cal.temp_sum += imu->raw.temp;
+    imu->cal.count++;
+    if (imu->cal.count < IMU_CAL_WINDOW) {
+        return;
+    }
+
+    // check variance of every axis over window
+    const float inv_count = 1.0f/(float)IMU_CAL_WINDOW;
+    float residual[3]; // (deg/s) mean angular velocity left after offset correction
+    bool stationary = 1;
+    for (axis = 0; axis < 3; axis++) {
+        residual[axis] = imu->cal.ang_vel_sum[axis]*inv_count;
+        float var_gyro = imu->cal.ang_vel_sq_sum[axis]*inv_count - residual[axis]*residual[axis];
+        float accel_mean = imu->cal.accel_sum[axis]*inv_count;
+        float var_accel = imu->cal.accel_sq_sum[axis]*inv_count - accel_mean*accel_mean;
+        if ((var_gyro > IMU_CAL_VAR_GYRO) || (var_accel > IMU_CAL_VAR_ACCEL)) {
+            stationary = 0;
+        }
+        if (imu->cal.converged && ((residual[axis] > IMU_CAL_MAX_RESIDUAL)
+            || (residual[axis] < -IMU_CAL_MAX_RESIDUAL))) {
+            stationary = 0; // steady rotation, not offset drift
+        }
+    }
+    float temp = imu->cal.temp_sum*inv_count; // (degC) mean window temperature
+    IMU_resetCalWindow(imu);
+    if (!stationary) {
+        return;
+    }
+
+    // total gyro offset at mean window temperature: offset model at that temperature plus residual
+    float offset[3];
+    float temp_rel = temp - IMU_TEMP_REF;
+    for (axis = 0; axis < 3; axis++) {
+        offset[axis] = imu->cal.ang_vel_offset[axis] + residual[axis]
+            + temp_rel*(imu->cal.ang_vel_temp_coef[axis][0] + temp_rel*imu->cal.ang_vel_temp_coef[axis][1]);
+    }
+
+    // running average until converged, then slow tracking
+    float k = imu->cal.converged ? IMU_CAL_K_TRACK : 1.0f/(float)(imu->cal.windows + 1);
+    for (axis = 0; axis < 3; axis++) {
+        imu->cal.ang_vel_offset[axis] += k*residual[axis];
+    }
+    imu->cal.windows++;
+    if (imu->cal.windows >= IMU_CAL_WINDOWS_CONVERGE) {
+        imu->cal.converged = 1;
+    }
+    IMU_updateTempFit(imu, temp, offset);
+}
+
+
+void IMU_setAccelCal(volatile imu_t * imu, const float * bias, const float mat[3][3]) {
+    /* Set accelerometer bias (g) and correction matrix, precompute count-domain values */
+    int i, j;
+    for (i = 0; i < 3; i++) {
+        imu->cal.accel_bias[i] = bias[i];
+        imu->cal.accel_offset[i] = bias[i]*imu->sens.accel;
+        for (j = 0; j < 3; j++) {
+            imu->cal.accel_mat[i][j] = mat[i][j];
+            imu->cal.accel_gain[i][j] = mat[i][j]/imu->sens.accel;
+        }
+    }
+}
+
+
+void IMU_measureAccelPose(volatile imu_t * imu, float * accel, int n_samples) {
+    /* Average uncorrected acceleration (g) over n_samples: must be stationary */
+    float accel_sum[3] = {0,0,0};
+    int axis;
+    int idx_sample;
+    for (idx_sample = 0; idx_sample < n_samples; idx_sample++) {
+        IMU_readVals(imu);
+        for (axis = 0; axis < 3; axis++) {
+            accel_sum[axis] += (float)imu->sample.accel[axis];
+        }
+    }
+    for (axis = 0; axis < 3; axis++) {
+        accel[axis] = accel_sum[axis]/((float)n_samples*imu->sens.accel);
+    }
+}
+
+
+bool IMU_calibrateAccel(volatile imu_t * imu, const float poses[IMU_CAL_ACCEL_POSES][3]) {
+    /* Fit bias and correction matrix from mean acceleration (g) in six poses (+x, -x, +y, -y, +z, -z up) */
+    // model: measured = A*gravity + bias, so pose pair difference gives a column of A
+    float a[3][3];
+    float bias[3] = {0,0,0};
+    int i, j;
+    for (j = 0; j < 3; j++) {
+        for (i = 0; i < 3; i++) {
+            a[i][j] = 0.5f*(poses[2*j][i] - poses[2*j + 1][i]);
+            bias[i] += (poses[2*j][i] + poses[2*j + 1][i])/6.0f;
+        }
+    }
+
+    float mat[3][3];
+    if (!IMU_invert3(a, mat)) {
+        return 0; // poses not distinct, keep previous calibration
+    }
+    IMU_setAccelCal(imu, bias, mat);
+    return 1;
+}
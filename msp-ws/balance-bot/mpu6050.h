@@ -13,12 +13,43 @@
 #define MPU6050_H_
 
 
+#include "fastmath.h"
 #include "i2c_cust.h"
+#include "imu_ahrs.h"
+#include "imu_fixed.h"
+#include "imu_kalman.h"
+#include "util.h"
 #include <math.h>
+#include <stdbool.h>
 
 
 /* Macros */
 #define IMU_CAL_CYCLES 200
+#define IMU_CAL_WINDOW 100          // samples per stationarity check window
+#define IMU_CAL_WINDOWS_CONVERGE 5  // stationary windows averaged before offsets count as converged
+#define IMU_CAL_VAR_GYRO 0.05f      // ((deg/s)^2) max gyro variance while stationary
+#define IMU_CAL_VAR_ACCEL 0.0001f   // (g^2) max accelerometer variance while stationary
+#define IMU_CAL_MAX_RESIDUAL 2.0f   // (deg/s) max mean gyro rate treated as offset drift once converged
+#define IMU_CAL_K_TRACK 0.02f       // weight of each stationary window in offset tracking once converged
+#define IMU_TEMP_REF 25.0f          // (degC) reference temperature of gyro offset model
+#define IMU_TEMP_FIT_SPAN 10.0f     // (degC) min temperature span of stationary windows to fit offset model
+#define IMU_CAL_ACCEL_POSES 6       // accelerometer calibration poses: +x, -x, +y, -y, +z, -z up
+
+#define IMU_EST_FLOAT 0             // attitude estimator: float complementary filter
+#define IMU_EST_FIXED 1             // attitude estimator: fixed-point complementary filter
+#define IMU_EST_AHRS 2              // attitude estimator: quaternion Mahony filter
+#define IMU_EST_KALMAN 3            // attitude estimator: pitch Kalman filter with gyro bias state
+#ifndef IMU_ESTIMATOR
+#define IMU_ESTIMATOR IMU_EST_FLOAT
+#endif
+#define IMU_FIX_TEMP_STEP 34        // (counts) temperature change (0.1 degC) refolded into fixed-point gyro offsets
+
+#define IMU_READ_BLOCKING 0         // sample read mode: polled in main loop
+#define IMU_READ_DMA 1              // sample read mode: started from timer, received by DMA
+#define IMU_READ_FIFO 2             // sample read mode: batches drained from IMU FIFO
+
+#define IMU_FIFO_SIZE 1024          // (bytes) IMU FIFO size
+#define IMU_FIFO_MAX_SAMPLES 16     // max samples drained from FIFO per read
 
 #define IMU_GYRO_THRESHOLD 0.0      // (deg/s) gyro rotation threshold
 
@@ -32,29 +63,96 @@
 #define IMU_ACCEL_SENS_16 2048.0    // (bits/g) +/-16g accelerometer sensitivity
 
 #define IMU_ADDR 0x68               // I2C address
+#define IMU_WHO_AM_I 0x68           // WHO_AM_I register contents
 
 #define IMU_REG_PWR_MGMT1 0x6B      // power management register 1
+#define IMU_REG_WHO_AM_I 0x75       // device identity
+#define IMU_REG_SMPLRT_DIV 0x19     // sample rate divider
+#define IMU_REG_INT_PIN_CFG 0x37    // INT pin configuration
+#define IMU_REG_INT_ENABLE 0x38     // interrupt enable
+#define IMU_REG_INT_STATUS 0x3A     // interrupt status (cleared on read)
+#define IMU_REG_FIFO_EN 0x23        // FIFO enable (sensors written to FIFO)
+#define IMU_REG_USER_CTRL 0x6A      // user control
+#define IMU_REG_FIFO_COUNTH 0x72    // first FIFO count register
+#define IMU_REG_FIFO_R_W 0x74       // FIFO data register
 #define IMU_REG_CONFIG 0x1A         // IMU configuration (DLPF)
 #define IMU_REG_GYRO_CONFIG 0x1B    // gyro configuration
 #define IMU_REG_ACCEL_CONFIG 0x1C   // accelerometer configuration
 #define IMU_REG_GRYO_XOUT1 0x43     // first x-axis velocity data register
 #define IMU_REG_ACCEL_XOUT1 0x3B    // first x-axis accelerometer data register
+#define IMU_REG_TEMP_OUT1 0x41      // first temperature data register
+
+#define IMU_INT_RD_CLEAR 0x10       // INT pin: active high push-pull 50 us pulse, cleared by any read
+#define IMU_INT_DATA_RDY 0x01       // data ready interrupt enable
+#define IMU_INT_FIFO_OFLOW 0x10     // FIFO overflow interrupt enable/status
+#define IMU_FIFO_EN_SAMPLE 0xF8     // FIFO: temp, gyro x/y/z, accel (written in register order)
+#define IMU_USER_FIFO_EN 0x40       // enable FIFO
+#define IMU_USER_FIFO_RESET 0x04    // reset FIFO (while FIFO disabled)
+
+#define IMU_NUM_SAMPLE_BYTES 14     // accel (6), temp (2), gyro (6) data bytes
+#define IMU_TEMP_SENS 340.0f        // (bits/degC) temperature sensitivity
+#define IMU_TEMP_OFFSET 36.53f      // (degC) temperature at zero counts
 
 #define PI 3.142  // pi
 
 
 /* Data types */
+typedef struct {
+    int16_t accel[3];   // accelerometer counts (registers 0x3B-0x40)
+    int16_t temp;       // temperature counts (registers 0x41-0x42)
+    int16_t gyro[3];    // gyro counts (registers 0x43-0x48)
+} imu_sample_t;         // packed in data register order for single burst read
+
+typedef struct {
+    int cutoff;             // (Hz) requested accelerometer bandwidth
+    uint8_t reg;            // CONFIG register value
+    float delay_accel;      // (s) accelerometer filter group delay
+    float delay_gyro;       // (s) gyro filter group delay
+} imu_dlpf_cfg_t;           // digital low-pass filter setting
+
+typedef struct {
+    int range;              // (deg/s or g) requested full-scale range
+    uint8_t reg;            // GYRO_CONFIG/ACCEL_CONFIG register value
+    float sens;             // (bits/deg/s or bits/g) sensitivity
+} imu_range_cfg_t;          // full-scale range setting
+
 typedef struct {
     struct {
         float gyro;      // (bits/deg/s) gyro sensitivity
         float accel;     // (bits/g) accelerometer sensitivity
     } sens;
     struct {
-        float ang_vel_offset[3];  // (deg/s) gyro angular velocity offset
+        float delay_accel;   // (s) accelerometer DLPF group delay
+        float delay_gyro;    // (s) gyro DLPF group delay
+    } dlpf;
+    struct {
+        float ang_vel_offset[3];  // (deg/s) gyro angular velocity offset at IMU_TEMP_REF
+        float ang_vel_temp_coef[3][2]; // (deg/s/degC, deg/s/degC^2) gyro offset change with temperature
+        float accel_bias[3];      // (g) accelerometer bias
+        float accel_mat[3][3];    // accelerometer scale/misalignment correction
+        float accel_offset[3];    // (counts) accelerometer bias, precomputed from accel_bias
+        float accel_gain[3][3];   // (g/count) correction over sensitivity, precomputed from accel_mat
+        float ang_vel_sum[3];     // (deg/s) window sum of offset-corrected angular velocity
+        float ang_vel_sq_sum[3];  // ((deg/s)^2) window sum of squared angular velocity
+        float accel_sum[3];       // (g) window sum of acceleration
+        float accel_sq_sum[3];    // (g^2) window sum of squared acceleration
+        float temp_sum;           // (degC) window sum of temperature
+        int count;                // samples in current window
+        int windows;              // stationary windows applied to offsets
+        bool converged;           // offsets averaged over IMU_CAL_WINDOWS_CONVERGE windows
     } cal;
+    struct {
+        float x_pow_sum[5];       // sums of powers 0-4 of window temperature above IMU_TEMP_REF
+        float y_sum[3][3];        // sums of window gyro offset times powers 0-2 of temperature
+        float temp_min;           // (degC) lowest stationary window temperature
+        float temp_max;           // (degC) highest stationary window temperature
+        bool valid;               // offset model fitted over IMU_TEMP_FIT_SPAN
+    } temp_fit;
+    imu_sample_t sample;     // latest raw sample (counts)
     struct {
         float ang_vel[3];    // (deg/s) angular velocity
         float accel[3];     // (g) acceleration
+        float temp;         // (degC) die temperature
     } raw;
     struct {
         float gyro[3];      // (deg) angle from gyro data
@@ -62,18 +160,44 @@ typedef struct {
         float fused[3][2];  // (deg) angle history from fusion of data
     } angle;
     struct {
-        float fused[3];           // (deg/s) angular velocity
+        float fused[3];           // (deg/s) angular velocity (AHRS: [1] is yaw rate)
     } ang_vel;
+    struct {
+        uint32_t read_blocking;   // (cycles) CPU time of last blocking sample read
+        uint32_t read_dma;        // (cycles) CPU time of last DMA sample read
+        uint32_t estimate;        // (cycles) CPU time of last attitude update
+    } cycles;
+    struct {
+        uint32_t overflows;       // number of FIFO overflows (samples lost)
+        uint32_t misaligned;      // number of FIFO resets on a fill level that is not whole samples
+    } fifo;
 } imu_t;
 
 
 /* Function prototypes */
-void IMU_init(volatile imu_t * imu, int cutoff_dlpf, int range_gyro, int range_accel);
+int IMU_init(volatile imu_t * imu, int cutoff_dlpf, int range_gyro, int range_accel);
+void IMU_initDataReady(int div_sample);
 void IMU_readVals(volatile imu_t * imu);
+void IMU_readSample(imu_sample_t * sample);
+void IMU_readSampleTimed(volatile imu_t * imu, imu_sample_t * sample);
+void IMU_procSample(volatile imu_t * imu, const imu_sample_t * sample);
+void IMU_takeSample(volatile imu_t * imu, const imu_sample_t * sample);
+int IMU_startReadDma(volatile bool * flag_done);
+void IMU_initFifo(int div_sample);
+int IMU_readFifo(volatile imu_t * imu, imu_sample_t * samples, int max_samples);
+int IMU_updateFifo(volatile imu_t * imu, float period_sample);
+void IMU_finishReadDma(volatile imu_t * imu);
 void IMU_calcAngleGyro(volatile float * ang_vel, volatile float * angle, float t_integ);
 void IMU_calcAngleAccel(volatile float* accel, volatile float* angle);
 void IMU_calcAngleFused(volatile imu_t * imu, float period_sense);
+void IMU_calcAngleFusedFloat(volatile imu_t * imu, float period_sense);
 void IMU_calibrate(volatile imu_t * imu, const int cycles, const int delay);
+void IMU_initCal(volatile imu_t * imu);
+void IMU_updateCal(volatile imu_t * imu);
+void IMU_setCal(volatile imu_t * imu, const float * ang_vel_offset, const float temp_coef[3][2]);
+void IMU_setAccelCal(volatile imu_t * imu, const float * bias, const float mat[3][3]);
+void IMU_measureAccelPose(volatile imu_t * imu, float * accel, int n_samples);
+bool IMU_calibrateAccel(volatile imu_t * imu, const float poses[IMU_CAL_ACCEL_POSES][3]);
 void IMU_selfTest(void);
 
 
@@ -0,0 +1,200 @@
+/**
+* @file cmp_enc_vel.c
+* @brief Host comparison of encoder velocity estimators
+*
+* Replays an edge trace through the interrupt-mode decoder on mocked port 3
+* and reports delay and noise of the estimator selected by ENC_VEL_EST. The
+* trace is simulated (sinusoidal wheel speed, encoder line placement error)
+* or read from a file of "time_s count" lines, one per edge. Built once per
+* estimator: make compare, or make compare TRACE=file
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "mock.h"
+#include "enc.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/* Macros */
+#define PERIOD_CALC 0.002           // (s) Enc_calcAngle call period
+#define SIM_TIME 20.0               // (s) simulated trace length
+#define SIM_STEP 1e-6               // (s) simulation time step
+#define SIM_VEL_MEAN 200.0          // (deg/s) mean wheel speed
+#define SIM_VEL_AMP 150.0           // (deg/s) wheel speed oscillation at ENC_DELAY_FREQ
+#define SIM_LINE_ERR 0.1            // (counts) max encoder line placement error
+#define COUNTS_PER_REV 1400         // encoder counts per wheel revolution
+#define REF_WINDOW 0.01             // (s) half width of centred reference velocity window
+#define SKIP_TIME 1.0               // (s) start of trace left out while estimators settle
+#define LAG_MAX 50                  // (samples) longest delay searched
+#define MAX_EDGES 2000000           // edges in trace
+#define MAX_SAMPLES 100000          // estimator samples in trace
+
+
+/* Module variables */
+static enc_t enc = {.pins = {0x04, 0x08}};  // channel A P3.2, B P3.3
+static enc_t * const encs[1] = {&enc};
+static double edge_t[MAX_EDGES];            // (s) edge times
+static int edge_count[MAX_EDGES];           // count after edge
+static double vel_est[2][MAX_SAMPLES];      // (deg/s) M/T and filtered velocity
+static double vel_ref[MAX_SAMPLES];         // (deg/s) reference velocity at sample times
+
+
+static int simTrace(void) {
+    /* Edges of a wheel with sinusoidal speed on an encoder with misplaced lines; true velocity as reference */
+    static double line_err[COUNTS_PER_REV];
+    uint32_t seed = 1;
+    int i, n = 0, count = 0;
+    double w = 2.0*M_PI*ENC_DELAY_FREQ;
+    for (i = 0; i < COUNTS_PER_REV; i++) {
+        seed = seed*1664525u + 1013904223u;
+        line_err[i] = SIM_LINE_ERR*((double)(seed >> 8)/(1 << 24)*2.0 - 1.0);
+    }
+    for (i = 0; i*SIM_STEP < SIM_TIME && n < MAX_EDGES; i++) {
+        double t = i*SIM_STEP;
+        double pos = (SIM_VEL_MEAN*t - SIM_VEL_AMP/w*(cos(w*t) - 1.0))/ENC_DEG_PER_COUNT; // (counts)
+        int line_up = ((count + 1) % COUNTS_PER_REV + COUNTS_PER_REV) % COUNTS_PER_REV;
+        int line_down = (count % COUNTS_PER_REV + COUNTS_PER_REV) % COUNTS_PER_REV;
+        if (pos >= count + 1 + line_err[line_up]) {
+            count++;
+        }
+        else if (pos < count + line_err[line_down]) {
+            count--;
+        }
+        else {
+            continue;
+        }
+        edge_t[n] = t;
+        edge_count[n] = count;
+        n++;
+    }
+    for (i = 0; i*PERIOD_CALC < SIM_TIME && i < MAX_SAMPLES; i++) {
+        vel_ref[i] = SIM_VEL_MEAN + SIM_VEL_AMP*sin(w*i*PERIOD_CALC);
+    }
+    return n;
+}
+
+
+static int readTrace(const char * path) {
+    /* Edges from file; centred window of edge-interpolated angle as reference */
+    FILE * f = fopen(path, "r");
+    int n = 0, i, k = 0;
+    if (NULL == f) {
+        perror(path);
+        exit(2);
+    }
+    while (n < MAX_EDGES && 2 == fscanf(f, "%lf %d", &edge_t[n], &edge_count[n])) {
+        n++;
+    }
+    fclose(f);
+    for (i = 0; i*PERIOD_CALC < edge_t[n-1] && i < MAX_SAMPLES; i++) {
+        double t = i*PERIOD_CALC;
+        double pos[2];
+        int j;
+        for (j = 0; j < 2; j++) {
+            double tw = t + (j ? REF_WINDOW : -REF_WINDOW);
+            while (k > 0 && edge_t[k] > tw) {
+                k--;
+            }
+            while (k < n - 1 && edge_t[k+1] <= tw) {
+                k++;
+            }
+            pos[j] = (k < n - 1 && edge_t[k] <= tw) ? edge_count[k] +
+                (tw - edge_t[k])/(edge_t[k+1] - edge_t[k])*(edge_count[k+1] - edge_count[k]) :
+                edge_count[k];
+        }
+        vel_ref[i] = (pos[1] - pos[0])*ENC_DEG_PER_COUNT/(2.0*REF_WINDOW);
+    }
+    return n;
+}
+
+
+static int replay(int num_edges) {
+    /* Run decoder on trace edges and estimator every PERIOD_CALC */
+    static const uint8_t seq[4] = {0, 1, 3, 2}; // channel states (B << 1 | A) in forward order
+    int n = 0, k = 0;
+    int count0 = edge_count[0] - (edge_count[1] - edge_count[0]);
+    mock_p3.IN = seq[count0 & 3] << 2;
+    Mock_setTime(0);
+    enc.count = count0;
+    Enc_init(&enc, (float)PERIOD_CALC);
+    while (n < MAX_SAMPLES && n*PERIOD_CALC <= edge_t[num_edges-1]) {
+        double t = n*PERIOD_CALC;
+        for (; k < num_edges && edge_t[k] <= t; k++) {
+            mock_p3.IN = seq[edge_count[k] & 3] << 2;
+            mock_p3.IFG |= enc.mask;
+            Mock_setTime((uint32_t)(edge_t[k]*ENC_TIMER_FREQ));
+            Enc_updatePort(encs, 1);
+        }
+        Mock_setTime((uint32_t)(t*ENC_TIMER_FREQ));
+        Enc_calcAngle(&enc);
+        vel_est[0][n] = enc.vel_mt;
+        vel_est[1][n] = enc.vel_filt;
+        n++;
+    }
+    return n;
+}
+
+
+static void compare(const double * est, int num, double * delay, double * rms) {
+    /* Lag maximizing correlation with reference (interpolated), rms error after removing it */
+    int n0 = (int)(SKIP_TIME/PERIOD_CALC);
+    int len = num - n0 - LAG_MAX - 1;
+    double corr[LAG_MAX + 1];
+    double mean_est = 0.0, mean_ref = 0.0;
+    int lag, i, best = 0;
+    for (i = 0; i < len; i++) {
+        mean_est += est[n0 + i + LAG_MAX];
+        mean_ref += vel_ref[n0 + i];
+    }
+    mean_est /= len;
+    mean_ref /= len;
+    for (lag = 0; lag <= LAG_MAX; lag++) {
+        corr[lag] = 0.0;
+        for (i = 0; i < len; i++) {
+            corr[lag] += (est[n0 + i + lag] - mean_est)*(vel_ref[n0 + i] - mean_ref);
+        }
+        if (corr[lag] > corr[best]) {
+            best = lag;
+        }
+    }
+    double frac = 0.0;
+    if (best > 0 && best < LAG_MAX) { // parabola through peak and neighbours
+        double curv = corr[best-1] - 2.0*corr[best] + corr[best+1];
+        frac = (curv < 0.0) ? 0.5*(corr[best-1] - corr[best+1])/curv : 0.0;
+    }
+    *delay = (best + frac)*PERIOD_CALC;
+
+    double sum_sq = 0.0;
+    int lag0 = (int)floor(best + frac);
+    double a = best + frac - lag0;
+    for (i = 0; i < len; i++) { // est[m] against reference at m - lag0 - a
+        double ref_delayed = (1.0 - a)*vel_ref[n0 + i + 1] + a*vel_ref[n0 + i];
+        double err = est[n0 + i + lag0 + 1] - ref_delayed;
+        sum_sq += err*err;
+    }
+    *rms = sqrt(sum_sq/len);
+}
+
+
+int main(int argc, char ** argv) {
+    static const char * names[] = {"FIR", "biquad", "alpha-beta"};
+    int num_edges = (argc > 1) ? readTrace(argv[1]) : simTrace();
+    if (num_edges < 2) {
+        fprintf(stderr, "trace needs at least two edges\n");
+        return 2;
+    }
+    int num = replay(num_edges);
+    double delay_mt, rms_mt, delay, rms;
+    compare(vel_est[0], num, &delay_mt, &rms_mt);
+    compare(vel_est[1], num, &delay, &rms);
+    printf("%-10s %s, %d edges: delay %.2f ms (model at %.0f Hz %.2f ms), rms error %.2f deg/s"
+        " (M/T: %.2f ms, %.2f deg/s)\n", names[ENC_VEL_EST], (argc > 1) ? argv[1] : "simulated", num_edges,
+        1e3*delay, ENC_DELAY_FREQ, 1e3*enc.delay_vel, rms, 1e3*delay_mt, rms_mt);
+    return 0;
+}
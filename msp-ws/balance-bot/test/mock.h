@@ -0,0 +1,86 @@
+/**
+* @file mock.h
+* @brief Host mocks of MSP432 peripherals
+*
+* State of the mocked CPU, interrupt controller, DMA, timers, flash and
+* EUSCI_B1 bus with an MPU-6050 register file behind it, for inspection and
+* setup by host tests
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+#ifndef MOCK_H_
+#define MOCK_H_
+
+
+#include "driverlib.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* Macros */
+#define MOCK_NUM_INT 64             // interrupt numbers tracked
+#define MOCK_NUM_PORT 11            // digital I/O ports read through driverlib (P1 to P10)
+#define MOCK_NUM_TIMER_A 4          // Timer_A modules
+#define MOCK_IMU_ADDR 0x68          // address the emulated slave acknowledges
+#define MOCK_IMU_NUM_REG 128        // emulated slave register file size
+#define MOCK_I2C_BYTE_TICKS 4       // register accesses per byte on the emulated bus
+#define MOCK_SLEEP_MAX_TICKS 1000   // bus steps before sleep gives up (no interrupt coming)
+#define MOCK_FLASH_SECTOR_SIZE 4096 // (bytes) flash sector backed by RAM
+#define MOCK_SMCLK 12000000         // (Hz) SMCLK reported by clock system
+
+
+/* Data types */
+typedef struct {
+    int starts;                 // START conditions from idle bus (transactions)
+    int restarts;               // repeated START conditions
+    int stops;                  // STOP conditions
+    int nacks;                  // address not acknowledged
+    int bytes_tx;               // bytes written to slave, including register pointer
+    int bytes_rx;               // bytes read from slave
+    int wakes;                  // CPU wake-ups from sleep on the I2C interrupt
+    int irqs;                   // interrupt routine runs
+} mock_i2c_stats_t;
+
+typedef struct {
+    bool unprotected;           // sector open for erase/program
+    bool fail;                  // make next erase/program fail
+    int erases;                 // sector erases
+    int programs;               // program operations
+} mock_flash_stats_t;
+
+typedef struct {
+    bool enabled;               // channel armed
+    uint8_t * dst;              // next destination byte
+    uint32_t remaining;         // bytes left in transfer
+} mock_dma_t;
+
+
+/* Mock state */
+extern uint32_t mock_primask;                       // 1: interrupts masked
+extern uint32_t mock_basepri;                       // priority mask (0: none)
+extern uint8_t mock_int_priority[MOCK_NUM_INT];     // priority byte written per interrupt
+extern bool mock_int_enabled[MOCK_NUM_INT];         // interrupt enabled in NVIC
+extern void (*mock_wfi)(void);                      // advances peripherals while CPU sleeps
+extern void (*mock_irq)(void);                      // runs pending interrupts when unmasked
+extern mock_dma_t mock_dma;                         // I2C receive DMA channel
+extern uint8_t mock_gpio_in[MOCK_NUM_PORT];         // input levels of ports read through driverlib
+extern uint16_t mock_timer_a[MOCK_NUM_TIMER_A];     // Timer_A counters (TAxR)
+extern uint16_t mock_ta_ccr0;                       // Timer_A period register (last timer written)
+extern mock_i2c_stats_t mock_i2c;                   // bus statistics since Mock_i2cReset
+extern uint8_t mock_imu_reg[MOCK_IMU_NUM_REG];      // emulated slave registers
+extern uint8_t mock_flash[MOCK_FLASH_SECTOR_SIZE];  // flash sector contents
+extern mock_flash_stats_t mock_flash_stats;         // flash state and operation counts
+
+
+/* Function prototypes */
+void Mock_setTime(uint32_t ticks);
+void Mock_flashReset(void);
+void Mock_i2cReset(void);
+void Mock_i2cSleep(void);
+void Mock_i2cIrq(void);
+
+
+#endif /* MOCK_H_ */
@@ -0,0 +1,223 @@
+/**
+* @file mock_eusci.c
+* @brief Host emulation of EUSCI_B1 in I2C master mode
+*
+* Every register access through EUSCI_B1 first advances the emulated bus, so
+* START/RESTART/STOP, byte shifting, clock stretching and the byte counter
+* behave as on the device closely enough to drive i2c_cust.c unchanged. The
+* slave is an MPU-6050 style register file with auto-incrementing pointer.
+*
+* Reads of RXBUF cannot be observed on the host: the receive flag is cleared
+* after the interrupt routine ran with it set (Mock_i2cIrq, on unmasking),
+* or, with interrupts masked, when the driver unpends the interrupt after
+* servicing it. Only the interrupt-driven engine is emulated.
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "mock.h"
+#include "i2c_cust.h"
+#include <string.h>
+
+
+/* Macros */
+#define MOCK_TXBUF_EMPTY 0xFFFF     // TXBUF value while no byte is waiting to be shifted out
+
+#define BUS_IDLE 0
+#define BUS_TX 1
+#define BUS_RX 2
+#define BUS_NACK 3
+
+
+/* Mock state */
+mock_i2c_stats_t mock_i2c;
+uint8_t mock_imu_reg[MOCK_IMU_NUM_REG];
+
+static EUSCI_B_Type eusci_b1 = {.TXBUF = MOCK_TXBUF_EMPTY};
+static int bus = BUS_IDLE;      // bus phase
+static int ticks;               // accesses left until current byte is shifted
+static bool ptr_next;           // next written byte sets register pointer
+static uint8_t ptr;             // slave register pointer
+static int count_rx;            // bytes received since (RE)START
+static bool last_rx;            // last byte of read delivered, STOP follows
+static bool rx_masked;          // receive flag was pending while interrupts were masked
+
+
+static void Mock_i2cStop(void) {
+    bus = BUS_IDLE;
+    eusci_b1.CTLW0 &= ~I2CC_CTLW0_TXSTP;
+    eusci_b1.IFG |= I2CC_IFG_STP;
+    mock_i2c.stops++;
+}
+
+
+static void Mock_i2cStep(void) {
+    /* Advance bus by one register access */
+    EUSCI_B_Type * b = &eusci_b1;
+    if (b->CTLW0 & I2CC_CTLW0_SWRST) {
+        return;
+    }
+    if (b->TXBUF != MOCK_TXBUF_EMPTY) { // writing TXBUF clears transmit flag
+        b->IFG &= ~I2CC_IFG_TX;
+    }
+
+    if (b->CTLW0 & I2CC_CTLW0_TXSTT) { // (RE)START and address
+        b->CTLW0 &= ~I2CC_CTLW0_TXSTT;
+        if (BUS_IDLE == bus) {
+            mock_i2c.starts++;
+        }
+        else {
+            mock_i2c.restarts++;
+        }
+        if (b->I2CSA != MOCK_IMU_ADDR) {
+            mock_i2c.nacks++;
+            b->IFG |= I2CC_IFG_NACK;
+            bus = BUS_NACK;
+            return;
+        }
+        ticks = MOCK_I2C_BYTE_TICKS;
+        if (b->CTLW0 & I2CC_CTLW0_TR) {
+            bus = BUS_TX;
+            ptr_next = 1;
+            b->TXBUF = MOCK_TXBUF_EMPTY;
+            b->IFG |= I2CC_IFG_TX; // ready for first byte
+        }
+        else {
+            bus = BUS_RX;
+            count_rx = 0;
+            last_rx = 0;
+        }
+        return;
+    }
+
+    switch (bus) {
+    case BUS_NACK:
+        if (b->CTLW0 & I2CC_CTLW0_TXSTP) {
+            Mock_i2cStop();
+        }
+        break;
+
+    case BUS_TX:
+        if (b->TXBUF != MOCK_TXBUF_EMPTY) { // shift byte out
+            if (--ticks > 0) {
+                break;
+            }
+            ticks = MOCK_I2C_BYTE_TICKS;
+            uint8_t byte = (uint8_t)b->TXBUF;
+            b->TXBUF = MOCK_TXBUF_EMPTY;
+            if (ptr_next) {
+                ptr = byte;
+                ptr_next = 0;
+            }
+            else {
+                mock_imu_reg[ptr++ % MOCK_IMU_NUM_REG] = byte;
+            }
+            mock_i2c.bytes_tx++;
+            b->IFG |= I2CC_IFG_TX;
+        }
+        else if (b->CTLW0 & I2CC_CTLW0_TXSTP) {
+            Mock_i2cStop();
+        }
+        break;
+
+    case BUS_RX:
+        if (b->IFG & I2CC_IFG_RX) { // clock stretched until RXBUF is read
+            break;
+        }
+        if (--ticks > 0) {
+            break;
+        }
+        ticks = MOCK_I2C_BYTE_TICKS;
+        if (last_rx) {
+            Mock_i2cStop();
+            break;
+        }
+        uint8_t byte = mock_imu_reg[ptr++ % MOCK_IMU_NUM_REG];
+        count_rx++;
+        mock_i2c.bytes_rx++;
+        if (b->CTLW0 & I2CC_CTLW0_TXSTP) { // STOP requested while byte was received: byte is last
+            last_rx = 1;
+        }
+        if (((b->CTLW1 & I2CC_CTLW1_ASTP_MASK) == I2CC_CTLW1_ASTP_STOP) && (count_rx == b->TBCNT)) {
+            last_rx = 1;
+        }
+        if (mock_dma.enabled) { // receive flag triggers DMA, which reads RXBUF
+            *mock_dma.dst++ = byte;
+            if (--mock_dma.remaining == 0) {
+                mock_dma.enabled = 0;
+            }
+        }
+        else {
+            b->RXBUF = byte;
+            b->IFG |= I2CC_IFG_RX;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+EUSCI_B_Type * Mock_eusciB1(void) {
+    /* Register block access: bus advances first */
+    mock_dwt.CYCCNT++;
+    Mock_i2cStep();
+    return &eusci_b1;
+}
+
+
+void Mock_i2cReset(void) {
+    /* Idle bus, clear statistics, route CPU sleep and interrupts to the I2C emulation (configuration is kept) */
+    eusci_b1.CTLW0 &= ~(I2CC_CTLW0_TXSTT | I2CC_CTLW0_TXSTP);
+    eusci_b1.IFG = 0;
+    eusci_b1.TXBUF = MOCK_TXBUF_EMPTY;
+    memset(&mock_i2c, 0, sizeof(mock_i2c));
+    memset(&mock_dma, 0, sizeof(mock_dma));
+    bus = BUS_IDLE;
+    rx_masked = 0;
+    mock_wfi = Mock_i2cSleep;
+    mock_irq = Mock_i2cIrq;
+}
+
+
+void Mock_i2cSleep(void) {
+    /* Let bus run while CPU sleeps until an enabled flag makes the interrupt pending */
+    int i;
+    for (i = 0; i < MOCK_SLEEP_MAX_TICKS; i++) {
+        Mock_i2cStep();
+        if (mock_int_enabled[INT_EUSCIB1] && (eusci_b1.IFG & eusci_b1.IE)) {
+            break;
+        }
+    }
+    mock_i2c.wakes++;
+    if (mock_primask) { // caller services the flags before unpending
+        rx_masked = (eusci_b1.IFG & eusci_b1.IE & I2CC_IFG_RX);
+    }
+}
+
+
+void Mock_i2cIrq(void) {
+    /* Run interrupt routine if an enabled flag is set */
+    uint16_t flags = eusci_b1.IFG & eusci_b1.IE;
+    if (!mock_int_enabled[INT_EUSCIB1] || !flags) {
+        return;
+    }
+    mock_i2c.irqs++;
+    EUSCIB1_IRQHandler();
+    if (flags & I2CC_IFG_RX) { // routine read RXBUF
+        eusci_b1.IFG &= ~I2CC_IFG_RX;
+    }
+}
+
+
+void MAP_Interrupt_unpendInterrupt(uint32_t interruptNumber) {
+    /* Clear pending interrupt after masked service: the service read RXBUF */
+    if ((interruptNumber == INT_EUSCIB1) && rx_masked) {
+        eusci_b1.IFG &= ~I2CC_IFG_RX;
+        rx_masked = 0;
+    }
+}
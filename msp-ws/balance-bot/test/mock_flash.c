@@ -0,0 +1,72 @@
+/**
+* @file mock_flash.c
+* @brief Host mock of MSP432 flash controller
+*
+* One flash sector backed by RAM: erase sets all bits, programming can only
+* clear bits, and both fail while the sector is protected
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "mock.h"
+#include <string.h>
+
+
+/* Mock state */
+uint8_t mock_flash[MOCK_FLASH_SECTOR_SIZE] __attribute__((aligned(4)));
+mock_flash_stats_t mock_flash_stats;
+
+
+void Mock_flashReset(void) {
+    /* Erased, protected sector */
+    memset(mock_flash, 0xFF, sizeof(mock_flash));
+    memset(&mock_flash_stats, 0, sizeof(mock_flash_stats));
+}
+
+
+bool MAP_FlashCtl_unprotectSector(uint_fast8_t memorySpace, uint32_t sectorMask) {
+    (void)memorySpace;
+    (void)sectorMask;
+    mock_flash_stats.unprotected = 1;
+    return 1;
+}
+
+
+bool MAP_FlashCtl_protectSector(uint_fast8_t memorySpace, uint32_t sectorMask) {
+    (void)memorySpace;
+    (void)sectorMask;
+    mock_flash_stats.unprotected = 0;
+    return 1;
+}
+
+
+bool MAP_FlashCtl_eraseSector(uint32_t addr) {
+    /* Erase whole mocked sector (address is truncated on 64-bit hosts) */
+    (void)addr;
+    if (!mock_flash_stats.unprotected || mock_flash_stats.fail) {
+        return 0;
+    }
+    memset(mock_flash, 0xFF, sizeof(mock_flash));
+    mock_flash_stats.erases++;
+    return 1;
+}
+
+
+bool MAP_FlashCtl_programMemory(void * src, void * dest, uint32_t length) {
+    /* Program bytes into mocked sector: bits can only go from 1 to 0 */
+    uint8_t * dst = dest;
+    const uint8_t * data = src;
+    uint32_t i;
+    if (!mock_flash_stats.unprotected || mock_flash_stats.fail
+        || (dst < mock_flash) || (dst + length > mock_flash + MOCK_FLASH_SECTOR_SIZE)) {
+        return 0;
+    }
+    for (i = 0; i < length; i++) {
+        dst[i] &= data[i];
+    }
+    mock_flash_stats.programs++;
+    return 1;
+}
@@ -0,0 +1,183 @@
+/**
+* @file mock_msp.c
+* @brief Host mocks of MSP432 peripherals
+*
+* CPU interrupt and priority masks, NVIC, DMA, cycle counter, GPIO inputs,
+* port 3, Timer32, Timer_A and clock system stand-ins
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "mock.h"
+
+
+/* Mock state */
+uint32_t mock_primask = 0;
+uint32_t mock_basepri = 0;
+uint8_t mock_int_priority[MOCK_NUM_INT];
+bool mock_int_enabled[MOCK_NUM_INT];
+void (*mock_wfi)(void) = 0;
+void (*mock_irq)(void) = 0;
+mock_dma_t mock_dma;
+DWT_Type mock_dwt;
+DIO_PORT_Interruptable_Type mock_p3;
+Timer32_Type mock_timer32_1;
+uint8_t mock_gpio_in[MOCK_NUM_PORT];
+uint16_t mock_timer_a[MOCK_NUM_TIMER_A];
+uint16_t mock_ta_ccr0;
+
+
+uint32_t CPU_cpsid(void) {
+    /* Mask interrupts: returns previous mask */
+    uint32_t prev = mock_primask;
+    mock_primask = 1;
+    return prev;
+}
+
+
+uint32_t CPU_cpsie(void) {
+    /* Unmask interrupts: returns previous mask */
+    uint32_t prev = mock_primask;
+    mock_primask = 0;
+    if (mock_irq) { // pending interrupts run now
+        mock_irq();
+    }
+    return prev;
+}
+
+
+uint32_t CPU_primask(void) {
+    return mock_primask;
+}
+
+
+uint32_t CPU_basepriGet(void) {
+    return mock_basepri;
+}
+
+
+void CPU_basepriSet(uint32_t newBasepri) {
+    /* Set priority mask: pending interrupts run when it is lifted */
+    mock_basepri = newBasepri;
+    if (!newBasepri && !mock_primask && mock_irq) {
+        mock_irq();
+    }
+}
+
+
+void CPU_wfi(void) {
+    /* Sleep until an interrupt is pending: time passes on the mocked peripherals */
+    mock_dwt.CYCCNT += 100;
+    if (mock_wfi) {
+        mock_wfi();
+    }
+}
+
+
+void MAP_Interrupt_setPriority(uint32_t interruptNumber, uint8_t priority) {
+    mock_int_priority[interruptNumber % MOCK_NUM_INT] = priority;
+}
+
+
+void MAP_Interrupt_enableInterrupt(uint32_t interruptNumber) {
+    mock_int_enabled[interruptNumber % MOCK_NUM_INT] = 1;
+}
+
+
+uint8_t MAP_GPIO_getInputPinValue(uint_fast8_t selectedPort, uint_fast16_t selectedPins) {
+    return (mock_gpio_in[selectedPort % MOCK_NUM_PORT] & selectedPins) ? GPIO_INPUT_PIN_HIGH :
+        GPIO_INPUT_PIN_LOW;
+}
+
+
+void MAP_DMA_enableModule(void) {
+}
+
+
+void MAP_DMA_setControlBase(void * controlTable) {
+    (void)controlTable;
+}
+
+
+void MAP_DMA_assignChannel(uint32_t mapping) {
+    (void)mapping;
+}
+
+
+void MAP_DMA_setChannelControl(uint32_t channelStructIndex, uint32_t control) {
+    (void)channelStructIndex;
+    (void)control;
+}
+
+
+void MAP_DMA_setChannelTransfer(uint32_t channelStructIndex, uint32_t mode, void * srcAddr,
+    void * dstAddr, uint32_t transferSize) {
+    /* Only peripheral to memory byte transfers (I2C receive) are modelled */
+    (void)channelStructIndex;
+    (void)mode;
+    (void)srcAddr;
+    mock_dma.dst = dstAddr;
+    mock_dma.remaining = transferSize;
+}
+
+
+void MAP_DMA_enableChannel(uint32_t channelNum) {
+    (void)channelNum;
+    mock_dma.enabled = (mock_dma.remaining > 0);
+}
+
+
+void MAP_Timer32_initModule(uint32_t timer, uint32_t preScaler, uint32_t resolution, uint32_t mode) {
+    (void)timer;
+    (void)preScaler;
+    (void)resolution;
+    (void)mode;
+}
+
+
+void MAP_Timer32_startTimer(uint32_t timer, bool oneShot) {
+    (void)timer;
+    (void)oneShot;
+}
+
+
+void MAP_Timer_A_configureContinuousMode(uint32_t timer, const Timer_A_ContinuousModeConfig * config) {
+    /* Counter is clocked by the test (TAxCLK edges), only the clear takes effect */
+    if (TIMER_A_DO_CLEAR == config->timerClear) {
+        mock_timer_a[(timer >> 10) % MOCK_NUM_TIMER_A] = 0;
+    }
+}
+
+
+void MAP_Timer_A_startCounter(uint32_t timer, uint_fast16_t timerMode) {
+    (void)timer;
+    (void)timerMode;
+}
+
+
+uint16_t MAP_Timer_A_getCounterValue(uint32_t timer) {
+    /* Module from base address (TIMER_A0_BASE + 0x400 per module) */
+    return mock_timer_a[(timer >> 10) % MOCK_NUM_TIMER_A];
+}
+
+
+void MAP_Timer_A_setCompareValue(uint32_t timer, uint_fast16_t compareRegister, uint_fast16_t compareValue) {
+    (void)timer;
+    if (TIMER_A_CAPTURECOMPARE_REGISTER_0 == compareRegister) {
+        mock_ta_ccr0 = (uint16_t)compareValue;
+    }
+}
+
+
+uint32_t MAP_CS_getSMCLK(void) {
+    return MOCK_SMCLK;
+}
+
+
+void Mock_setTime(uint32_t ticks) {
+    /* Set free-running Timer32 so that the up-counting time reads ticks */
+    mock_timer32_1.VALUE = ~ticks;
+}
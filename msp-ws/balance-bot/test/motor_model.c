@@ -0,0 +1,109 @@
+/**
+* @file motor_model.c
+* @brief Host reader of identified motor models
+*
+* Reads a UART log of the firmware (one line of space-separated values per
+* transmission), picks the motor model lines (N_UART_MOTOR values: dead zone,
+* gain, time constant of right then left motor) and combines the runs: mean
+* and spread per motor, and velocity loop gains for a target closed-loop time
+* constant by internal model control (PI zero on the motor pole). Usage:
+* motor_model [log] [time constant (s)], log from stdin if omitted or "-"
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Macros */
+#define N_UART_MOTOR 6              // values per motor model line (main.c)
+#define MAX_VALS 16                 // values parsed per line
+#define MAX_RUNS 256                // model lines kept
+#define TAU_CL_DEFAULT 0.05         // (s) closed-loop time constant if not given
+
+
+/* Module variables */
+static double runs[MAX_RUNS][N_UART_MOTOR]; // dead zone, gain, tau (right, left) per run
+
+
+static int parseLine(char * line, double * vals) {
+    /* Values on a log line; 0 if any token is not a number */
+    int n = 0;
+    char * tok;
+    for (tok = strtok(line, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        char * end;
+        if (n == MAX_VALS) {
+            return 0;
+        }
+        vals[n++] = strtod(tok, &end);
+        if (*end) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+
+int main(int argc, char ** argv) {
+    static const char * names[2] = {"right", "left"};
+    FILE * f = stdin;
+    double tau_cl = (argc > 2) ? atof(argv[2]) : TAU_CL_DEFAULT;
+    char line[512];
+    int num = 0, i, m, k;
+    if ((argc > 1) && strcmp(argv[1], "-")) {
+        f = fopen(argv[1], "r");
+        if (NULL == f) {
+            perror(argv[1]);
+            return 2;
+        }
+    }
+    while (fgets(line, sizeof(line), f) && (num < MAX_RUNS)) {
+        double vals[MAX_VALS];
+        if (N_UART_MOTOR == parseLine(line, vals)) {
+            memcpy(runs[num++], vals, sizeof(runs[0]));
+        }
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+    if (0 == num) {
+        fprintf(stderr, "no motor model lines (%d values) in log\n", N_UART_MOTOR);
+        return 1;
+    }
+
+    for (i = 0; i < num; i++) {
+        printf("run %2d:", i + 1);
+        for (m = 0; m < 2; m++) {
+            printf("  %s dead zone %6.2f %%, gain %7.2f (deg/s)/%%, tau %6.4f s", names[m],
+                runs[i][3*m], runs[i][3*m+1], runs[i][3*m+2]);
+        }
+        printf("\n");
+    }
+    for (m = 0; m < 2; m++) {
+        double mean[3] = {0.0, 0.0, 0.0}, sd[3] = {0.0, 0.0, 0.0};
+        for (k = 0; k < 3; k++) {
+            for (i = 0; i < num; i++) {
+                mean[k] += runs[i][3*m+k]/num;
+            }
+            for (i = 0; i < num; i++) {
+                sd[k] += (runs[i][3*m+k] - mean[k])*(runs[i][3*m+k] - mean[k]);
+            }
+            sd[k] = (num > 1) ? sqrt(sd[k]/(num - 1)) : 0.0;
+        }
+        printf("%-5s mean of %d: dead zone %.2f +- %.2f %%, gain %.2f +- %.2f (deg/s)/%%, tau %.4f +- %.4f s\n",
+            names[m], num, mean[0], sd[0], mean[1], sd[1], mean[2], sd[2]);
+        if ((mean[1] <= 0.0) || (mean[2] <= 0.0)) {
+            continue;
+        }
+        // PI zero cancels motor pole: open loop 1/(tau_cl s), closed loop first order with tau_cl
+        printf("      gains for %.3f s loop: .k_p = %.4ff, .k_i = %.4ff, .k_ff_vel = %.5ff\n",
+            tau_cl, mean[2]/(mean[1]*tau_cl), 1.0/(mean[1]*tau_cl), 1.0/mean[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+* @file driverlib.h
+* @brief Host stand-in for MSP432 driverlib
+*
+* Constants and functions of driverlib used by the firmware modules,
+* implemented by mocks in mock_msp.c
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+#ifndef DRIVERLIB_H_
+#define DRIVERLIB_H_
+
+
+#include "msp.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* Macros */
+#define INT_EUSCIB1 37
+
+#define GPIO_PORT_P4 4
+#define GPIO_PORT_P8 8
+#define GPIO_PIN2 0x0004
+#define GPIO_PIN3 0x0008
+#define GPIO_INPUT_PIN_LOW 0x00
+#define GPIO_INPUT_PIN_HIGH 0x01
+
+#define DMA_CH3_EUSCIB1RX0 0x00000003
+#define UDMA_PRI_SELECT 0x00000000
+#define UDMA_MODE_BASIC 0x00000001
+#define UDMA_SIZE_8 0x00000000
+#define UDMA_SRC_INC_NONE 0x0C000000
+#define UDMA_DST_INC_8 0x00000000
+#define UDMA_ARB_1 0x00000000
+
+#define TIMER32_PRESCALER_1 0x00
+#define TIMER32_32BIT 0x01
+#define TIMER32_FREE_RUN_MODE 0x00
+
+#define TIMER_A2_BASE 0x40000800
+#define TIMER_A3_BASE 0x40000C00
+#define TIMER_A_CLOCKSOURCE_EXTERNAL_TXCLK 0x0000
+#define TIMER_A_CLOCKSOURCE_DIVIDER_1 0x01
+#define TIMER_A_TAIE_INTERRUPT_DISABLE 0x00
+#define TIMER_A_DO_CLEAR 0x0004
+#define TIMER_A_CONTINUOUS_MODE 0x0020
+#define TIMER_A_CAPTURECOMPARE_REGISTER_0 0x02
+
+#define FLASH_INFO_MEMORY_SPACE_BANK0 0x03
+#define FLASH_SECTOR0 0x00000001
+
+
+/* Data types */
+typedef struct {
+    uint_fast16_t clockSource;
+    uint_fast16_t clockSourceDivider;
+    uint_fast16_t timerInterruptEnable_TAIE;
+    uint_fast16_t timerClear;
+} Timer_A_ContinuousModeConfig;
+
+
+/* Function prototypes */
+uint32_t CPU_cpsid(void);
+uint32_t CPU_cpsie(void);
+uint32_t CPU_primask(void);
+uint32_t CPU_basepriGet(void);
+void CPU_basepriSet(uint32_t newBasepri);
+void CPU_wfi(void);
+
+void MAP_Interrupt_setPriority(uint32_t interruptNumber, uint8_t priority);
+void MAP_Interrupt_enableInterrupt(uint32_t interruptNumber);
+void MAP_Interrupt_unpendInterrupt(uint32_t interruptNumber);
+
+uint8_t MAP_GPIO_getInputPinValue(uint_fast8_t selectedPort, uint_fast16_t selectedPins);
+
+void MAP_DMA_enableModule(void);
+void MAP_DMA_setControlBase(void * controlTable);
+void MAP_DMA_assignChannel(uint32_t mapping);
+void MAP_DMA_setChannelControl(uint32_t channelStructIndex, uint32_t control);
+void MAP_DMA_setChannelTransfer(uint32_t channelStructIndex, uint32_t mode, void * srcAddr,
+    void * dstAddr, uint32_t transferSize);
+void MAP_DMA_enableChannel(uint32_t channelNum);
+
+void MAP_Timer32_initModule(uint32_t timer, uint32_t preScaler, uint32_t resolution, uint32_t mode);
+void MAP_Timer32_startTimer(uint32_t timer, bool oneShot);
+
+void MAP_Timer_A_configureContinuousMode(uint32_t timer, const Timer_A_ContinuousModeConfig * config);
+void MAP_Timer_A_startCounter(uint32_t timer, uint_fast16_t timerMode);
+uint16_t MAP_Timer_A_getCounterValue(uint32_t timer);
+void MAP_Timer_A_setCompareValue(uint32_t timer, uint_fast16_t compareRegister, uint_fast16_t compareValue);
+uint32_t MAP_CS_getSMCLK(void);
+
+extern uint8_t mock_flash[];     // RAM-backed flash sector (CAL_ADDR in host tests)
+bool MAP_FlashCtl_unprotectSector(uint_fast8_t memorySpace, uint32_t sectorMask);
+bool MAP_FlashCtl_protectSector(uint_fast8_t memorySpace, uint32_t sectorMask);
+bool MAP_FlashCtl_eraseSector(uint32_t addr);
+bool MAP_FlashCtl_programMemory(void * src, void * dest, uint32_t length);
+
+
+#endif /* DRIVERLIB_H_ */
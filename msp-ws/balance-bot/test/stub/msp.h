@@ -0,0 +1,64 @@
+/**
+* @file msp.h
+* @brief Host stand-in for MSP432 peripheral registers
+*
+* Register blocks used by the firmware modules, backed by mocks. Accesses to
+* EUSCI_B1 step the bus emulation in mock_eusci.c first.
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+#ifndef MSP_H_
+#define MSP_H_
+
+
+#include <stdint.h>
+
+
+/* Data types */
+typedef struct {
+    volatile uint16_t CTLW0;    // control word 0
+    volatile uint16_t CTLW1;    // control word 1
+    volatile uint16_t BRW;      // bit rate control
+    volatile uint16_t STATW;    // status
+    volatile uint16_t TBCNT;    // byte counter threshold
+    volatile uint16_t RXBUF;    // receive buffer
+    volatile uint16_t TXBUF;    // transmit buffer
+    volatile uint16_t I2CSA;    // slave address
+    volatile uint16_t IE;       // interrupt enable
+    volatile uint16_t IFG;      // interrupt flags
+} EUSCI_B_Type;
+
+typedef struct {
+    volatile uint32_t CYCCNT;   // cycle counter
+} DWT_Type;
+
+typedef struct {
+    volatile uint8_t IN;        // input
+    volatile uint8_t IES;       // interrupt edge select (1: falling)
+    volatile uint8_t IE;        // interrupt enable
+    volatile uint8_t IFG;       // interrupt flags
+} DIO_PORT_Interruptable_Type;
+
+typedef struct {
+    volatile uint32_t LOAD;     // load value
+    volatile uint32_t VALUE;    // current value (counts down)
+    volatile uint32_t CONTROL;  // control
+} Timer32_Type;
+
+
+/* Mocks */
+EUSCI_B_Type * Mock_eusciB1(void);
+extern DWT_Type mock_dwt;
+extern DIO_PORT_Interruptable_Type mock_p3;
+extern Timer32_Type mock_timer32_1;
+
+#define EUSCI_B1 (Mock_eusciB1())
+#define DWT (&mock_dwt)
+#define P3 (&mock_p3)
+#define TIMER32_1 (&mock_timer32_1)
+
+
+#endif /* MSP_H_ */
@@ -0,0 +1,53 @@
+/**
+* @file test.h
+* @brief Host test helpers
+*
+* Check macros and timing for host tests of the firmware modules
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+#ifndef TEST_H_
+#define TEST_H_
+
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+
+/* Macros */
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tol) do { \
+        double check_a_ = (a), check_b_ = (b); \
+        if (!(fabs(check_a_ - check_b_) <= (tol))) { \
+            printf("%s:%d: check failed: %s = %g, %s = %g (tol %g)\n", __FILE__, __LINE__, \
+                #a, check_a_, #b, check_b_, (double)(tol)); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT() (printf("%s: %s\n", __FILE__, test_failures ? "FAIL" : "ok"), test_failures != 0)
+
+
+/* Module variables */
+static int test_failures = 0; // failed checks in this test program
+
+
+static inline double Test_timeNs(void) {
+    /* Monotonic host time (ns) for throughput benchmarks */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec*1e9 + (double)ts.tv_nsec;
+}
+
+
+#endif /* TEST_H_ */
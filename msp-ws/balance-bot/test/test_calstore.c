@@ -0,0 +1,130 @@
+/**
+* @file test_calstore.c
+* @brief Host test of the calibration store
+*
+* CRC-32 check value, save/load round trip on RAM-backed flash, rejection of
+* erased, corrupted and out-of-date records, and failed writes
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "mock.h"
+#include "calstore.h"
+#include <string.h>
+
+
+/* Macros */
+#define NUM_BENCH 100000            // CRCs per timing run
+
+
+/* Module variables */
+static volatile uint32_t sink;      // keeps benchmarked results alive
+
+
+static void fillRecord(cal_record_t * rec) {
+    /* Distinct non-trivial calibration values */
+    memset(rec, 0, sizeof(*rec));
+    rec->gyro_offset[0] = 1.25f;
+    rec->gyro_offset[2] = -0.5f;
+    rec->gyro_temp_coef[1][0] = 0.02f;
+    rec->accel_bias[1] = -0.015f;
+    rec->accel_mat[0][0] = 1.01f;
+    rec->accel_mat[1][1] = 0.99f;
+    rec->accel_mat[2][2] = 1.0f;
+    rec->deadzone[0] = 7.5f;
+    rec->motor_gain[1] = 12.0f;
+    rec->motor_tau[0] = 0.08f;
+}
+
+
+static void testCrc(void) {
+    /* Standard check value of CRC-32/ISO-HDLC */
+    CHECK(Cal_crc32("123456789", 9) == 0xCBF43926);
+    CHECK(Cal_crc32("", 0) == 0x00000000);
+}
+
+
+static void testRoundTrip(void) {
+    /* Saved record loads back identical, sector protected again */
+    cal_record_t rec, rec_load;
+    Mock_flashReset();
+    CHECK(!Cal_load(&rec_load)); // erased flash
+    fillRecord(&rec);
+    CHECK(Cal_save(&rec));
+    CHECK(mock_flash_stats.erases == 1);
+    CHECK(mock_flash_stats.programs == 1);
+    CHECK(!mock_flash_stats.unprotected);
+    CHECK(Cal_load(&rec_load));
+    CHECK(memcmp(&rec, &rec_load, sizeof(rec)) == 0);
+    CHECK(rec_load.version == CAL_VERSION);
+
+    rec.deadzone[1] = 6.0f; // overwrite: erase first, bits come back
+    CHECK(Cal_save(&rec));
+    CHECK(Cal_load(&rec_load));
+    CHECK(rec_load.deadzone[1] == 6.0f);
+}
+
+
+static void testReject(void) {
+    /* Any flipped bit, wrong version or size makes load fail */
+    cal_record_t rec, rec_load;
+    int i, bit;
+    Mock_flashReset();
+    fillRecord(&rec);
+    CHECK(Cal_save(&rec));
+    int loaded = 0;
+    for (i = 0; i < (int)sizeof(cal_record_t); i++) {
+        for (bit = 0; bit < 8; bit++) {
+            mock_flash[i] ^= 1 << bit;
+            loaded += Cal_load(&rec_load);
+            mock_flash[i] ^= 1 << bit;
+        }
+    }
+    CHECK(loaded == 0);
+    CHECK(Cal_load(&rec_load));
+
+    cal_record_t * rec_flash = (cal_record_t *)mock_flash;
+    rec_flash->version = CAL_VERSION - 1; // older layout with valid CRC
+    rec_flash->crc = Cal_crc32(rec_flash, sizeof(cal_record_t) - sizeof(uint32_t));
+    CHECK(!Cal_load(&rec_load));
+}
+
+
+static void testWriteFail(void) {
+    /* Failed erase reported, sector left protected */
+    cal_record_t rec;
+    Mock_flashReset();
+    fillRecord(&rec);
+    mock_flash_stats.fail = 1;
+    CHECK(!Cal_save(&rec));
+    CHECK(!mock_flash_stats.unprotected);
+}
+
+
+static void testBench(void) {
+    /* Host ns per record CRC */
+    cal_record_t rec;
+    int i;
+    fillRecord(&rec);
+    double t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        rec.crc = i;
+        sink = Cal_crc32(&rec, sizeof(cal_record_t));
+    }
+    printf("host ns per %d byte record CRC: %.1f\n", (int)sizeof(cal_record_t),
+        (Test_timeNs() - t_start)/NUM_BENCH);
+}
+
+
+int main(void) {
+    testCrc();
+    testRoundTrip();
+    testReject();
+    testWriteFail();
+    testBench();
+    return TEST_RESULT();
+}
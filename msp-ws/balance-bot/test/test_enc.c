@@ -0,0 +1,255 @@
+/**
+* @file test_enc.c
+* @brief Host test of the encoder driver
+*
+* Scripted channel levels on mocked port 3 and edge times on mocked Timer32
+* drive the quadrature decoder: all 16 state transitions, full cycles in both
+* directions, missed edge recovery, glitch rejection, two encoders sharing
+* one port read, M/T velocity at constant edge rate, and velocity after long
+* standstill
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "mock.h"
+#include "enc.h"
+
+
+/* Macros */
+#define TICKS_MS 48000              // (ticks) one millisecond of edge timer
+#define PERIOD_CALC 0.002f          // (s) Enc_calcAngle call period
+
+
+/* Module variables */
+static enc_t enc_r = {.pins = {0x04, 0x08}};    // channel A P3.2, B P3.3
+static enc_t enc_l = {.pins = {0x40, 0x80}};    // channel A P3.6, B P3.7
+static enc_t * const encs[2] = {&enc_r, &enc_l};
+static uint32_t time_now = 0;                   // (ticks) mocked edge timer
+static const int gray_pos[4] = {0, 1, 3, 2};    // position of state (B << 1 | A) in forward sequence
+
+
+static void setState(enc_t * enc, uint8_t state) {
+    /* Drive encoder channels to state without running the interrupt */
+    mock_p3.IN = (mock_p3.IN & ~enc->mask) | (uint8_t)(state << enc->shift);
+}
+
+
+static void edge(uint32_t dt) {
+    /* Advance time and run port interrupt */
+    time_now += dt;
+    Mock_setTime(time_now);
+    mock_p3.IFG |= enc_r.mask | enc_l.mask;
+    Enc_updatePort(encs, 2);
+}
+
+
+static void initEncs(uint8_t state_r, uint8_t state_l) {
+    /* Start both encoders from given channel states */
+    mock_p3.IN = 0;
+    mock_p3.IES = 0;
+    time_now = 1000*TICKS_MS;
+    Mock_setTime(time_now);
+    enc_r.count = 0;
+    enc_l.count = 0;
+    Enc_init(&enc_r, PERIOD_CALC);
+    Enc_init(&enc_l, PERIOD_CALC);
+    setState(&enc_r, state_r);
+    setState(&enc_l, state_l);
+    Enc_init(&enc_r, PERIOD_CALC);
+    Enc_init(&enc_l, PERIOD_CALC);
+}
+
+
+static void testTransitions(void) {
+    /* Every (previous, new) state pair: +1/-1 along Gray sequence, illegal for double change */
+    uint8_t s0, s;
+    for (s0 = 0; s0 < 4; s0++) {
+        for (s = 0; s < 4; s++) {
+            initEncs(s0, 0);
+            setState(&enc_r, s);
+            edge(2*ENC_MISS_WINDOW); // slow: illegal transition is not recovered
+            int step = (gray_pos[s] - gray_pos[s0] + 4) % 4;
+            int count = (1 == step) ? 1 : ((3 == step) ? -1 : 0);
+            CHECK(enc_r.count == count);
+            CHECK(enc_r.illegal == (2 == step));
+            CHECK(enc_r.missed == 0);
+            CHECK(enc_r.state_prev == s);
+            if (count) {
+                CHECK(enc_r.dir == count);
+                CHECK(enc_r.t_edge == time_now);
+            }
+            CHECK((mock_p3.IES & enc_r.mask) == (mock_p3.IN & enc_r.mask)); // next edge away from level
+            CHECK((mock_p3.IFG & enc_r.mask) == 0);
+            CHECK(enc_l.count == 0);
+        }
+    }
+}
+
+
+static void testSequence(void) {
+    /* Full cycles forward then back return to start */
+    static const uint8_t seq[4] = {0, 1, 3, 2};
+    int i;
+    initEncs(0, 0);
+    for (i = 1; i <= 40; i++) {
+        setState(&enc_r, seq[i % 4]);
+        edge(TICKS_MS);
+    }
+    CHECK(enc_r.count == 40);
+    for (i = 39; i >= 0; i--) {
+        setState(&enc_r, seq[i % 4]);
+        edge(TICKS_MS);
+    }
+    CHECK(enc_r.count == 0);
+    CHECK(enc_r.illegal == 0);
+    CHECK(enc_r.dt_edge_min == TICKS_MS);
+}
+
+
+static void testMissed(void) {
+    /* Double change soon after an edge: two steps in last direction */
+    initEncs(0, 0);
+    setState(&enc_r, 1);
+    edge(TICKS_MS);
+    setState(&enc_r, 2); // skipped state 3
+    edge(TICKS_MS);
+    CHECK(enc_r.count == 3);
+    CHECK(enc_r.illegal == 1);
+    CHECK(enc_r.missed == 1);
+}
+
+
+static void testGlitch(void) {
+    /* Edge undone when followed within ENC_MIN_EDGE_SPACING by return to prior state, fast steps kept */
+    static const uint8_t seq[4] = {0, 1, 3, 2};
+    int i;
+    initEncs(0, 0);
+    setState(&enc_r, 1);
+    edge(TICKS_MS);
+    uint32_t t_real = time_now;
+    setState(&enc_r, 3); // leading edge of glitch counts until trailing edge
+    edge(TICKS_MS);
+    CHECK(enc_r.count == 2);
+    setState(&enc_r, 1);
+    edge(ENC_MIN_EDGE_SPACING/2);
+    CHECK(enc_r.count == 1);
+    CHECK(enc_r.glitches == 2);
+    CHECK(enc_r.state_prev == 1);
+    CHECK(enc_r.dir == 1);
+    CHECK(enc_r.t_edge == t_real);
+
+    setState(&enc_r, 0); // backward glitch after forward edge
+    edge(TICKS_MS);
+    setState(&enc_r, 1);
+    edge(ENC_MIN_EDGE_SPACING/2);
+    CHECK(enc_r.count == 1);
+    CHECK(enc_r.dir == 1);
+    CHECK(enc_r.glitches == 4);
+
+    setState(&enc_r, 3); // real step followed quickly by next real step
+    edge(TICKS_MS);
+    setState(&enc_r, 2);
+    edge(ENC_MIN_EDGE_SPACING/2);
+    CHECK(enc_r.count == 3);
+    CHECK(enc_r.glitches == 4);
+
+    setState(&enc_r, 0); // return after spacing: real reversal, both edges count
+    edge(TICKS_MS);
+    setState(&enc_r, 2);
+    edge(2*ENC_MIN_EDGE_SPACING);
+    CHECK(enc_r.count == 3);
+    CHECK(enc_r.dir == -1);
+    CHECK(enc_r.glitches == 4);
+
+    setState(&enc_r, 0); // glitch over before port is read
+    setState(&enc_r, 2);
+    edge(TICKS_MS);
+    CHECK(enc_r.count == 3);
+
+    initEncs(0, 0); // glitch on every step of a run
+    for (i = 1; i <= 40; i++) {
+        setState(&enc_r, seq[i % 4]);
+        edge(TICKS_MS);
+        setState(&enc_r, seq[(i + 1) % 4]);
+        edge(TICKS_MS/4);
+        setState(&enc_r, seq[i % 4]);
+        edge(ENC_MIN_EDGE_SPACING/4);
+    }
+    CHECK(enc_r.count == 40);
+    CHECK(enc_r.glitches == 80);
+    CHECK(enc_r.state_prev == seq[0]);
+}
+
+
+static void testShared(void) {
+    /* Edges on both encoders in one port read are both decoded */
+    initEncs(0, 0);
+    setState(&enc_r, 1);
+    setState(&enc_l, 2);
+    edge(TICKS_MS);
+    CHECK(enc_r.count == 1);
+    CHECK(enc_l.count == -1);
+}
+
+
+static void testVelocity(void) {
+    /* Constant edge rate slower and faster than calculation rate: M/T velocity is exact */
+    static const uint8_t seq[4] = {0, 1, 3, 2};
+    static const uint32_t periods[3] = {7*TICKS_MS, TICKS_MS/3, 5*TICKS_MS/7}; // (ticks) between edges
+    int p, i;
+    for (p = 0; p < 3; p++) {
+        uint32_t t_calc = 1000*TICKS_MS; // (ticks) next calculation
+        uint32_t t_edge = t_calc;        // (ticks) next edge
+        int n = 0;
+        initEncs(0, 0);
+        for (i = 0; i < 500; i++) { // 1 s of calculations at 500 Hz
+            t_calc += 2*TICKS_MS;
+            while ((int32_t)(t_edge + periods[p] - t_calc) <= 0) {
+                t_edge += periods[p];
+                setState(&enc_r, seq[++n % 4]);
+                edge(t_edge - time_now);
+            }
+            time_now = t_calc;
+            Mock_setTime(time_now);
+            Enc_calcAngle(&enc_r);
+        }
+        CHECK_NEAR(enc_r.vel_mt, ENC_DEG_PER_COUNT*ENC_TIMER_FREQ/(float)periods[p], 1e-3f*enc_r.vel_mt);
+    }
+}
+
+
+static void testStandstill(void) {
+    /* First edge after standstill longer than timer wrap (89 s) reads as slow, not wrapped */
+    uint64_t elapsed = 0; // (ticks) since last edge
+    initEncs(0, 0);
+    setState(&enc_r, 1);
+    edge(TICKS_MS);
+    while (elapsed < (1ULL << 32)) { // 500 Hz calculation until timer wrapped once
+        time_now += 2*TICKS_MS;
+        elapsed += 2*TICKS_MS;
+        Mock_setTime(time_now);
+        Enc_calcAngle(&enc_r);
+    }
+    CHECK(enc_r.vel_mt == 0.0f);
+    setState(&enc_r, 3);
+    edge(0); // elapsed ticks wrapped to under 2 ms
+    Enc_calcAngle(&enc_r);
+    CHECK(enc_r.vel_mt > 0.0f);
+    CHECK(enc_r.vel_mt <= ENC_DEG_PER_COUNT/ENC_VEL_TIMEOUT);
+}
+
+
+int main(void) {
+    testTransitions();
+    testSequence();
+    testMissed();
+    testGlitch();
+    testShared();
+    testVelocity();
+    testStandstill();
+    return TEST_RESULT();
+}
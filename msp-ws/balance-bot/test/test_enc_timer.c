@@ -0,0 +1,177 @@
+/**
+* @file test_enc_timer.c
+* @brief Host test of the encoder driver in Timer_A counting mode
+*
+* A scripted quadrature position clocks the mocked Timer_A on channel A
+* rising edges and runs the port interrupt on channel B rising edges: runs
+* in both directions, angle between channel B edges, M/T velocity at
+* constant edge rate, and wheel angle drift over a random walk with
+* reversals
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "mock.h"
+#include "enc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/* Macros */
+#define TICKS_MS 48000              // (ticks) one millisecond of edge timer
+#define PERIOD_CALC 0.002f          // (s) Enc_calcAngle call period
+#define PORT_A GPIO_PORT_P8         // right channel A on TA3CLK (P8.3)
+#define PIN_A GPIO_PIN3
+#define PIN_B 0x08                  // right channel B on P3.3
+#define WALK_STEPS 5000             // reversals in random walk
+
+
+/* Module variables */
+static enc_t enc_r = {.pins = {PIN_A, PIN_B}, .port_a = PORT_A, .timer_a = TIMER_A3_BASE};
+static enc_t * const encs[1] = {&enc_r};
+static int pos = 0;                             // (counts) true quadrature position
+static uint32_t time_now = 0;                   // (ticks) mocked edge timer
+static const uint8_t seq[4] = {0, 1, 3, 2};     // forward state sequence (B << 1 | A)
+
+
+static void setPos(int p) {
+    /* Drive channels to quadrature position without counting or interrupts */
+    uint8_t state = seq[p & 0x03];
+    pos = p;
+    mock_gpio_in[PORT_A] = (state & 0x01) ? PIN_A : 0;
+    mock_p3.IN = (state & 0x02) ? PIN_B : 0;
+}
+
+
+static void step(int dir, uint32_t dt) {
+    /* Move one count: channel A rising clocks Timer_A, channel B rising runs port interrupt */
+    uint8_t state_prev = seq[pos & 0x03];
+    setPos(pos + dir);
+    uint8_t state = seq[pos & 0x03];
+    time_now += dt;
+    Mock_setTime(time_now);
+    if ((state & 0x01) && !(state_prev & 0x01)) {
+        mock_timer_a[3]++;
+    }
+    if ((state & 0x02) && !(state_prev & 0x02)) {
+        mock_p3.IFG |= PIN_B;
+        Enc_updatePort(encs, 1);
+    }
+}
+
+
+static void initEnc(void) {
+    /* Start encoder at position 0 */
+    mock_p3.IES = 0xFF;
+    mock_timer_a[3] = 0x1234; // cleared by Enc_init
+    time_now = 1000*TICKS_MS;
+    Mock_setTime(time_now);
+    setPos(0);
+    enc_r.count = 0;
+    Enc_init(&enc_r, PERIOD_CALC);
+}
+
+
+static int angleCounts(void) {
+    /* Wheel angle from Enc_calcAngle in counts */
+    Enc_calcAngle(&enc_r);
+    return (int)lroundf(enc_r.pos[0]/ENC_DEG_PER_COUNT);
+}
+
+
+static void testInit(void) {
+    /* Counter cleared and channel B armed for rising edge */
+    initEnc();
+    CHECK(enc_r.mask == PIN_B);
+    CHECK(enc_r.shift == 3);
+    CHECK((mock_p3.IES & PIN_B) == 0);
+    CHECK(mock_timer_a[3] == 0);
+    CHECK(enc_r.tar_ref == 0);
+}
+
+
+static void testRuns(void) {
+    /* Forward, reverse and back: angle within a period of position, two more around reversals */
+    int i, err_max = 0;
+    initEnc();
+    for (i = 0; i < 400; i++) {
+        step(1, TICKS_MS);
+        int err = abs(angleCounts() - pos);
+        err_max = (err > err_max) ? err : err_max;
+    }
+    CHECK(enc_r.dir == 1);
+    for (i = 0; i < 800; i++) {
+        step(-1, TICKS_MS);
+        int err = abs(angleCounts() - pos);
+        err_max = (err > err_max) ? err : err_max;
+    }
+    CHECK(enc_r.dir == -1);
+    for (i = 0; i < 400; i++) {
+        step(1, TICKS_MS);
+        int err = abs(angleCounts() - pos);
+        err_max = (err > err_max) ? err : err_max;
+    }
+    CHECK(pos == 0);
+    CHECK(err_max < 3*ENC_COUNTS_PER_EDGE);
+    CHECK(abs(angleCounts()) <= ENC_COUNTS_PER_EDGE);
+    CHECK(enc_r.dt_edge_min == 2*TICKS_MS); // channel B edges on either side of a reversal
+}
+
+
+static void testVelocity(void) {
+    /* Constant edge rate: M/T velocity over channel B edges is exact */
+    static const uint32_t periods[2] = {7*TICKS_MS, TICKS_MS/3}; // (ticks) between counts
+    int p, i;
+    for (p = 0; p < 2; p++) {
+        uint32_t t_calc = 1000*TICKS_MS; // (ticks) next calculation
+        uint32_t t_step = t_calc;        // (ticks) next count
+        initEnc();
+        for (i = 0; i < 500; i++) { // 1 s of calculations at 500 Hz
+            t_calc += 2*TICKS_MS;
+            while ((int32_t)(t_step + periods[p] - t_calc) <= 0) {
+                t_step += periods[p];
+                step(1, t_step - time_now);
+            }
+            time_now = t_calc;
+            Mock_setTime(time_now);
+            Enc_calcAngle(&enc_r);
+        }
+        CHECK_NEAR(enc_r.vel_mt, ENC_DEG_PER_COUNT*ENC_TIMER_FREQ/(float)periods[p], 1e-3f*enc_r.vel_mt);
+    }
+}
+
+
+static void testWalk(void) {
+    /* Random walk with dither and reversals: angle wanders, bounded by reversal count */
+    int i, j;
+    long err_sum = 0;
+    srand(1);
+    initEnc();
+    for (i = 0; i < WALK_STEPS; i++) {
+        int dir = (i & 1) ? -1 : 1;
+        int len = 1 + rand() % 40;
+        for (j = 0; j < len; j++) {
+            step(dir, TICKS_MS/4);
+        }
+        err_sum += angleCounts() - pos;
+    }
+    int err = angleCounts() - pos;
+    float err_mean = (float)err_sum/WALK_STEPS;
+    printf("timer mode after %d reversals: angle error %d counts, mean %.1f counts\n", WALK_STEPS, err,
+        err_mean);
+    CHECK(abs(err) <= 200);
+    CHECK(fabsf(err_mean) <= 200.0f);
+}
+
+
+int main(void) {
+    testInit();
+    testRuns();
+    testVelocity();
+    testWalk();
+    return TEST_RESULT();
+}
@@ -0,0 +1,109 @@
+/**
+* @file test_fastmath.c
+* @brief Host test of fast single-precision math
+*
+* Error bounds stated in fastmath.c against double precision libm, and host
+* time per call against single precision libm
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "fastmath.h"
+
+
+/* Macros */
+#define NUM_ANGLES 100000           // atan2 test points around the circle
+#define NUM_BENCH 1000000           // calls per timing run
+
+
+/* Module variables */
+static volatile float sink;         // keeps benchmarked results alive
+
+
+static void testAtan2(void) {
+    /* Absolute error over all quadrants and radii, exact axes */
+    double err_max = 0.0;
+    int i;
+    for (i = 0; i < NUM_ANGLES; i++) {
+        double angle = -M_PI + 2.0*M_PI*(i + 0.5)/NUM_ANGLES;
+        double radius = pow(10.0, (double)(i % 13) - 6.0);
+        float y = (float)(radius*sin(angle));
+        float x = (float)(radius*cos(angle));
+        double err = fabs((double)FMath_atan2f(y, x) - atan2((double)y, (double)x));
+        if (err > err_max) {
+            err_max = err;
+        }
+    }
+    printf("FMath_atan2f max error %.2e rad\n", err_max);
+    CHECK(err_max < 1.2e-5);
+    CHECK(FMath_atan2f(0.0f, 0.0f) == 0.0f);
+    CHECK_NEAR(FMath_atan2f(1.0f, 0.0f), M_PI/2, 1.2e-5);
+    CHECK_NEAR(FMath_atan2f(0.0f, -1.0f), M_PI, 1.2e-5);
+    CHECK_NEAR(FMath_atan2f(-1.0f, 0.0f), -M_PI/2, 1.2e-5);
+}
+
+
+static void testSqrt(void) {
+    /* Reciprocal root within bound, root correctly rounded, non-positive input gives 0 */
+    double err_inv = 0.0;
+    int exact = 1;
+    float x;
+    for (x = 1e-30f; x < 1e30f; x *= 1.0137f) {
+        double ref = sqrt((double)x);
+        double err = fabs((double)FMath_invSqrtf(x)*ref - 1.0);
+        if (err > err_inv) {
+            err_inv = err;
+        }
+        if (FMath_sqrtf(x) != (float)ref) {
+            exact = 0;
+        }
+    }
+    printf("FMath_invSqrtf max relative error %.2e\n", err_inv);
+    CHECK(err_inv < 5.0e-6);
+    CHECK(exact);
+    CHECK(FMath_sqrtf(0.0f) == 0.0f);
+    CHECK(FMath_sqrtf(-4.0f) == 0.0f);
+}
+
+
+static void testBench(void) {
+    /* Host ns per call against single precision libm */
+    double t_start, t_fast, t_libm;
+    int i;
+
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = FMath_atan2f((float)(i & 1023) - 512.0f, 300.0f);
+    }
+    t_fast = (Test_timeNs() - t_start)/NUM_BENCH;
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = atan2f((float)(i & 1023) - 512.0f, 300.0f);
+    }
+    t_libm = (Test_timeNs() - t_start)/NUM_BENCH;
+    printf("host ns/call atan2: fast %.2f, libm %.2f\n", t_fast, t_libm);
+
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = FMath_invSqrtf((float)(i + 1));
+    }
+    t_fast = (Test_timeNs() - t_start)/NUM_BENCH;
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = 1.0f/sqrtf((float)(i + 1));
+    }
+    t_libm = (Test_timeNs() - t_start)/NUM_BENCH;
+    printf("host ns/call 1/sqrt: fast %.2f, libm %.2f\n", t_fast, t_libm);
+}
+
+
+int main(void) {
+    testAtan2();
+    testSqrt();
+    testBench();
+    return TEST_RESULT();
+}
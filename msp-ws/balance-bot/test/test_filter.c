@@ -0,0 +1,318 @@
+/**
+* @file test_filter.c
+* @brief Host test of digital filters
+*
+* Frequency response of FIR, Q15 FIR and biquad cascade measured on
+* sinusoids against the response evaluated from their coefficients, Q15
+* against float FIR, moving average against exact mean, and host time per
+* sample of each filter
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "filter.h"
+#include <stdlib.h>
+
+
+/* Macros */
+#define FREQ_SAMPLE 500.0           // (Hz) sample rate
+#define FIR_ORDER 20                // FIR order (odd number of taps)
+#define FIR_CUTOFF 30.0             // (Hz) FIR and biquad cutoff
+#define NUM_SETTLE 1000             // samples before response is measured
+#define NUM_MEASURE 5000            // samples over which response is measured
+#define AVG_LEN 32                  // moving average length
+#define NUM_BENCH 1000000           // samples per timing run
+
+
+/* Data types */
+typedef float (*filt_run_t)(void * filt, float x); // one filter step on float samples
+
+
+/* Module variables */
+static float fir_coeffs[FIR_ORDER + 1];
+static int16_t fir_coeffs_q15[FIR_ORDER + 1];
+static float biquad_coeffs[2][5];
+static volatile float sink;         // keeps benchmarked results alive
+
+
+static void designFir(void) {
+    /* Hamming-windowed sinc low-pass, unity DC gain */
+    double sum = 0.0;
+    int k;
+    for (k = 0; k <= FIR_ORDER; k++) {
+        double m = k - FIR_ORDER/2.0;
+        double wc = 2.0*M_PI*FIR_CUTOFF/FREQ_SAMPLE;
+        double h = (m == 0.0) ? wc/M_PI : sin(wc*m)/(M_PI*m);
+        h *= 0.54 - 0.46*cos(2.0*M_PI*k/FIR_ORDER);
+        fir_coeffs[k] = (float)h;
+        sum += h;
+    }
+    for (k = 0; k <= FIR_ORDER; k++) {
+        fir_coeffs[k] /= (float)sum;
+        fir_coeffs_q15[k] = (int16_t)lrint(fir_coeffs[k]*32768.0);
+    }
+}
+
+
+static void designBiquad(void) {
+    /* Butterworth low-pass by bilinear transform (same design as encoder velocity filter), twice */
+    double k = tan(M_PI*FIR_CUTOFF/FREQ_SAMPLE);
+    double norm = 1.0/(1.0 + M_SQRT2*k + k*k);
+    int i;
+    for (i = 0; i < 2; i++) {
+        biquad_coeffs[i][0] = (float)(k*k*norm);
+        biquad_coeffs[i][1] = (float)(2.0*k*k*norm);
+        biquad_coeffs[i][2] = (float)(k*k*norm);
+        biquad_coeffs[i][3] = (float)(2.0*(k*k - 1.0)*norm);
+        biquad_coeffs[i][4] = (float)((1.0 - M_SQRT2*k + k*k)*norm);
+    }
+}
+
+
+static void evalPoly(const float * c, int n, double w, double * re, double * im) {
+    /* c[0] + c[1] z^-1 + ... at z = e^(jw) */
+    int i;
+    *re = 0.0;
+    *im = 0.0;
+    for (i = 0; i < n; i++) {
+        *re += c[i]*cos(w*i);
+        *im -= c[i]*sin(w*i);
+    }
+}
+
+
+static double gainFir(double freq) {
+    double re, im;
+    evalPoly(fir_coeffs, FIR_ORDER + 1, 2.0*M_PI*freq/FREQ_SAMPLE, &re, &im);
+    return hypot(re, im);
+}
+
+
+static double gainBiquad(double freq, int num_sections) {
+    double w = 2.0*M_PI*freq/FREQ_SAMPLE;
+    double gain = 1.0;
+    int i;
+    for (i = 0; i < num_sections; i++) {
+        const float den[3] = {1.0f, biquad_coeffs[i][3], biquad_coeffs[i][4]};
+        double num_re, num_im, den_re, den_im;
+        evalPoly(biquad_coeffs[i], 3, w, &num_re, &num_im);
+        evalPoly(den, 3, w, &den_re, &den_im);
+        gain *= hypot(num_re, num_im)/hypot(den_re, den_im);
+    }
+    return gain;
+}
+
+
+static double measureGain(filt_run_t run, void * filt, double freq, double amp) {
+    /* Steady-state output amplitude over input amplitude for a sinusoid at freq */
+    double sum_s = 0.0, sum_c = 0.0;
+    int i;
+    for (i = 0; i < NUM_SETTLE + NUM_MEASURE; i++) {
+        double phase = 2.0*M_PI*freq*i/FREQ_SAMPLE;
+        float y = run(filt, (float)(amp*sin(phase)));
+        if (i >= NUM_SETTLE) {
+            sum_s += y*sin(phase);
+            sum_c += y*cos(phase);
+        }
+    }
+    return 2.0*hypot(sum_s, sum_c)/(NUM_MEASURE*amp);
+}
+
+
+static float runFir(void * filt, float x) {
+    return Filt_updateFir(filt, x);
+}
+
+
+static float runFirQ15(void * filt, float x) {
+    return Filt_updateFirQ15(filt, (int16_t)lrintf(x));
+}
+
+
+static float runBiquad(void * filt, float x) {
+    return Filt_updateBiquad(filt, x);
+}
+
+
+static void testFir(void) {
+    /* Impulse response is the taps (through buffer wrap), gain matches coefficients */
+    static const double freqs[] = {0.0, 5.0, 20.0, 30.0, 50.0, 100.0, 200.0};
+    filt_fir_t fir;
+    float buf[FILT_FIR_BUF_LEN(FIR_ORDER)];
+    int i, k;
+    Filt_initFir(&fir, fir_coeffs, buf, FIR_ORDER);
+    for (i = 0; i < 3*(FIR_ORDER + 1); i++) { // pass buffer wrap twice
+        Filt_updateFir(&fir, 0.0f);
+    }
+    for (k = 0; k <= FIR_ORDER; k++) {
+        CHECK(Filt_updateFir(&fir, (0 == k) ? 1.0f : 0.0f) == fir_coeffs[k]);
+    }
+    CHECK(Filt_updateFir(&fir, 0.0f) == 0.0f);
+
+    for (i = 0; i < (int)(sizeof(freqs)/sizeof(freqs[0])); i++) {
+        Filt_initFir(&fir, fir_coeffs, buf, FIR_ORDER);
+        double gain = 0.0;
+        if (0.0 == freqs[i]) { // step settles after order + 1 samples
+            for (k = 0; k <= FIR_ORDER; k++) {
+                gain = runFir(&fir, 1.0f);
+            }
+        }
+        else {
+            gain = measureGain(runFir, &fir, freqs[i], 1.0);
+        }
+        CHECK_NEAR(gain, gainFir(freqs[i]), 1e-4);
+    }
+    printf("FIR order %d gain at %.0f Hz: %.4f\n", FIR_ORDER, FIR_CUTOFF, gainFir(FIR_CUTOFF));
+}
+
+
+static void testFirQ15(void) {
+    /* Q15 FIR within rounding of float FIR, same response, even and odd tap counts */
+    filt_fir_t fir;
+    filt_fir_q15_t fir_q15;
+    float buf[FILT_FIR_BUF_LEN(FIR_ORDER)];
+    int16_t buf_q15[FILT_FIR_BUF_LEN(FIR_ORDER)];
+    uint32_t seed = 1;
+    int order, i;
+    for (order = FIR_ORDER - 1; order <= FIR_ORDER; order++) {
+        int err_max = 0;
+        Filt_initFir(&fir, fir_coeffs, buf, order);
+        Filt_initFirQ15(&fir_q15, fir_coeffs_q15, buf_q15, order);
+        for (i = 0; i < 10000; i++) {
+            seed = seed*1664525u + 1013904223u;
+            int16_t x = (int16_t)((int32_t)(seed >> 16) - 32768)/2; // stays in range after gain
+            float y = Filt_updateFir(&fir, (float)x);
+            int err = abs(Filt_updateFirQ15(&fir_q15, x) - (int)lrintf(y));
+            if (err > err_max) {
+                err_max = err;
+            }
+        }
+        printf("Q15 FIR order %d max deviation from float: %d LSB\n", order, err_max);
+        CHECK(err_max <= 4); // tap quantization, 0.5 LSB per tap at most on half scale input
+    }
+    Filt_initFirQ15(&fir_q15, fir_coeffs_q15, buf_q15, FIR_ORDER);
+    CHECK_NEAR(measureGain(runFirQ15, &fir_q15, 20.0, 16384.0), gainFir(20.0), 1e-3);
+    Filt_initFirQ15(&fir_q15, fir_coeffs_q15, buf_q15, FIR_ORDER);
+    CHECK_NEAR(measureGain(runFirQ15, &fir_q15, 100.0, 16384.0), gainFir(100.0), 1e-3);
+}
+
+
+static void testBiquad(void) {
+    /* Butterworth: unity DC gain, -3 dB at cutoff per section, cascade multiplies */
+    static const double freqs[] = {5.0, 30.0, 60.0, 150.0};
+    float state[2][2];
+    filt_biquad_t bq;
+    int n, i;
+    for (n = 1; n <= 2; n++) {
+        for (i = 0; i < (int)(sizeof(freqs)/sizeof(freqs[0])); i++) {
+            Filt_initBiquad(&bq, (const float (*)[5])biquad_coeffs, state, n);
+            CHECK_NEAR(measureGain(runBiquad, &bq, freqs[i], 1.0), gainBiquad(freqs[i], n), 1e-4);
+        }
+    }
+    CHECK_NEAR(gainBiquad(FIR_CUTOFF, 1), M_SQRT1_2, 1e-4);
+    CHECK_NEAR(gainBiquad(0.0, 2), 1.0, 1e-5);
+    Filt_initBiquad(&bq, (const float (*)[5])biquad_coeffs, state, 2);
+    float y = 0.0f;
+    for (i = 0; i < 500; i++) {
+        y = Filt_updateBiquad(&bq, 3.0f);
+    }
+    CHECK_NEAR(y, 3.0, 1e-4);
+}
+
+
+static void testAvg(void) {
+    /* Exact mean of last samples, no round-off drift over long runs with large offset */
+    filt_avg_t avg;
+    float buf[AVG_LEN];
+    double hist[AVG_LEN] = {0};
+    double err_max = 0.0;
+    uint32_t seed = 7;
+    int i;
+    Filt_initAvg(&avg, buf, AVG_LEN);
+    for (i = 0; i < 1000000; i++) {
+        seed = seed*1664525u + 1013904223u;
+        float x = 1000.0f + (float)(seed >> 20)*0.001f;
+        hist[i % AVG_LEN] = x;
+        float y = Filt_updateAvg(&avg, x);
+        double mean = 0.0;
+        int k;
+        for (k = 0; k < AVG_LEN; k++) {
+            mean += hist[k];
+        }
+        mean /= AVG_LEN;
+        if (fabs(y - mean) > err_max) {
+            err_max = fabs(y - mean);
+        }
+    }
+    printf("moving average max error after 1e6 samples: %.2e\n", err_max);
+    CHECK(err_max < 1e-3);
+}
+
+
+static void testBench(void) {
+    /* Host ns per sample of each filter */
+    filt_fir_t fir;
+    filt_fir_q15_t fir_q15;
+    filt_biquad_t bq;
+    filt_avg_t avg;
+    float buf[FILT_FIR_BUF_LEN(FIR_ORDER)];
+    int16_t buf_q15[FILT_FIR_BUF_LEN(FIR_ORDER)];
+    float state[2][2];
+    float buf_avg[AVG_LEN];
+    double t_start, t_fir, t_q15, t_bq1, t_bq2, t_avg;
+    int i;
+
+    Filt_initFir(&fir, fir_coeffs, buf, FIR_ORDER);
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = Filt_updateFir(&fir, (float)(i & 255));
+    }
+    t_fir = (Test_timeNs() - t_start)/NUM_BENCH;
+
+    Filt_initFirQ15(&fir_q15, fir_coeffs_q15, buf_q15, FIR_ORDER);
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = Filt_updateFirQ15(&fir_q15, (int16_t)(i & 255));
+    }
+    t_q15 = (Test_timeNs() - t_start)/NUM_BENCH;
+
+    Filt_initBiquad(&bq, (const float (*)[5])biquad_coeffs, state, 1);
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = Filt_updateBiquad(&bq, (float)(i & 255));
+    }
+    t_bq1 = (Test_timeNs() - t_start)/NUM_BENCH;
+
+    Filt_initBiquad(&bq, (const float (*)[5])biquad_coeffs, state, 2);
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = Filt_updateBiquad(&bq, (float)(i & 255));
+    }
+    t_bq2 = (Test_timeNs() - t_start)/NUM_BENCH;
+
+    Filt_initAvg(&avg, buf_avg, AVG_LEN);
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        sink = Filt_updateAvg(&avg, (float)(i & 255));
+    }
+    t_avg = (Test_timeNs() - t_start)/NUM_BENCH;
+
+    printf("host ns/sample: FIR %d taps %.2f, Q15 FIR %.2f, biquad x1 %.2f, x2 %.2f, average %d %.2f\n",
+        FIR_ORDER + 1, t_fir, t_q15, t_bq1, t_bq2, AVG_LEN, t_avg);
+}
+
+
+int main(void) {
+    designFir();
+    designBiquad();
+    testFir();
+    testFirQ15();
+    testBiquad();
+    testAvg();
+    testBench();
+    return TEST_RESULT();
+}
@@ -0,0 +1,201 @@
+/**
+* @file test_i2c.c
+* @brief Host test of the I2C transaction engine
+*
+* Drives i2c_cust.c against the EUSCI_B1 emulation: byte order on the bus,
+* START/RESTART/STOP counts per transaction, NACK, queueing with callbacks,
+* DMA reads with automatic STOP, and sleeping in I2Cc_wait
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "mock.h"
+#include "i2c_cust.h"
+#include <string.h>
+
+
+/* Module variables */
+static int order_callback[2];   // transactions in order of completion callbacks
+static int num_callback = 0;
+
+
+static void callbackRecord(i2c_trans_t * trans) {
+    /* Record completion order by transaction context */
+    if (num_callback < 2) {
+        order_callback[num_callback] = *(int *)trans->context;
+    }
+    num_callback++;
+}
+
+
+static void testWrite(void) {
+    /* Register write: one transaction, pointer byte then data */
+    Mock_i2cReset();
+    CHECK(I2Cc_write(MOCK_IMU_ADDR, 0x6B, 0x01) == 0);
+    CHECK(mock_imu_reg[0x6B] == 0x01);
+    CHECK(mock_i2c.starts == 1);
+    CHECK(mock_i2c.restarts == 0);
+    CHECK(mock_i2c.stops == 1);
+    CHECK(mock_i2c.bytes_tx == 2);
+    CHECK(mock_i2c.bytes_rx == 0);
+}
+
+
+static void testRead(void) {
+    /* Single byte read: pointer write, RESTART, byte, STOP set from receive interrupt */
+    unsigned char data = 0;
+    Mock_i2cReset();
+    mock_imu_reg[0x75] = 0x68;
+    mock_imu_reg[0x76] = 0x55;
+    CHECK(I2Cc_read(MOCK_IMU_ADDR, 0x75, &data) == 0);
+    CHECK(data == 0x68);
+    CHECK(mock_i2c.starts == 1);
+    CHECK(mock_i2c.restarts == 1);
+    CHECK(mock_i2c.stops == 1);
+    CHECK(mock_i2c.bytes_tx == 1);
+    CHECK(mock_i2c.bytes_rx == 2);  // byte held on the bus when STOP was set is discarded
+}
+
+
+static void testBurstRead(void) {
+    /* Burst read: big-endian register pairs arrive in host order */
+    int16_t data[3];
+    const uint8_t regs[6] = {0x12, 0x34, 0xFF, 0xFE, 0x80, 0x00};
+    Mock_i2cReset();
+    memcpy(&mock_imu_reg[0x3B], regs, sizeof(regs));
+    CHECK(I2Cc_burstRead2(MOCK_IMU_ADDR, 0x3B, 6, data) == 0);
+    CHECK(data[0] == 0x1234);
+    CHECK(data[1] == -2);
+    CHECK(data[2] == -32768);
+    CHECK(mock_i2c.starts == 1);
+    CHECK(mock_i2c.restarts == 1);
+    CHECK(mock_i2c.stops == 1);
+    CHECK(mock_i2c.bytes_rx == 6);
+    CHECK(mock_i2c.wakes > 0);      // waited asleep, interrupt routine did the work
+    CHECK(mock_i2c.irqs > 0);
+}
+
+
+static void testNack(void) {
+    /* Missing slave: transaction aborted with STOP, engine free for the next one */
+    unsigned char data = 0;
+    Mock_i2cReset();
+    CHECK(I2Cc_write(MOCK_IMU_ADDR + 1, 0x6B, 0x01) == -1);
+    CHECK(mock_i2c.nacks == 1);
+    CHECK(mock_i2c.stops == 1);
+    mock_imu_reg[0x75] = 0x68;
+    CHECK(I2Cc_read(MOCK_IMU_ADDR, 0x75, &data) == 0);
+    CHECK(data == 0x68);
+}
+
+
+static void testQueue(void) {
+    /* Two queued transactions run back to back, callbacks in submission order */
+    static const uint8_t tx_a[2] = {0x19, 0x07};
+    static const uint8_t tx_b = 0x19;
+    static int id_a = 1, id_b = 2;
+    uint8_t rx_b = 0;
+    i2c_trans_t trans_a = {
+        .addr_slave = MOCK_IMU_ADDR, .data_tx = tx_a, .num_tx = 2,
+        .callback = callbackRecord, .context = &id_a,
+    };
+    i2c_trans_t trans_b = {
+        .addr_slave = MOCK_IMU_ADDR, .data_tx = &tx_b, .num_tx = 1, .data_rx = &rx_b, .num_rx = 1,
+        .callback = callbackRecord, .context = &id_b,
+    };
+    Mock_i2cReset();
+    num_callback = 0;
+    CHECK(I2Cc_submit(&trans_a) == 0);
+    CHECK(I2Cc_submit(&trans_b) == 0);
+    CHECK(trans_b.status == I2CC_STATUS_QUEUED);
+    CHECK(I2Cc_wait(&trans_b) == 0);
+    CHECK(trans_a.status == I2CC_STATUS_DONE);
+    CHECK(rx_b == 0x07);            // read back what the first transaction wrote
+    CHECK(num_callback == 2);
+    CHECK(order_callback[0] == 1);
+    CHECK(order_callback[1] == 2);
+    CHECK(mock_i2c.starts == 2);
+    CHECK(mock_i2c.stops == 2);
+}
+
+
+static void testDma(void) {
+    /* DMA read: bytes land without receive interrupts, byte counter generates STOP */
+    uint8_t data[14];
+    static const uint8_t tx = 0x3B;
+    int i;
+    i2c_trans_t trans = {
+        .addr_slave = MOCK_IMU_ADDR, .data_tx = &tx, .num_tx = 1, .data_rx = data, .num_rx = 14,
+        .flag_dma = 1,
+    };
+    Mock_i2cReset();
+    for (i = 0; i < 14; i++) {
+        mock_imu_reg[0x3B + i] = 0xA0 + i;
+    }
+    CHECK(I2Cc_transfer(&trans) == 0);
+    for (i = 0; i < 14; i++) {
+        CHECK(data[i] == 0xA0 + i);
+    }
+    CHECK(mock_i2c.restarts == 1);
+    CHECK(mock_i2c.stops == 1);
+    CHECK(mock_i2c.bytes_rx == 14);
+    CHECK(mock_i2c.irqs < 14);      // no interrupt per received byte
+    CHECK(trans.cycles > 0);
+}
+
+
+static void testMasked(void) {
+    /* Interrupts masked (start-up): wait sleeps and services the engine itself */
+    int16_t data[2];
+    const uint8_t regs[4] = {0x01, 0x02, 0x03, 0x04};
+    Mock_i2cReset();
+    memcpy(&mock_imu_reg[0x43], regs, sizeof(regs));
+    mock_primask = 1;
+    CHECK(I2Cc_burstRead2(MOCK_IMU_ADDR, 0x43, 4, data) == 0);
+    CHECK(mock_primask == 1);       // mask left as found
+    mock_primask = 0;
+    CHECK(data[0] == 0x0102);
+    CHECK(data[1] == 0x0304);
+    CHECK(mock_i2c.irqs == 0);      // interrupt routine never ran
+    CHECK(mock_i2c.wakes > 0);
+    CHECK(mock_i2c.stops == 1);
+}
+
+
+static void testSubmitMask(void) {
+    /* Submit masks by priority (BASEPRI), never PRIMASK, and keeps a stricter outer mask */
+    static const uint8_t tx[2] = {0x1A, 0x03};
+    i2c_trans_t trans = {.addr_slave = MOCK_IMU_ADDR, .data_tx = tx, .num_tx = 2};
+    Mock_i2cReset();
+    mock_basepri = PRIORITY_TICK; // submitted from tick interrupt, as IMU_startReadDma
+    CHECK(I2Cc_submit(&trans) == 0);
+    CHECK(mock_basepri == PRIORITY_TICK);   // mask left as found
+    CHECK(mock_primask == 0);
+    mock_basepri = 0;
+    CHECK(I2Cc_wait(&trans) == 0);
+    CHECK(mock_imu_reg[0x1A] == 0x03);
+    CHECK(mock_i2c.irqs > 0);
+}
+
+
+int main(void) {
+    Mock_i2cReset();
+    I2Cc_initAsync();
+    CHECK(mock_int_enabled[INT_EUSCIB1]);
+    CHECK(mock_int_priority[INT_EUSCIB1] == I2CC_INT_PRIORITY);
+    I2Cc_initDma();
+
+    testWrite();
+    testRead();
+    testBurstRead();
+    testNack();
+    testQueue();
+    testDma();
+    testMasked();
+    testSubmitMask();
+    return TEST_RESULT();
+}
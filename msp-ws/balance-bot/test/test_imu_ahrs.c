@@ -0,0 +1,115 @@
+/**
+* @file test_imu_ahrs.c
+* @brief Host test of quaternion attitude estimation
+*
+* Initial attitude, convergence and gyro bias tracking from a wrong start,
+* and consistency of combined rotations (yaw while pitched) on simulated
+* gyro and accelerometer data
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "mpu6050.h"
+
+
+/* Macros */
+#define FREQ_SAMPLE 500.0f          // (Hz) sample rate
+#define NUM_BENCH 1000000           // updates per timing run
+
+
+/* Module variables */
+static volatile float sink;         // keeps benchmarked results alive
+
+
+static void upFromPitch(float pitch, float * up) {
+    /* Up direction in body frame pitched about x (deg), as measured by accelerometer at rest (g) */
+    float rad = pitch*(float)M_PI/180.0f;
+    up[0] = 0.0f;
+    up[1] = cosf(rad);
+    up[2] = -sinf(rad);
+}
+
+
+static void testInit(void) {
+    /* Pitch and roll from initial quaternion read back through accelerometer formulas */
+    imu_ahrs_t est;
+    float angle[3];
+    IMUahrs_init(&est, 30.0f, -10.0f);
+    IMU_calcAngleAccel(est.up, angle);
+    CHECK_NEAR(angle[0], 30.0, 0.01);
+    CHECK_NEAR(angle[2], -10.0, 0.01);
+    CHECK_NEAR(est.q[0]*est.q[0] + est.q[1]*est.q[1] + est.q[2]*est.q[2] + est.q[3]*est.q[3], 1.0, 1e-5);
+}
+
+
+static void testConverge(void) {
+    /* Wrong start and gyro bias: pitch converges, integral term takes up the bias */
+    const float bias = 2.0f; // (deg/s) on x
+    const float ang_vel[3] = {bias, 0.0f, 0.0f};
+    imu_ahrs_t est;
+    float up[3], angle[3];
+    int i;
+    upFromPitch(20.0f, up);
+    IMUahrs_init(&est, 0.0f, 0.0f);
+    for (i = 0; i < 300*(int)FREQ_SAMPLE; i++) { // integral time constant about K_P/K_I = 50 s
+        IMUahrs_update(&est, ang_vel, up, 1.0f/FREQ_SAMPLE);
+    }
+    IMU_calcAngleAccel(est.up, angle);
+    printf("AHRS after 300 s: pitch %.3f deg, bias correction %.3f deg/s\n",
+        angle[0], est.bias_integ[0]/IMUAHRS_DEG_TO_RAD);
+    CHECK_NEAR(angle[0], 20.0, 0.1);
+    CHECK_NEAR(est.bias_integ[0]/IMUAHRS_DEG_TO_RAD, -bias, 0.1*bias);
+}
+
+
+static void testYawWhilePitched(void) {
+    /* Rotation about world vertical keeps pitch (no accelerometer correction) and reads as yaw rate */
+    const float rate = 90.0f; // (deg/s)
+    const float accel[3] = {0.0f, 0.0f, 0.0f}; // skip correction: pure gyro integration
+    imu_ahrs_t est;
+    float up[3], ang_vel[3], angle[3];
+    int i, axis;
+    upFromPitch(30.0f, up);
+    for (axis = 0; axis < 3; axis++) {
+        ang_vel[axis] = rate*up[axis];
+    }
+    IMUahrs_init(&est, 30.0f, 0.0f);
+    for (i = 0; i < 10*(int)FREQ_SAMPLE; i++) { // 2.5 turns
+        IMUahrs_update(&est, ang_vel, accel, 1.0f/FREQ_SAMPLE);
+    }
+    IMU_calcAngleAccel(est.up, angle);
+    printf("AHRS after 900 deg yaw at 30 deg pitch: pitch %.4f deg, roll %.4f deg\n", angle[0], angle[2]);
+    CHECK_NEAR(angle[0], 30.0, 0.01);
+    CHECK_NEAR(angle[2], 0.0, 0.01);
+    CHECK_NEAR(est.yaw_rate, rate, 0.01);
+}
+
+
+static void testBench(void) {
+    /* Host ns per update */
+    const float ang_vel[3] = {1.0f, -2.0f, 0.5f};
+    float up[3];
+    imu_ahrs_t est;
+    int i;
+    upFromPitch(10.0f, up);
+    IMUahrs_init(&est, 0.0f, 0.0f);
+    double t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        IMUahrs_update(&est, ang_vel, up, 1.0f/FREQ_SAMPLE);
+    }
+    sink = est.q[0];
+    printf("host ns/update: %.2f\n", (Test_timeNs() - t_start)/NUM_BENCH);
+}
+
+
+int main(void) {
+    testInit();
+    testConverge();
+    testYawWhilePitched();
+    testBench();
+    return TEST_RESULT();
+}
@@ -0,0 +1,171 @@
+/**
+* @file test_imu_fixed.c
+* @brief Host comparison of fixed-point and float attitude estimation
+*
+* Built with IMU_ESTIMATOR = IMU_EST_FIXED: raw counts of a simulated pitch
+* oscillation, with accelerometer bias/misalignment and a gyro offset that
+* drifts with temperature, go through IMU_takeSample/IMU_calcAngleFused
+* (counts straight to imu_fixed.c) and through IMU_procSample and the shipped
+* float complementary filter, IMU_calcAngleFusedFloat, with the same
+* calibration. Angles and calibrated rates must agree; host time per sample of
+* both paths is reported. Validation is against synthetic samples only.
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "mpu6050.h"
+#include <string.h>
+
+
+/* Macros */
+#define FREQ_SAMPLE 500.0f          // (Hz) sample rate
+#define NUM_SAMPLES 10000           // samples simulated (20 s)
+#define PITCH_AMP 20.0f             // (deg) pitch oscillation amplitude
+#define PITCH_FREQ 0.5f             // (Hz) pitch oscillation frequency
+#define TEMP_START 20.0f            // (degC) die temperature at start
+#define TEMP_END 40.0f              // (degC) die temperature at end
+#define NUM_BENCH 200000            // samples per timing run
+
+
+/* Module variables */
+static volatile imu_t imu_fix;
+static volatile imu_t imu_flt;
+static imu_sample_t samples[NUM_SAMPLES];
+static const float accel_a[3][3] = { // measured = A*gravity + bias
+    {1.02f, 0.01f, -0.02f},
+    {-0.01f, 0.98f, 0.015f},
+    {0.02f, -0.01f, 1.01f},
+};
+static const float accel_bias[3] = {0.03f, -0.02f, 0.05f}; // (g)
+static const float gyro_offset[3] = {1.5f, -0.8f, 0.3f}; // (deg/s) at IMU_TEMP_REF
+static const float gyro_temp_coef[3][2] = {{0.03f, 0.001f}, {-0.02f, 0.0f}, {0.01f, -0.0005f}};
+
+
+static int16_t toCounts(float x) {
+    /* Round to sample counts */
+    return (int16_t)lrintf(x);
+}
+
+
+static void simulate(void) {
+    /* Generate raw samples of pitch oscillation about x */
+    uint32_t seed = 1;
+    int i, axis;
+    for (i = 0; i < NUM_SAMPLES; i++) {
+        float t = (float)i/FREQ_SAMPLE;
+        float w = 2.0f*(float)M_PI*PITCH_FREQ;
+        float pitch = PITCH_AMP*sinf(w*t)*(float)M_PI/180.0f; // (rad)
+        float rate = PITCH_AMP*w*cosf(w*t); // (deg/s)
+        float temp = TEMP_START + (TEMP_END - TEMP_START)*t*FREQ_SAMPLE/NUM_SAMPLES;
+        float temp_rel = temp - IMU_TEMP_REF;
+        const float gravity[3] = {0.0f, cosf(pitch), -sinf(pitch)}; // (g) sensor frame
+        const float rate_true[3] = {rate, 0.0f, 0.0f};
+        for (axis = 0; axis < 3; axis++) {
+            seed = seed*1664525u + 1013904223u;
+            float noise = (float)((int)(seed >> 29) - 4)*0.5f; // (counts)
+            float accel = accel_a[axis][0]*gravity[0] + accel_a[axis][1]*gravity[1]
+                + accel_a[axis][2]*gravity[2] + accel_bias[axis];
+            float offset = gyro_offset[axis]
+                + temp_rel*(gyro_temp_coef[axis][0] + temp_rel*gyro_temp_coef[axis][1]);
+            samples[i].accel[axis] = toCounts(accel*(float)IMU_ACCEL_SENS_2 + noise);
+            samples[i].gyro[axis] = toCounts((rate_true[axis] + offset)*(float)IMU_GYRO_SENS_1000 + noise);
+        }
+        samples[i].temp = toCounts((temp - IMU_TEMP_OFFSET)*IMU_TEMP_SENS);
+    }
+}
+
+
+static void setup(volatile imu_t * imu) {
+    /* Same sensitivity and calibration for both estimators */
+    float poses[IMU_CAL_ACCEL_POSES][3];
+    int i, j;
+    memset((void *)imu, 0, sizeof(*imu));
+    imu->sens.gyro = IMU_GYRO_SENS_1000;
+    imu->sens.accel = IMU_ACCEL_SENS_2;
+    for (j = 0; j < 3; j++) { // poses: +/- gravity along each axis
+        for (i = 0; i < 3; i++) {
+            poses[2*j][i] = accel_a[i][j] + accel_bias[i];
+            poses[2*j + 1][i] = -accel_a[i][j] + accel_bias[i];
+        }
+    }
+    CHECK(IMU_calibrateAccel(imu, poses));
+    IMU_procSample(imu, &samples[0]);
+    IMU_initCal(imu);
+    IMU_setCal(imu, gyro_offset, gyro_temp_coef);
+}
+
+
+static void calcFloat(volatile imu_t * imu, float period) {
+    /* Shipped float estimator with background calibration, as IMU_calcAngleFused runs it */
+    IMU_calcAngleFusedFloat(imu, period);
+    IMU_updateCal(imu);
+}
+
+
+static void testAccuracy(void) {
+    /* Both paths track each other over the whole run and the true pitch */
+    const float period = 1.0f/FREQ_SAMPLE;
+    float err_angle = 0, err_rate = 0, err_accel = 0, err_true = 0;
+    int i, axis;
+    setup(&imu_fix);
+    setup(&imu_flt);
+    for (i = 0; i < NUM_SAMPLES; i++) {
+        IMU_takeSample(&imu_fix, &samples[i]);
+        IMU_calcAngleFused(&imu_fix, period);
+        IMU_procSample(&imu_flt, &samples[i]);
+        calcFloat(&imu_flt, period);
+
+        err_angle = fmaxf(err_angle, fabsf(imu_fix.angle.fused[0][0] - imu_flt.angle.fused[0][0]));
+        for (axis = 0; axis < 3; axis++) {
+            err_rate = fmaxf(err_rate, fabsf(imu_fix.raw.ang_vel[axis] - imu_flt.raw.ang_vel[axis]));
+            err_accel = fmaxf(err_accel, fabsf(imu_fix.raw.accel[axis] - imu_flt.raw.accel[axis]));
+        }
+        if (i > NUM_SAMPLES/2) { // settled
+            float t = (float)i/FREQ_SAMPLE;
+            float pitch = PITCH_AMP*sinf(2.0f*(float)M_PI*PITCH_FREQ*t);
+            err_true = fmaxf(err_true, fabsf(imu_fix.angle.fused[0][0] - pitch));
+        }
+    }
+    printf("fixed vs float: angle %.4f deg, rate %.4f deg/s, accel %.5f g; vs true pitch %.3f deg\n",
+        err_angle, err_rate, err_accel, err_true);
+    CHECK(err_angle < 0.05f);
+    CHECK(err_rate < 0.01f);     // temperature model folded into offsets
+    CHECK(err_accel < 0.001f);   // bias and misalignment applied to counts
+    CHECK(err_true < 0.5f);
+    CHECK_NEAR(imu_fix.raw.temp, imu_flt.raw.temp, 1e-4);
+}
+
+
+static void testBench(void) {
+    /* Host time per sample: conversion, estimator and background calibration */
+    const float period = 1.0f/FREQ_SAMPLE;
+    int i;
+    setup(&imu_fix);
+    setup(&imu_flt);
+    double t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        IMU_takeSample(&imu_fix, &samples[i % NUM_SAMPLES]);
+        IMU_calcAngleFused(&imu_fix, period);
+    }
+    double t_fix = (Test_timeNs() - t_start)/NUM_BENCH;
+    t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        IMU_procSample(&imu_flt, &samples[i % NUM_SAMPLES]);
+        calcFloat(&imu_flt, period);
+    }
+    double t_flt = (Test_timeNs() - t_start)/NUM_BENCH;
+    printf("host ns/sample: fixed %.1f, float %.1f (relative only: host FPU and libm, not Cortex-M4F)\n",
+        t_fix, t_flt);
+}
+
+
+int main(void) {
+    simulate();
+    testAccuracy();
+    testBench();
+    return TEST_RESULT();
+}
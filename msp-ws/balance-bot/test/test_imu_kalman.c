@@ -0,0 +1,120 @@
+/**
+* @file test_imu_kalman.c
+* @brief Host test of Kalman filter pitch estimation
+*
+* Precomputed gain against a double precision Riccati solution, and bias
+* tracking and noise rejection on a simulated pitch oscillation with gyro
+* bias and noisy accelerometer pitch
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "imu_kalman.h"
+
+
+/* Macros */
+#define FREQ_SAMPLE 500.0f          // (Hz) sample rate
+#define NUM_SAMPLES 30000           // samples simulated (60 s)
+#define PITCH_AMP 10.0f             // (deg) pitch oscillation amplitude
+#define PITCH_FREQ 0.5f             // (Hz) pitch oscillation frequency
+#define GYRO_BIAS 3.0f              // (deg/s) simulated gyro bias
+#define NUM_BENCH 1000000           // updates per timing run
+
+
+/* Module variables */
+static uint32_t seed = 1;           // noise generator state
+static volatile float sink;         // keeps benchmarked results alive
+
+
+static float noiseGauss(void) {
+    /* Standard normal sample (Box-Muller on LCG) */
+    seed = seed*1664525u + 1013904223u;
+    double u1 = ((seed >> 8) + 1.0)/16777217.0;
+    seed = seed*1664525u + 1013904223u;
+    double u2 = (seed >> 8)/16777216.0;
+    return (float)(sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2));
+}
+
+
+static void testGain(void) {
+    /* Steady-state gain matches Riccati iteration in double precision */
+    const double dt = 1.0/FREQ_SAMPLE;
+    double p00 = IMUKAL_P0_ANGLE, p01 = 0.0, p10 = 0.0, p11 = IMUKAL_P0_BIAS;
+    double k0 = 0.0, k1 = 0.0;
+    imu_kalman_t est;
+    int i;
+    for (i = 0; i < 1000000; i++) {
+        p00 += dt*(dt*p11 - p01 - p10 + IMUKAL_Q_ANGLE);
+        p01 -= dt*p11;
+        p10 -= dt*p11;
+        p11 += IMUKAL_Q_BIAS*dt;
+        k0 = p00/(p00 + IMUKAL_R_ANGLE);
+        k1 = p10/(p00 + IMUKAL_R_ANGLE);
+        double q00 = p00 - k0*p00, q01 = p01 - k0*p01, q10 = p10 - k1*p00, q11 = p11 - k1*p01;
+        p00 = q00;
+        p01 = q01;
+        p10 = q10;
+        p11 = q11;
+    }
+    IMUkal_init(&est, 0.0f, 1.0f/FREQ_SAMPLE);
+    printf("Kalman gain: %.6f, %.6f (double precision %.6f, %.6f)\n", est.k[0], est.k[1], k0, k1);
+    CHECK_NEAR(est.k[0], k0, 0.02*k0);
+    CHECK_NEAR(est.k[1], k1, 0.02*fabs(k1));
+    CHECK(est.k[1] < 0.0f); // accel above estimate: rate underestimated, bias too high
+}
+
+
+static void testTrack(void) {
+    /* Bias learned online, angle error well below accelerometer noise */
+    const float sigma_accel = sqrtf(IMUKAL_R_ANGLE); // (deg)
+    imu_kalman_t est;
+    double err_sq_sum = 0.0, accel_sq_sum = 0.0;
+    int count = 0;
+    int i;
+    IMUkal_init(&est, 0.0f, 1.0f/FREQ_SAMPLE);
+    for (i = 0; i < NUM_SAMPLES; i++) {
+        float t = (float)i/FREQ_SAMPLE;
+        float w = 2.0f*(float)M_PI*PITCH_FREQ;
+        float pitch = PITCH_AMP*sinf(w*t);
+        float rate = PITCH_AMP*w*cosf(w*t);
+        float angle_accel = pitch + sigma_accel*noiseGauss();
+        IMUkal_update(&est, rate + GYRO_BIAS, angle_accel);
+        if (i >= NUM_SAMPLES/2) { // settled
+            err_sq_sum += (est.angle - pitch)*(est.angle - pitch);
+            accel_sq_sum += (angle_accel - pitch)*(angle_accel - pitch);
+            count++;
+        }
+    }
+    double rms = sqrt(err_sq_sum/count);
+    printf("Kalman: bias %.3f deg/s, angle rms error %.4f deg (accel %.4f deg)\n",
+        est.bias, rms, sqrt(accel_sq_sum/count));
+    CHECK_NEAR(est.bias, GYRO_BIAS, 0.1);
+    CHECK(rms < 0.3*sigma_accel);
+    CHECK_NEAR(est.rate, PITCH_AMP*2.0*M_PI*PITCH_FREQ*cos(2.0*M_PI*PITCH_FREQ*(NUM_SAMPLES - 1)/FREQ_SAMPLE), 0.2);
+}
+
+
+static void testBench(void) {
+    /* Host ns per update */
+    imu_kalman_t est;
+    int i;
+    IMUkal_init(&est, 0.0f, 1.0f/FREQ_SAMPLE);
+    double t_start = Test_timeNs();
+    for (i = 0; i < NUM_BENCH; i++) {
+        IMUkal_update(&est, (float)(i & 15), (float)(i & 7));
+    }
+    sink = est.angle;
+    printf("host ns/update: %.2f\n", (Test_timeNs() - t_start)/NUM_BENCH);
+}
+
+
+int main(void) {
+    testGain();
+    testTrack();
+    testBench();
+    return TEST_RESULT();
+}
@@ -0,0 +1,337 @@
+/**
+* @file test_motor_pid.c
+* @brief Host test of the motor velocity controller
+*
+* Closed loop on a simulated DC motor with dead zone through Motor_velUpdate
+* and the staged PWM registers: settling time, overshoot and steady-state
+* error of set-point steps, ramp tracking with the model's acceleration
+* feed-forward, integrator windup at saturation, motor characterization, and
+* every command checked against a double-precision controller fed the same
+* measurements. Built as float (test_motor_pid) and Q15 (MOTOR_PID_Q15,
+* test_motor_pid_q15); the shared reference makes the two equivalent
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "motor.h"
+
+
+/* Macros */
+#define PERIOD_CONTROL 0.002        // (s) controller period
+#define PERIOD_PWM 600              // (timer counts) 20 kHz at 12 MHz SMCLK
+#define PLANT_DEADZONE 8.0          // (% duty cycle) duty below which motor stays still
+#define PLANT_GAIN 10.0             // ((deg/s)/%) steady-state velocity per duty above dead zone
+#define PLANT_TAU 0.05              // (s) velocity time constant
+#define PLANT_SUBSTEPS 20           // plant integration steps per control period
+#define SETTLE_BAND 0.02            // settling band, fraction of step
+#define DEG_PER_COUNT (360.0/1400.0) // (deg) encoder resolution
+#if MOTOR_PID_Q15
+#define U_TOL (0.5*MOTOR_DUTY_MAX/PERIOD_PWM) // (% duty cycle) command deviation from reference: Q15
+    // quantization, within half a PWM timer count
+#else
+#define U_TOL 1e-3                  // (% duty cycle) command deviation from reference: float rounding
+#endif
+
+
+/* Data types */
+typedef struct {
+    double k_p, k_i_dt, k_d_dt, k_aw_dt, u_max;
+    double integ, vel_prev, vel_des, u_ff, k_ff_vel, k_ff_acc;
+    int off;
+} ref_pid_t;                        // double-precision controller, same law as Motor_calcPid
+
+typedef struct {
+    double settle;                  // (s) time after step until velocity stays in band
+    double overshoot;               // overshoot, fraction of step
+    double err_final;               // (deg/s) velocity error at end of run
+    double u_dev;                   // (% duty cycle) max command deviation from reference
+} step_result_t;
+
+
+/* Module variables */
+static const motor_gains_t gains = { // as in main.c
+    .k_p = 0.03f,
+    .k_i = 2.5f,
+    .k_d = 0.0f,
+    .k_aw = 80.0f,
+    .k_ff_vel = 0.0f,
+    .k_ff_acc = 0.0f,
+};
+static uint16_t reg_forward;
+static uint16_t reg_back;
+static motor_t motor;
+static ref_pid_t ref;
+static double vel_plant;            // (deg/s) simulated motor velocity
+static double gain_plant;           // ((deg/s)/%) simulated motor gain
+
+
+static void refInit(const motor_t * m) {
+    /* Reference gains and state from the same inputs as Motor_initPid */
+    ref = (ref_pid_t){0};
+    ref.k_p = gains.k_p;
+    ref.k_i_dt = (double)gains.k_i*PERIOD_CONTROL;
+    ref.k_d_dt = (double)gains.k_d/PERIOD_CONTROL;
+    ref.k_aw_dt = (double)gains.k_aw*PERIOD_CONTROL;
+    ref.u_max = MOTOR_DUTY_MAX*(PERIOD_PWM - MOTOR_CCR_MIN)/(double)PERIOD_PWM - m->deadzone;
+    ref.k_ff_vel = (m->gain > 0.0f) ? 1.0/m->gain : gains.k_ff_vel;
+    ref.k_ff_acc = (m->gain > 0.0f) ? (double)m->tau/m->gain : gains.k_ff_acc;
+    ref.off = 1;
+}
+
+
+static double refCalc(double vel) {
+    /* One reference controller step */
+    if (ref.off) {
+        ref.integ = 0.0;
+        ref.vel_prev = vel;
+        return 0.0;
+    }
+    double err = ref.vel_des - vel;
+    double u_unsat = ref.k_p*err + ref.integ + ref.k_d_dt*(ref.vel_prev - vel) + ref.u_ff;
+    ref.vel_prev = vel;
+    double u = fmax(-ref.u_max, fmin(ref.u_max, u_unsat));
+    #if MOTOR_ANTIWINDUP == MOTOR_AW_BACKCALC
+        ref.integ += ref.k_i_dt*err + ref.k_aw_dt*(u - u_unsat);
+    #else
+        if ((u == u_unsat) || ((u_unsat > u) == (err < 0))) {
+            ref.integ += ref.k_i_dt*err;
+        }
+    #endif
+    ref.integ = fmax(-ref.u_max, fmin(ref.u_max, ref.integ));
+    return u;
+}
+
+
+static void setVel(double vel_des, double acc_des) {
+    /* New set-point and its rate of change for motor and reference */
+    Motor_setVel(&motor, (float)vel_des, (float)acc_des);
+    ref.vel_des = vel_des;
+    ref.u_ff = ref.k_ff_vel*vel_des + ref.k_ff_acc*acc_des;
+    ref.off = (fabs(vel_des) < MOTOR_VEL_DEADBAND);
+}
+
+
+static double stagedDuty(void) {
+    /* Signed duty (%) of staged fast-decay output, from set/reset register values */
+    uint16_t ccr = (motor.pwm_next.dir < 0) ? motor.pwm_next.back : motor.pwm_next.forward;
+    if ((0 == motor.pwm_next.dir) || (MOTOR_CCR_OFF == ccr)) {
+        return 0.0;
+    }
+    return motor.pwm_next.dir*(motor.period - ccr)*MOTOR_DUTY_MAX/motor.period;
+}
+
+
+static void stepPlant(double duty) {
+    /* Motor over one control period: no torque inside dead zone, first-order lag outside */
+    double u = (duty > PLANT_DEADZONE) ? duty - PLANT_DEADZONE :
+        ((duty < -PLANT_DEADZONE) ? duty + PLANT_DEADZONE : 0.0);
+    int i;
+    for (i = 0; i < PLANT_SUBSTEPS; i++) {
+        vel_plant += (gain_plant*u - vel_plant)*(PERIOD_CONTROL/PLANT_SUBSTEPS)/PLANT_TAU;
+    }
+}
+
+
+static void initLoop(float deadzone, float gain, float tau) {
+    /* Motor at rest with given compensation model */
+    motor = (motor_t){0};
+    motor.reg_duty.forward = &reg_forward;
+    motor.reg_duty.back = &reg_back;
+    motor.period = PERIOD_PWM;
+    motor.decay = MOTOR_DECAY_FAST;
+    motor.deadzone = deadzone;
+    motor.gain = gain;
+    motor.tau = tau;
+    Motor_initPid(&motor, &gains, (float)PERIOD_CONTROL);
+    refInit(&motor);
+    vel_plant = 0.0;
+    gain_plant = PLANT_GAIN;
+}
+
+
+static step_result_t runStep(double vel_des, double time) {
+    /* Step set-point from current velocity and run closed loop */
+    step_result_t res = {0};
+    double vel_start = vel_plant;
+    double step = vel_des - vel_start;
+    double peak = 0.0;
+    int n = (int)(time/PERIOD_CONTROL + 0.5);
+    int i;
+    setVel(vel_des, 0.0);
+    for (i = 0; i < n; i++) {
+        float vel_meas = (float)vel_plant;
+        Motor_velUpdate(&motor, vel_meas);
+        double u_ref = refCalc(vel_meas);
+        double dev = fabs(motor.pid_vel.u - u_ref);
+        if (dev > res.u_dev) {
+            res.u_dev = dev;
+        }
+        stepPlant(stagedDuty());
+
+        double progress = (vel_plant - vel_start)/step;
+        if (progress - 1.0 > peak) {
+            peak = progress - 1.0;
+        }
+        if (fabs(progress - 1.0) > SETTLE_BAND) {
+            res.settle = (i + 1)*PERIOD_CONTROL;
+        }
+    }
+    res.overshoot = peak;
+    res.err_final = vel_des - vel_plant;
+    return res;
+}
+
+
+static double runRamp(double vel_end, double time) {
+    /* Ramp set-point from rest with acceleration feed-forward: returns max tracking error (deg/s) */
+    double acc = vel_end/time;
+    double err_max = 0.0;
+    int n = (int)(time/PERIOD_CONTROL + 0.5);
+    int i;
+    for (i = 1; i <= n; i++) {
+        double vel_des = acc*i*PERIOD_CONTROL;
+        setVel(vel_des, acc);
+        float vel_meas = (float)vel_plant;
+        Motor_velUpdate(&motor, vel_meas);
+        double u_ref = refCalc(vel_meas);
+        CHECK(fabs(motor.pid_vel.u - u_ref) < U_TOL);
+        stepPlant(stagedDuty());
+        err_max = fmax(err_max, fabs(vel_des + acc*PERIOD_CONTROL - vel_plant)); // vs set-point at end of period
+    }
+    return err_max;
+}
+
+
+static void report(const char * name, step_result_t res) {
+    printf("%-28s settle %.3f s, overshoot %5.1f %%, final error %6.3f deg/s, max |u - u_ref| %.2e %%\n",
+        name, res.settle, 100.0*res.overshoot, res.err_final, res.u_dev);
+    CHECK(res.u_dev < U_TOL);
+}
+
+
+static void testStepModel(void) {
+    /* Identified model: feed-forward reaches set-point alone, integrator charged during the lag
+       adds overshoot (main.c integral gain is tuned for the unmodelled loop) */
+    initLoop(PLANT_DEADZONE, PLANT_GAIN, PLANT_TAU);
+    step_result_t res = runStep(400.0, 1.0);
+    report("step 0 -> 400, model", res);
+    CHECK(res.settle < 0.35);
+    CHECK(res.overshoot < 0.3);
+    CHECK(fabs(res.err_final) < 0.5);
+
+    res = runStep(-300.0, 1.0);
+    report("step 400 -> -300, model", res);
+    CHECK(res.settle < 0.35); // includes crossing dead zone
+    CHECK(res.overshoot < 0.3);
+    CHECK(fabs(res.err_final) < 0.5);
+}
+
+
+static void testRamp(void) {
+    /* Identified time constant adds acceleration feed-forward: ramp tracked without lag */
+    initLoop(PLANT_DEADZONE, PLANT_GAIN, PLANT_TAU);
+    double err_model = runRamp(400.0, 0.2);
+    initLoop(PLANT_DEADZONE, PLANT_GAIN, 0.0f);
+    double err_static = runRamp(400.0, 0.2);
+    printf("ramp 0 -> 400 in 0.2 s       max error %.1f deg/s with tau, %.1f deg/s without\n",
+        err_model, err_static);
+    CHECK(err_model < 0.25*err_static);
+}
+
+
+static void testStepNoModel(void) {
+    /* No model: integrator supplies the steady-state command, dead zone still compensated */
+    initLoop(PLANT_DEADZONE, 0.0f, 0.0f);
+    step_result_t res = runStep(400.0, 2.0);
+    report("step 0 -> 400, no model", res);
+    CHECK(res.settle < 0.3);
+    CHECK(res.overshoot < 0.15);
+    CHECK(fabs(res.err_final) < 0.5);
+}
+
+
+static void testWindup(void) {
+    /* Set-point beyond reach saturates command; return below it without windup overshoot */
+    initLoop(PLANT_DEADZONE, 0.0f, 0.0f);
+    step_result_t res = runStep(2000.0, 1.0);
+    report("step 0 -> 2000 (saturated)", res);
+    CHECK(fabs(motor.pid_vel.u + PLANT_DEADZONE - Motor_getDutyMax(&motor)) < U_TOL);
+    CHECK(fabs(stagedDuty() - Motor_getDutyMax(&motor)) < 0.5*Motor_getResolution(&motor)); // reaches cap
+    CHECK(vel_plant < 2000.0);
+    res = runStep(300.0, 2.0);
+    report("step saturated -> 300", res);
+    CHECK(res.settle < 0.4);
+    CHECK(res.overshoot < 0.2); // clamped integrator held at saturation, not wound up
+    CHECK(fabs(res.err_final) < 0.5);
+}
+
+
+static void testOff(void) {
+    /* Set-point inside deadband switches output off and clears integrator */
+    initLoop(PLANT_DEADZONE, 0.0f, 0.0f);
+    runStep(200.0, 0.5);
+    step_result_t res = runStep(0.5*MOTOR_VEL_DEADBAND, 0.5);
+    CHECK(0.0f == motor.pid_vel.u);
+    CHECK(0 == motor.pid_vel.integ);
+    CHECK(0 == motor.pwm_next.dir);
+    CHECK(fabs(vel_plant) < 1.0);
+    CHECK(res.u_dev < U_TOL);
+}
+
+
+static int runChar(motor_char_t * ch) {
+    /* Characterization on simulated motor until finished: returns control periods taken */
+    double pos = 0.0; // (deg)
+    int n = 0;
+    Motor_initChar(ch, 0);
+    while (!Motor_updateChar(&motor, ch, (int)floor(pos/DEG_PER_COUNT), (float)vel_plant,
+        (float)PERIOD_CONTROL) && (n < 100000)) {
+        double vel_start = vel_plant;
+        stepPlant(stagedDuty());
+        pos += 0.5*(vel_start + vel_plant)*PERIOD_CONTROL;
+        n++;
+    }
+    return n;
+}
+
+
+static void testChar(void) {
+    /* Breakaway and first-order model identified; failed run leaves motor model untouched */
+    motor_char_t ch;
+    initLoop(0.0f, 0.0f, 0.0f);
+    int n = runChar(&ch);
+    printf("characterization: %.1f s, dead zone %.2f %%, gain %.2f (deg/s)/%%, tau %.4f s\n",
+        n*PERIOD_CONTROL, motor.deadzone, motor.gain, motor.tau);
+    CHECK(MOTOR_CHAR_DONE == ch.stage);
+    CHECK(motor.deadzone >= PLANT_DEADZONE);
+    CHECK(motor.deadzone < PLANT_DEADZONE + 2.0); // ramp continues until 8 counts have turned
+    CHECK(ch.deadzone == motor.deadzone);
+    CHECK(fabs(motor.gain - PLANT_GAIN) < 0.1*PLANT_GAIN); // absorbs dead zone overestimate
+    CHECK(fabs(motor.tau - PLANT_TAU) < 0.1*PLANT_TAU);
+
+    initLoop(12.0f, 7.0f, 0.1f); // motor stalled: no breakaway below duty cap
+    gain_plant = 0.0;
+    runChar(&ch);
+    CHECK(MOTOR_CHAR_FAILED == ch.stage);
+    CHECK(12.0f == motor.deadzone);
+    CHECK(7.0f == motor.gain);
+    CHECK(0.1f == motor.tau);
+    CHECK(0 == motor.pwm_next.dir);
+}
+
+
+int main(void) {
+    printf("motor PID %s, %s anti-windup\n", MOTOR_PID_Q15 ? "Q15" : "float",
+        (MOTOR_ANTIWINDUP == MOTOR_AW_BACKCALC) ? "back-calculation" : "clamping");
+    testStepModel();
+    testRamp();
+    testStepNoModel();
+    testWindup();
+    testOff();
+    testChar();
+    return TEST_RESULT();
+}
@@ -0,0 +1,243 @@
+/**
+* @file test_motor_pwm.c
+* @brief Host test of the motor PWM output layer
+*
+* Mocked TIMER_A0 compare registers with a per-count set/reset output model
+* (up mode: output set when the count reaches CCRn, reset when it reaches
+* CCR0). Motor_commitPwm runs as the CCR0 interrupt a given number of counts
+* into each period. Every duty of both decay modes, reversals, two-motor
+* commits and commit latency are checked count by count
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "mock.h"
+#include "motor.h"
+
+
+/* Macros */
+#define FREQ_PWM 20000              // (Hz) PWM frequency: 600 counts at MOCK_SMCLK
+#define NUM_CCR 5                   // TA0CCR0-4
+#define LATENCY_COMMIT ((MOTOR_CYCLES_ENTRY + MOTOR_CYCLES_COMMIT + MOTOR_CYCLES_MASKED \
+    + MOTOR_CYCLES_PER_COUNT - 1)/MOTOR_CYCLES_PER_COUNT) // (timer counts) worst-case boundary to last
+    // register write
+
+
+/* Data types */
+typedef struct {
+    int rises;                      // output rising edges in period
+    int falls;                      // output falling edges in period
+    int rise_at;                    // (timer count) last rising edge
+    int high;                       // (timer counts) time high
+    bool high_at_start;             // output high at first count of period
+} pwm_out_t;
+
+typedef struct {
+    int drive[2];                   // (timer counts) forward only, back only high
+    int brake;                      // (timer counts) both high
+    int coast;                      // (timer counts) both low
+} pwm_bridge_t;
+
+
+/* Module variables */
+static uint16_t ccr[NUM_CCR];       // TA0CCR0-4 (CCR0 written through MAP_Timer_A_setCompareValue)
+static bool out[NUM_CCR];           // TA0.1-4 output levels
+static motor_t motor_r = {.reg_duty = {&ccr[1], &ccr[2]}};
+static motor_t motor_l = {.reg_duty = {&ccr[4], &ccr[3]}};
+static motor_t * const motors[2] = {&motor_r, &motor_l};
+static pwm_out_t outs[NUM_CCR];     // outputs over last period
+static pwm_bridge_t bridges[2];     // H-bridge input states over last period (right, left)
+
+
+static void runPeriod(int latency) {
+    /* One timer period, counts 0 to CCR0, with period interrupt committing at count latency */
+    static const int chans[2][2] = {{1, 2}, {4, 3}}; // forward, back register of right and left
+    int t, c, m;
+    for (c = 1; c < NUM_CCR; c++) {
+        outs[c] = (pwm_out_t){.rise_at = -1, .high_at_start = out[c]};
+    }
+    for (m = 0; m < 2; m++) {
+        bridges[m] = (pwm_bridge_t){{0, 0}, 0, 0};
+    }
+    for (t = 0; t <= mock_ta_ccr0; t++) {
+        if (t == latency) {
+            Motor_commitPwm(motors, 2);
+        }
+        for (c = 1; c < NUM_CCR; c++) {
+            if ((t == ccr[c]) && !out[c]) {
+                out[c] = 1;
+                outs[c].rises++;
+                outs[c].rise_at = t;
+            }
+            if ((t == mock_ta_ccr0) && out[c]) {
+                out[c] = 0;
+                outs[c].falls++;
+            }
+            outs[c].high += out[c];
+        }
+        for (m = 0; m < 2; m++) {
+            bool fwd = out[chans[m][0]];
+            bool back = out[chans[m][1]];
+            if (fwd && back) {
+                bridges[m].brake++;
+            }
+            else if (fwd) {
+                bridges[m].drive[0]++;
+            }
+            else if (back) {
+                bridges[m].drive[1]++;
+            }
+            else {
+                bridges[m].coast++;
+            }
+        }
+    }
+}
+
+
+static void initPwm(void) {
+    /* Outputs off, staged nothing */
+    int c;
+    for (c = 0; c < NUM_CCR; c++) {
+        ccr[c] = 0;
+        out[c] = 0;
+    }
+    CHECK(0 == Motor_initPwm(motors, 2, 0, FREQ_PWM));
+    CHECK(mock_ta_ccr0 == MOCK_SMCLK/FREQ_PWM);
+    runPeriod(LATENCY_COMMIT);
+}
+
+
+static int onCounts(int k) {
+    /* Expected drive time (counts) for a duty of k counts: at most period minus commit margin */
+    int on_max = motor_r.period - MOTOR_CCR_MIN;
+    return (k > on_max) ? on_max : k;
+}
+
+
+static void checkSteady(int m, int k, uint8_t decay) {
+    /* Motor m drove k counts (signed) last period, every edge in place */
+    static const int chans[2][2] = {{1, 2}, {4, 3}};
+    const pwm_bridge_t * b = &bridges[m];
+    int period = motor_r.period;
+    int on = onCounts((k < 0) ? -k : k);
+    int dir = (k > 0) - (k < 0);
+    int c;
+    for (c = 0; c < 2; c++) {
+        const pwm_out_t * o = &outs[chans[m][c]];
+        CHECK(!o->high_at_start); // low when commit lands
+        CHECK(o->rises <= 1);
+        CHECK(o->rises == o->falls);
+        CHECK((o->rise_at < 0) || (o->rise_at >= MOTOR_CCR_MIN)); // set points after commit margin
+    }
+    if (MOTOR_DECAY_FAST == decay) {
+        CHECK(0 == b->brake);
+        CHECK(b->drive[0] == ((dir > 0) ? on : 0));
+        CHECK(b->drive[1] == ((dir < 0) ? on : 0));
+        CHECK(b->coast == period + 1 - on);
+    }
+    else {
+        CHECK(b->drive[0] == ((dir > 0) ? on : 0));
+        CHECK(b->drive[1] == ((dir < 0) ? on : 0));
+        CHECK(b->brake == period - MOTOR_CCR_MIN - on); // rest of period after commit margin
+        CHECK(b->coast == MOTOR_CCR_MIN + 1);
+    }
+}
+
+
+static void testDuty(uint8_t decay) {
+    /* Every duty count both ways: right forward, left back, committed in the same period */
+    int period, k;
+    initPwm();
+    period = motor_r.period;
+    for (k = 0; k <= period; k++) {
+        float duty = (float)k*MOTOR_DUTY_MAX/period;
+        Motor_setOutput(&motor_r, duty, decay);
+        Motor_setOutput(&motor_l, -duty, decay);
+        Motor_releasePwm();
+        runPeriod(LATENCY_COMMIT); // first reversal of left holds both inputs low
+        runPeriod(LATENCY_COMMIT);
+        checkSteady(0, k, decay);
+        checkSteady(1, -k, decay);
+    }
+}
+
+
+static void testReversal(uint8_t decay) {
+    /* Direction change goes through one period with both inputs low, then drives the other way */
+    initPwm();
+    Motor_setOutput(&motor_r, 50.0f, decay);
+    Motor_setOutput(&motor_l, 50.0f, decay);
+    Motor_releasePwm();
+    runPeriod(LATENCY_COMMIT);
+    checkSteady(0, motor_r.period/2, decay);
+
+    Motor_setOutput(&motor_r, -50.0f, decay);
+    Motor_setOutput(&motor_l, 25.0f, decay);
+    Motor_releasePwm();
+    runPeriod(LATENCY_COMMIT);
+    CHECK(bridges[0].coast == motor_r.period + 1);
+    checkSteady(1, motor_l.period/2, decay); // left holds previous duty while right is off
+    runPeriod(LATENCY_COMMIT);
+    checkSteady(0, -motor_r.period/2, decay); // both change in the same period
+    checkSteady(1, motor_l.period/4, decay);
+
+    Motor_setOutput(&motor_r, 0.0f, decay); // stop, then other way: zero state already passed
+    Motor_releasePwm();
+    runPeriod(LATENCY_COMMIT);
+    CHECK(((MOTOR_DECAY_FAST == decay) ? bridges[0].coast : bridges[0].brake) ==
+        ((MOTOR_DECAY_FAST == decay) ? motor_r.period + 1 : motor_r.period - MOTOR_CCR_MIN));
+    Motor_setOutput(&motor_r, 50.0f, decay);
+    Motor_releasePwm();
+    runPeriod(LATENCY_COMMIT);
+    checkSteady(0, motor_r.period/2, decay);
+}
+
+
+static void testStaging(void) {
+    /* Nothing commits until released; a motor staged after release holds the commit */
+    initPwm();
+    Motor_setOutput(&motor_r, 50.0f, MOTOR_DECAY_FAST);
+    runPeriod(LATENCY_COMMIT);
+    CHECK(0 == bridges[0].drive[0]);
+    Motor_releasePwm();
+    Motor_setOutput(&motor_l, 50.0f, MOTOR_DECAY_FAST); // main loop still staging
+    runPeriod(LATENCY_COMMIT);
+    CHECK(0 == bridges[0].drive[0]);
+    CHECK(0 == bridges[1].drive[0]);
+    Motor_releasePwm();
+    runPeriod(LATENCY_COMMIT);
+    checkSteady(0, motor_r.period/2, MOTOR_DECAY_FAST);
+    checkSteady(1, motor_l.period/2, MOTOR_DECAY_FAST);
+}
+
+
+static void testLatency(void) {
+    /* Commit by MOTOR_CCR_MIN keeps full duty; later commit misses the earliest set point */
+    initPwm();
+    Motor_setOutput(&motor_r, MOTOR_DUTY_MAX, MOTOR_DECAY_FAST);
+    Motor_releasePwm();
+    runPeriod(MOTOR_CCR_MIN);
+    checkSteady(0, motor_r.period, MOTOR_DECAY_FAST);
+
+    initPwm();
+    Motor_setOutput(&motor_r, MOTOR_DUTY_MAX, MOTOR_DECAY_FAST);
+    Motor_releasePwm();
+    runPeriod(MOTOR_CCR_MIN + 1);
+    CHECK(0 == outs[1].rises); // set point passed before register was written: runt period
+}
+
+
+int main(void) {
+    testDuty(MOTOR_DECAY_FAST);
+    testDuty(MOTOR_DECAY_SLOW);
+    testReversal(MOTOR_DECAY_FAST);
+    testReversal(MOTOR_DECAY_SLOW);
+    testStaging();
+    testLatency();
+    return TEST_RESULT();
+}
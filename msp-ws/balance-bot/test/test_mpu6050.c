@@ -0,0 +1,316 @@
+/**
+* @file test_mpu6050.c
+* @brief Host test of MPU-6050 sample reads
+*
+* Runs the driver against the emulated bus and register file: configuration is
+* written and verified, a sample is one burst transaction, registers land in
+* imu_sample_t in host byte order, blocking and DMA reads agree, the
+* data-ready pulse is configured, FIFO overflow is taken from INT_STATUS,
+* background calibration accepts only stationary windows and fits the gyro
+* offset temperature model, and the six-pose accelerometer fit recovers bias
+* and skew
+*
+* @author Lucas Tiziani
+* @date 2021-01-16
+*
+*/
+
+
+#include "test.h"
+#include "mock.h"
+#include "mpu6050.h"
+#include <string.h>
+
+
+/* Module variables */
+static volatile imu_t imu;
+static const int16_t sample_ref[7] = { // accel x/y/z, temp, gyro x/y/z (counts)
+    4096, -8192, 16384, -1700, 131, -262, 32767,
+};
+
+
+static void loadSample(void) {
+    /* Place reference sample in data registers, big-endian as the IMU does */
+    int i;
+    for (i = 0; i < 7; i++) {
+        mock_imu_reg[IMU_REG_ACCEL_XOUT1 + 2*i] = (uint16_t)sample_ref[i] >> 8;
+        mock_imu_reg[IMU_REG_ACCEL_XOUT1 + 2*i + 1] = (uint16_t)sample_ref[i] & 0xFF;
+    }
+}
+
+
+static void checkSample(const imu_sample_t * sample) {
+    /* Sample fields match reference in register order */
+    int axis;
+    for (axis = 0; axis < 3; axis++) {
+        CHECK(sample->accel[axis] == sample_ref[axis]);
+        CHECK(sample->gyro[axis] == sample_ref[4 + axis]);
+    }
+    CHECK(sample->temp == sample_ref[3]);
+}
+
+
+static void testReadSample(void) {
+    /* One burst: pointer byte, RESTART, 14 data bytes, STOP */
+    imu_sample_t sample;
+    Mock_i2cReset();
+    loadSample();
+    IMU_readSample(&sample);
+    checkSample(&sample);
+    CHECK(mock_i2c.starts == 1);
+    CHECK(mock_i2c.restarts == 1);
+    CHECK(mock_i2c.stops == 1);
+    CHECK(mock_i2c.bytes_tx == 1);
+    CHECK(mock_i2c.bytes_rx == IMU_NUM_SAMPLE_BYTES);
+}
+
+
+static void testInit(void) {
+    /* Configuration written and verified; unknown identity rejected */
+    Mock_i2cReset();
+    mock_imu_reg[IMU_REG_WHO_AM_I] = IMU_WHO_AM_I;
+    CHECK(IMU_init(&imu, 44, 1000, 2) == 0);
+    CHECK(mock_imu_reg[IMU_REG_PWR_MGMT1] == 0x03);
+    CHECK(mock_imu_reg[IMU_REG_CONFIG] == 0x03);
+    CHECK(mock_imu_reg[IMU_REG_GYRO_CONFIG] == 0x10);
+    CHECK(mock_imu_reg[IMU_REG_ACCEL_CONFIG] == 0x00);
+    CHECK_NEAR(imu.sens.gyro, IMU_GYRO_SENS_1000, 1e-3);
+    CHECK(mock_i2c.nacks == 0);
+    CHECK(mock_i2c.starts == mock_i2c.stops);
+
+    mock_imu_reg[IMU_REG_WHO_AM_I] = 0x72;
+    CHECK(IMU_init(&imu, 44, 1000, 2) == -1);
+    mock_imu_reg[IMU_REG_WHO_AM_I] = IMU_WHO_AM_I;
+    CHECK(IMU_init(&imu, 44, 1000, 2) == 0);
+}
+
+
+static void testReadVals(void) {
+    /* Blocking read converts to physical units */
+    Mock_i2cReset();
+    loadSample();
+    IMU_readVals(&imu);
+    checkSample((const imu_sample_t *)&imu.sample);
+    CHECK_NEAR(imu.raw.accel[0], 4096/IMU_ACCEL_SENS_2, 1e-6);
+    CHECK_NEAR(imu.raw.accel[1], -8192/IMU_ACCEL_SENS_2, 1e-6);
+    CHECK_NEAR(imu.raw.accel[2], 1.0, 1e-6);
+    CHECK_NEAR(imu.raw.temp, -1700/IMU_TEMP_SENS + IMU_TEMP_OFFSET, 1e-4);
+    CHECK_NEAR(imu.raw.ang_vel[0], 131/imu.sens.gyro, 1e-4);
+    CHECK(imu.cycles.read_blocking > 0);
+}
+
+
+static void testReadSampleTimed(void) {
+    /* Timed read refreshes blocking read cost, sample goes to caller only */
+    imu_sample_t sample;
+    Mock_i2cReset();
+    loadSample();
+    imu.cycles.read_blocking = 0;
+    IMU_readSampleTimed(&imu, &sample);
+    checkSample(&sample);
+    CHECK(imu.cycles.read_blocking > 0);
+}
+
+
+static void testReadDma(void) {
+    /* DMA read delivers the same sample through its double buffer */
+    volatile bool flag_done = 0;
+    Mock_i2cReset();
+    loadSample();
+    imu.raw.accel[2] = 0.0f; // left from blocking read
+    imu.raw.ang_vel[0] = 0.0f;
+    CHECK(IMU_startReadDma(&flag_done) == 0);
+    CHECK(IMU_startReadDma(&flag_done) == -1); // previous read still on the bus
+    while (!flag_done) {
+        CPU_cpsid();
+        CPU_wfi();
+        CPU_cpsie();
+    }
+    IMU_finishReadDma(&imu);
+    CHECK_NEAR(imu.raw.accel[2], 1.0, 1e-6);
+    CHECK_NEAR(imu.raw.ang_vel[0], 131/imu.sens.gyro, 1e-4);
+    CHECK(mock_i2c.starts == 1);
+    CHECK(mock_i2c.stops == 1);
+    CHECK(mock_i2c.bytes_rx == IMU_NUM_SAMPLE_BYTES);
+    CHECK(imu.cycles.read_dma > 0);
+}
+
+
+static void testDataReady(void) {
+    /* Data-ready pulse: sample rate divider, pulsed INT pin, DATA_RDY interrupt only */
+    Mock_i2cReset();
+    IMU_initDataReady(1);
+    CHECK(mock_imu_reg[IMU_REG_SMPLRT_DIV] == 1);
+    CHECK(mock_imu_reg[IMU_REG_INT_PIN_CFG] == IMU_INT_RD_CLEAR);
+    CHECK(mock_imu_reg[IMU_REG_INT_ENABLE] == IMU_INT_DATA_RDY);
+    CHECK(mock_i2c.nacks == 0);
+    CHECK(mock_i2c.stops == 3);
+}
+
+
+static void setFifoState(uint8_t int_status, uint16_t count) {
+    /* Load interrupt status and FIFO fill level registers */
+    mock_imu_reg[IMU_REG_INT_STATUS] = int_status;
+    mock_imu_reg[IMU_REG_FIFO_COUNTH] = count >> 8;
+    mock_imu_reg[IMU_REG_FIFO_COUNTH + 1] = count & 0xFF;
+}
+
+
+static void testReadFifo(void) {
+    /* Overflow is taken from INT_STATUS, fill level only guards sample alignment */
+    imu_sample_t samples[IMU_FIFO_MAX_SAMPLES];
+    Mock_i2cReset();
+    IMU_initFifo(0);
+    CHECK(mock_imu_reg[IMU_REG_INT_ENABLE] & IMU_INT_FIFO_OFLOW);
+    CHECK(mock_imu_reg[IMU_REG_USER_CTRL] == IMU_USER_FIFO_EN);
+    imu.fifo.overflows = 0;
+    imu.fifo.misaligned = 0;
+
+    setFifoState(0, 2*IMU_NUM_SAMPLE_BYTES);
+    CHECK(IMU_readFifo(&imu, samples, IMU_FIFO_MAX_SAMPLES) == 2);
+
+    setFifoState(IMU_INT_FIFO_OFLOW, 70*IMU_NUM_SAMPLE_BYTES); // aligned, but samples were lost
+    mock_imu_reg[IMU_REG_USER_CTRL] = 0;
+    CHECK(IMU_readFifo(&imu, samples, IMU_FIFO_MAX_SAMPLES) == 0);
+    CHECK(imu.fifo.overflows == 1);
+    CHECK(mock_imu_reg[IMU_REG_USER_CTRL] == IMU_USER_FIFO_EN); // reset and re-enabled
+
+    setFifoState(0, IMU_NUM_SAMPLE_BYTES + 1);
+    CHECK(IMU_readFifo(&imu, samples, IMU_FIFO_MAX_SAMPLES) == 0);
+    CHECK(imu.fifo.overflows == 1);
+    CHECK(imu.fifo.misaligned == 1);
+
+    setFifoState(0, 20*IMU_NUM_SAMPLE_BYTES); // more than one read drains
+    CHECK(IMU_readFifo(&imu, samples, IMU_FIFO_MAX_SAMPLES) == IMU_FIFO_MAX_SAMPLES);
+    CHECK(mock_i2c.nacks == 0);
+}
+
+
+static void feedCal(imu_t * imu_cal, const imu_sample_t * sample, int n_samples) {
+    /* Run samples through conversion and estimator, background calibration included */
+    int i;
+    for (i = 0; i < n_samples; i++) {
+        IMU_procSample(imu_cal, sample);
+        IMU_calcAngleFused(imu_cal, 0.002f);
+    }
+}
+
+
+static void testBackgroundCal(void) {
+    /* Stationary windows average out gyro offset, motion and steady rotation are rejected */
+    imu_t imu_cal = {0};
+    imu_sample_t rest = {{0, 0, 16384}, 0, {131, -262, 66}}; // 1 g on z, about 4, -8, 2 deg/s offset
+    imu_sample_t moving = rest;
+    imu_sample_t turning = rest;
+    int axis, i, windows;
+    imu_cal.sens.gyro = IMU_GYRO_SENS_1000;
+    imu_cal.sens.accel = IMU_ACCEL_SENS_2;
+    IMU_procSample(&imu_cal, &rest);
+    IMU_initCal(&imu_cal);
+
+    feedCal(&imu_cal, &rest, IMU_CAL_WINDOWS_CONVERGE*IMU_CAL_WINDOW);
+    CHECK(imu_cal.cal.converged);
+    CHECK(imu_cal.cal.windows == IMU_CAL_WINDOWS_CONVERGE);
+    for (axis = 0; axis < 3; axis++) {
+        CHECK_NEAR(imu_cal.cal.ang_vel_offset[axis], rest.gyro[axis]/IMU_GYRO_SENS_1000, 1e-3);
+    }
+
+    windows = imu_cal.cal.windows;
+    for (i = 0; i < IMU_CAL_WINDOW; i++) { // shaken: gyro variance above threshold
+        moving.gyro[0] = rest.gyro[0] + ((i & 1) ? 300 : -300);
+        feedCal(&imu_cal, &moving, 1);
+    }
+    CHECK(imu_cal.cal.windows == windows);
+    turning.gyro[2] = rest.gyro[2] + 328; // 10 deg/s steady rotation: no variance, large mean
+    feedCal(&imu_cal, &turning, IMU_CAL_WINDOW);
+    CHECK(imu_cal.cal.windows == windows);
+    CHECK_NEAR(imu_cal.cal.ang_vel_offset[2], rest.gyro[2]/IMU_GYRO_SENS_1000, 1e-3);
+}
+
+
+static void testTempFit(void) {
+    /* Stationary windows over a warm-up fit the quadratic gyro offset model */
+    static const float offset[3] = {2.0f, -1.0f, 0.5f}; // (deg/s) at IMU_TEMP_REF
+    static const float coef[3][2] = {{0.03f, 0.001f}, {-0.02f, 0.0f}, {0.01f, -0.0005f}};
+    imu_t imu_cal = {0};
+    imu_sample_t rest = {{0, 0, 16384}, 0, {0, 0, 0}};
+    float temp;
+    int axis;
+    imu_cal.sens.gyro = IMU_GYRO_SENS_250; // finest count quantization
+    imu_cal.sens.accel = IMU_ACCEL_SENS_2;
+    IMU_procSample(&imu_cal, &rest);
+    IMU_initCal(&imu_cal);
+
+    for (temp = IMU_TEMP_REF; temp <= IMU_TEMP_REF + 20.0f; temp += 0.5f) { // one window per step
+        float temp_rel = temp - IMU_TEMP_REF;
+        rest.temp = (int16_t)lrintf((temp - IMU_TEMP_OFFSET)*IMU_TEMP_SENS);
+        for (axis = 0; axis < 3; axis++) {
+            float ang_vel = offset[axis] + temp_rel*(coef[axis][0] + temp_rel*coef[axis][1]);
+            rest.gyro[axis] = (int16_t)lrintf(ang_vel*(float)IMU_GYRO_SENS_250);
+        }
+        feedCal(&imu_cal, &rest, IMU_CAL_WINDOW);
+    }
+    CHECK(imu_cal.temp_fit.valid);
+    for (axis = 0; axis < 3; axis++) {
+        CHECK_NEAR(imu_cal.cal.ang_vel_offset[axis], offset[axis], 0.01);
+        CHECK_NEAR(imu_cal.cal.ang_vel_temp_coef[axis][0], coef[axis][0], 3e-4);
+        CHECK_NEAR(imu_cal.cal.ang_vel_temp_coef[axis][1], coef[axis][1], 3e-5);
+    }
+}
+
+
+static void testCalibrateAccel(void) {
+    /* Six-pose fit recovers bias and skew, corrected sample reads true gravity */
+    static const float a[3][3] = { // measured = A*gravity + bias
+        {1.02f, 0.01f, -0.02f},
+        {-0.01f, 0.98f, 0.015f},
+        {0.02f, -0.01f, 1.01f},
+    };
+    static const float bias[3] = {0.03f, -0.02f, 0.05f}; // (g)
+    static const float gravity[3] = {0.0f, 0.8660254f, -0.5f}; // (g) pitched 30 deg
+    float poses[IMU_CAL_ACCEL_POSES][3];
+    imu_t imu_cal = {0};
+    imu_sample_t sample = {{0, 0, 0}, 0, {0, 0, 0}};
+    int i, j;
+    imu_cal.sens.gyro = IMU_GYRO_SENS_1000;
+    imu_cal.sens.accel = IMU_ACCEL_SENS_2;
+    for (j = 0; j < 3; j++) { // poses: +/- gravity along each axis
+        for (i = 0; i < 3; i++) {
+            poses[2*j][i] = a[i][j] + bias[i];
+            poses[2*j + 1][i] = -a[i][j] + bias[i];
+        }
+    }
+    CHECK(IMU_calibrateAccel(&imu_cal, poses));
+    for (i = 0; i < 3; i++) {
+        CHECK_NEAR(imu_cal.cal.accel_bias[i], bias[i], 1e-6);
+        float accel = a[i][0]*gravity[0] + a[i][1]*gravity[1] + a[i][2]*gravity[2] + bias[i];
+        sample.accel[i] = (int16_t)lrintf(accel*(float)IMU_ACCEL_SENS_2);
+    }
+    IMU_procSample(&imu_cal, &sample);
+    for (i = 0; i < 3; i++) {
+        CHECK_NEAR(imu_cal.raw.accel[i], gravity[i], 1.5/IMU_ACCEL_SENS_2); // rounding of counts
+    }
+
+    memset(poses, 0, sizeof(poses)); // no distinct poses: previous calibration kept
+    CHECK(!IMU_calibrateAccel(&imu_cal, poses));
+    CHECK_NEAR(imu_cal.cal.accel_bias[0], bias[0], 1e-6);
+}
+
+
+int main(void) {
+    Mock_i2cReset();
+    I2Cc_initAsync();
+    I2Cc_initDma();
+
+    testInit();
+    testReadSample();
+    testReadVals();
+    testReadSampleTimed();
+    testReadDma();
+    testDataReady();
+    testReadFifo();
+    testBackgroundCal();
+    testTempFit();
+    testCalibrateAccel();
+    return TEST_RESULT();
+}
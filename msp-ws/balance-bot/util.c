@@ -41,3 +41,11 @@ void delayMs(int freq_clock, int n) {
         for (i = (freq_clock/HZ_PER_MS); i > 0; i--); // delay 1 ms
     }
 }
+
+
+void cycleCountInit(void) {
+    /* Start DWT cycle counter for timing measurements */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // enable trace block
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
@@ -1,8 +1,10 @@
 /**
 * @file util.h
-* @brief LED and delay utilities
+* @brief LED, delay and interrupt masking utilities
 *
-* LED and delay utilities for MSP432
+* LED and delay utilities for MSP432. Critical sections raise BASEPRI to the
+* encoder/I2C level instead of setting PRIMASK, so the PWM commit interrupt
+* (PRIORITY_PWM) is never held off by them.
 *
 * @author Lucas Tiziani
 * @date 2020-12-19
@@ -20,11 +22,35 @@
 
 /* Macros */
 #define HZ_PER_MS 12000 // clock Hz per millisecond delay
+#define CYCLE_COUNT() (DWT->CYCCNT) // (cycles) free-running CPU cycle counter
+
+// NVIC implements the upper 3 priority bits: levels are 0x00, 0x20, ... 0xE0
+#define PRIORITY_PWM 0x00 // PWM commit: must finish before earliest set point (MOTOR_CCR_MIN)
+#define PRIORITY_ENC 0x20 // encoder edges and I2C, highest level critical sections mask
+#define PRIORITY_TICK 0x40 // sensor and control ticks, IMU data ready
+
+
+/* Inline functions */
+static inline uint32_t criticalEnter(void) {
+    /* Mask interrupts at PRIORITY_ENC and below (BASEPRI), PWM commit still runs: returns previous mask */
+    uint32_t basepri = CPU_basepriGet();
+    if (!basepri || (basepri > PRIORITY_ENC)) { // never lower an outer mask
+        CPU_basepriSet(PRIORITY_ENC);
+    }
+    return basepri;
+}
+
+
+static inline void criticalExit(uint32_t basepri) {
+    /* Restore mask returned by criticalEnter */
+    CPU_basepriSet(basepri);
+}
 
 
 /* Function prototypes */
 void LED2_set(int state);
 void delayMs(int clockFreq, int n);
+void cycleCountInit(void);
 
 
 #endif /* UTIL_H_ */